@@ -0,0 +1,91 @@
+#ifndef SOLAR_SYSTEM_ALLOC_STATS_H
+#define SOLAR_SYSTEM_ALLOC_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+// Process-wide count of operator new calls, kept by the replacement operators in
+// src/alloc_stats.cpp. Used to check that hot paths (model import) don't allocate per element.
+struct AllocationCounter {
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> bytes{0};
+};
+
+inline AllocationCounter& Allocations() {
+    static AllocationCounter counter; // constant-initialised, safe to use from operator new
+    return counter;
+}
+
+// the same for the calling thread alone, so a window measured on one thread doesn't take in
+// what other threads (texture decodes, the model loader) allocate meanwhile
+struct ThreadAllocationCounter {
+    size_t count;
+    size_t bytes;
+};
+
+inline ThreadAllocationCounter& ThreadAllocations() {
+    static thread_local ThreadAllocationCounter counter = {0, 0}; // constant-initialised too
+    return counter;
+}
+
+struct AllocationSnapshot {
+    size_t count = 0;
+    size_t bytes = 0;
+
+    static AllocationSnapshot Now() {
+        AllocationSnapshot s;
+        s.count = Allocations().count.load(std::memory_order_relaxed);
+        s.bytes = Allocations().bytes.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // the calling thread's count
+    static AllocationSnapshot ThisThread() {
+        AllocationSnapshot s;
+        s.count = ThreadAllocations().count;
+        s.bytes = ThreadAllocations().bytes;
+        return s;
+    }
+
+    AllocationSnapshot Since(const AllocationSnapshot& earlier) const {
+        AllocationSnapshot d;
+        d.count = count - earlier.count;
+        d.bytes = bytes - earlier.bytes;
+        return d;
+    }
+};
+
+// the process's peak resident set size so far (VmHWM), 0 where /proc isn't available
+inline size_t PeakResidentBytes() {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status)
+        return 0;
+    char line[256];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            kb = strtoull(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return kb * 1024;
+}
+
+// the process's resident set size right now (from /proc/self/statm), 0 where /proc isn't
+// available
+inline size_t ResidentBytes() {
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    unsigned long long pages = 0, resident = 0;
+    int read = fscanf(statm, "%llu %llu", &pages, &resident);
+    fclose(statm);
+    return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+#endif //SOLAR_SYSTEM_ALLOC_STATS_H
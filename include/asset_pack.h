@@ -0,0 +1,509 @@
+#ifndef SOLAR_SYSTEM_ASSET_PACK_H
+#define SOLAR_SYSTEM_ASSET_PACK_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "content_hash.h"
+#include "lz4_block.h"
+#include "parallel.h"
+#include "batch_io.h"
+
+// Every file the viewer reads at start-up, in one file (cooked/assets.pack, written by
+// solar_cook). The pack is mapped once and its pages are read ahead in a single sequential
+// pass; loaders then get views straight into the mapping instead of opening, seeking and
+// copying hundreds of loose files.
+//
+//   PackHeader
+//   PackEntry[entryCount], sorted by path hash for binary search
+//   path names (entries point into them)
+//   blobs, each starting on a PACK_ALIGNMENT boundary:
+//     stored:     the file's bytes
+//     compressed: u32 compressedSize[chunkCount], then the chunks, each an independent LZ4
+//                 block of chunkBytes input bytes (the last one shorter)
+//
+// Compressed files inflate chunk by chunk on ParallelFor workers; files that LZ4 doesn't
+// shrink much (PNG, JPEG) are stored and handed out without copying.
+
+const char ASSET_PACK_MAGIC[4] = {'S', 'P', 'A', 'K'};
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint64_t PACK_ALIGNMENT = 4096;
+const uint32_t PACK_CHUNK_BYTES = 256 * 1024;
+const char* const ASSET_PACK_PATH = "cooked/assets.pack";
+
+struct PackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t chunkBytes;
+    uint64_t namesBytes;
+};
+
+const uint32_t PACK_ENTRY_COMPRESSED = 1;
+
+struct PackEntry {
+    uint64_t hash;       // HashString of the path
+    uint64_t offset;     // of the blob, from the start of the pack
+    uint64_t size;       // of the file
+    uint64_t storedSize; // of the blob
+    uint32_t nameOffset; // into the path names
+    uint32_t nameLength;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+// A file's contents, either inside the mapped pack or in `owned` (inflated from the pack, or
+// read from a loose file). Copies share the buffer; the pack mapping lives until exit.
+struct AssetView {
+    bool ok = false;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<std::vector<unsigned char>> owned;
+
+    std::string String() const {
+        return std::string(reinterpret_cast<const char*>(data), size);
+    }
+};
+
+// paths as the pack stores them: relative to the working directory, without "./"
+inline std::string PackKey(const std::string& path) {
+    static const std::string cwd = []() {
+        char buffer[PATH_MAX];
+        return getcwd(buffer, sizeof(buffer)) ? std::string(buffer) + '/' : std::string();
+    }();
+    std::string key = path;
+    if (!cwd.empty() && key.compare(0, cwd.size(), cwd) == 0)
+        key.erase(0, cwd.size());
+    while (key.compare(0, 2, "./") == 0)
+        key.erase(0, 2);
+    return key;
+}
+
+namespace pack_detail {
+
+inline uint64_t AlignUp(uint64_t value) {
+    return (value + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+
+// the blob for one file: its chunks compressed, or the bytes as they are when that saves
+// less than an eighth
+inline std::vector<unsigned char> EncodeBlob(const std::vector<unsigned char>& bytes, bool& compressed) {
+    size_t chunks = (bytes.size() + PACK_CHUNK_BYTES - 1) / PACK_CHUNK_BYTES;
+    std::vector<std::vector<unsigned char>> encoded(chunks);
+    ParallelFor(chunks, [&](size_t i) {
+        size_t begin = i * PACK_CHUNK_BYTES;
+        size_t size = std::min<size_t>(PACK_CHUNK_BYTES, bytes.size() - begin);
+        encoded[i].resize(Lz4CompressBound(size));
+        encoded[i].resize(Lz4Compress(bytes.data() + begin, size, encoded[i].data()));
+    });
+
+    size_t total = chunks * sizeof(uint32_t);
+    for (const auto& chunk : encoded)
+        total += chunk.size();
+    compressed = chunks > 0 && total < bytes.size() - bytes.size() / 8;
+    if (!compressed)
+        return bytes;
+
+    std::vector<unsigned char> blob(chunks * sizeof(uint32_t));
+    blob.reserve(total);
+    for (size_t i = 0; i < chunks; ++i) {
+        uint32_t size = (uint32_t)encoded[i].size();
+        memcpy(&blob[i * sizeof(uint32_t)], &size, sizeof(size));
+    }
+    for (const auto& chunk : encoded)
+        blob.insert(blob.end(), chunk.begin(), chunk.end());
+    return blob;
+}
+
+} // namespace pack_detail
+
+struct PackInput {
+    std::string path;
+    std::vector<unsigned char> bytes;
+};
+
+struct PackWriteStats {
+    size_t files = 0, compressedFiles = 0;
+    uint64_t inputBytes = 0, packBytes = 0;
+};
+
+// writes every input (path -> contents) into one pack at `path`
+inline bool WriteAssetPack(const std::string& path, const std::vector<PackInput>& inputs,
+                           PackWriteStats* stats = nullptr) {
+    using namespace pack_detail;
+    std::vector<PackEntry> entries(inputs.size());
+    std::vector<std::vector<unsigned char>> blobs(inputs.size());
+    std::string names;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        std::string key = PackKey(inputs[i].path);
+        PackEntry& entry = entries[i];
+        memset(&entry, 0, sizeof(entry));
+        entry.hash = HashString(key);
+        entry.size = inputs[i].bytes.size();
+        entry.nameOffset = (uint32_t)names.size();
+        entry.nameLength = (uint32_t)key.size();
+        names += key;
+    }
+    ParallelFor(inputs.size(), [&](size_t i) {
+        bool compressed;
+        blobs[i] = EncodeBlob(inputs[i].bytes, compressed);
+        entries[i].storedSize = blobs[i].size();
+        entries[i].flags = compressed ? PACK_ENTRY_COMPRESSED : 0;
+    });
+
+    // blobs go in input order, so related files stay next to each other on disk
+    uint64_t offset = AlignUp(sizeof(PackHeader) + entries.size() * sizeof(PackEntry) + names.size());
+    for (PackEntry& entry : entries) {
+        entry.offset = offset;
+        offset = AlignUp(offset + entry.storedSize);
+    }
+    std::vector<PackEntry> sorted = entries;
+    std::sort(sorted.begin(), sorted.end(), [](const PackEntry& a, const PackEntry& b) { return a.hash < b.hash; });
+
+    PackHeader header;
+    memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = (uint32_t)entries.size();
+    header.chunkBytes = PACK_CHUNK_BYTES;
+    header.namesBytes = names.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(sorted.data()), sorted.size() * sizeof(PackEntry));
+    out.write(names.data(), names.size());
+    const std::vector<char> padding(PACK_ALIGNMENT, 0);
+    uint64_t at = sizeof(header) + sorted.size() * sizeof(PackEntry) + names.size();
+    for (size_t i = 0; i < blobs.size(); ++i) {
+        out.write(padding.data(), (std::streamsize)(entries[i].offset - at));
+        out.write(reinterpret_cast<const char*>(blobs[i].data()), blobs[i].size());
+        at = entries[i].offset + blobs[i].size();
+    }
+    if (!out)
+        return false;
+
+    if (stats) {
+        *stats = PackWriteStats();
+        stats->files = entries.size();
+        for (const PackEntry& entry : entries) {
+            stats->compressedFiles += entry.flags & PACK_ENTRY_COMPRESSED ? 1 : 0;
+            stats->inputBytes += entry.size;
+        }
+        stats->packBytes = at;
+    }
+    return true;
+}
+
+// A read-only pack mapped into memory. Mount it before anything loads; lookups don't
+// modify it and are safe from any thread.
+class AssetPack {
+public:
+    // the pack the loaders look in first (see OpenAsset)
+    static AssetPack& Mounted() {
+        static AssetPack pack;
+        return pack;
+    }
+
+    bool Open(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat file;
+        void* mapping = MAP_FAILED;
+        if (fstat(fd, &file) == 0 && (size_t)file.st_size >= sizeof(PackHeader))
+            mapping = mmap(nullptr, (size_t)file.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+
+        unmap();
+        base = static_cast<const unsigned char*>(mapping);
+        mappedBytes = (size_t)file.st_size;
+        if (!readTableOfContents()) {
+            unmap();
+            return false;
+        }
+        // the whole pack is read ahead front to back instead of page by page on first touch
+        madvise(mapping, mappedBytes, MADV_SEQUENTIAL);
+        madvise(mapping, mappedBytes, MADV_WILLNEED);
+        return true;
+    }
+
+    bool IsOpen() const { return base != nullptr; }
+    bool Contains(const std::string& path) const { return lookup(PackKey(path)) != nullptr; }
+    size_t Files() const { return count; }
+    size_t MappedBytes() const { return mappedBytes; }
+
+    // The first `prefix` bytes of the file (all of it by default). Stored files point into
+    // the mapping; compressed ones inflate only the chunks the prefix covers.
+    bool Find(const std::string& path, AssetView& view, size_t prefix = std::numeric_limits<size_t>::max()) const {
+        const PackEntry* entry = lookup(PackKey(path));
+        if (!entry)
+            return false;
+        size_t size = (size_t)std::min<uint64_t>(entry->size, prefix);
+        const unsigned char* blob = base + entry->offset;
+        view = AssetView();
+        if (!(entry->flags & PACK_ENTRY_COMPRESSED)) {
+            view.ok = true;
+            view.data = blob;
+            view.size = size;
+            return true;
+        }
+
+        size_t chunks = (size_t)((entry->size + chunkBytes - 1) / chunkBytes);
+        size_t needed = (size + chunkBytes - 1) / chunkBytes;
+        std::vector<uint64_t> starts(chunks + 1, chunks * sizeof(uint32_t));
+        for (size_t i = 0; i < chunks; ++i) {
+            uint32_t stored;
+            memcpy(&stored, blob + i * sizeof(uint32_t), sizeof(stored));
+            starts[i + 1] = starts[i] + stored;
+        }
+        if (starts[chunks] > entry->storedSize)
+            return false;
+
+        auto bytes = std::make_shared<std::vector<unsigned char>>(std::min<uint64_t>(entry->size, needed * (uint64_t)chunkBytes));
+        std::vector<char> inflated(needed, 0);
+        ParallelFor(needed, [&](size_t i) {
+            size_t begin = i * chunkBytes;
+            size_t length = std::min<size_t>(chunkBytes, bytes->size() - begin);
+            inflated[i] = Lz4Decompress(blob + starts[i], (size_t)(starts[i + 1] - starts[i]),
+                                        bytes->data() + begin, length);
+        });
+        if (std::find(inflated.begin(), inflated.end(), 0) != inflated.end())
+            return false;
+        view.ok = true;
+        view.data = bytes->data();
+        view.size = size;
+        view.owned = std::move(bytes);
+        return true;
+    }
+
+    ~AssetPack() { unmap(); }
+
+private:
+    const unsigned char* base = nullptr;
+    size_t mappedBytes = 0;
+    const PackEntry* entries = nullptr;
+    size_t count = 0;
+    const char* names = nullptr;
+    uint32_t chunkBytes = PACK_CHUNK_BYTES;
+
+    AssetPack() = default;
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    void unmap() {
+        if (base)
+            munmap(const_cast<unsigned char*>(base), mappedBytes);
+        base = nullptr;
+        mappedBytes = 0;
+        entries = nullptr;
+        count = 0;
+        names = nullptr;
+    }
+
+    bool readTableOfContents() {
+        PackHeader header;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != ASSET_PACK_VERSION || header.chunkBytes == 0)
+            return false;
+        uint64_t namesStart = sizeof(PackHeader) + (uint64_t)header.entryCount * sizeof(PackEntry);
+        if (namesStart + header.namesBytes > mappedBytes)
+            return false;
+        entries = reinterpret_cast<const PackEntry*>(base + sizeof(PackHeader));
+        count = header.entryCount;
+        names = reinterpret_cast<const char*>(base + namesStart);
+        chunkBytes = header.chunkBytes;
+        for (size_t i = 0; i < count; ++i) {
+            const PackEntry& entry = entries[i];
+            if ((uint64_t)entry.nameOffset + entry.nameLength > header.namesBytes ||
+                entry.offset > mappedBytes || entry.storedSize > mappedBytes - entry.offset ||
+                ((entry.flags & PACK_ENTRY_COMPRESSED) == 0 && entry.size != entry.storedSize) ||
+                ((entry.flags & PACK_ENTRY_COMPRESSED) &&
+                 (entry.size + chunkBytes - 1) / chunkBytes * sizeof(uint32_t) > entry.storedSize))
+                return false;
+        }
+        return true;
+    }
+
+    const PackEntry* lookup(const std::string& key) const {
+        if (!base)
+            return nullptr;
+        uint64_t hash = HashString(key);
+        const PackEntry* it = std::lower_bound(entries, entries + count, hash,
+                                               [](const PackEntry& entry, uint64_t h) { return entry.hash < h; });
+        for (; it != entries + count && it->hash == hash; ++it) {
+            if (key.compare(0, std::string::npos, names + it->nameOffset, it->nameLength) == 0)
+                return it;
+        }
+        return nullptr;
+    }
+};
+
+// Loose files a loader is about to open, read in one batch (BatchRead) and held until
+// OpenAsset asks for them. Loaders stage everything one loading phase needs, then decode
+// as usual; files the mounted pack has are left to the pack. A file staged n times (two
+// programs sharing a vertex shader) is read once and dropped after its n-th whole open,
+// counting opens that went to disk because the batch hadn't finished yet, so staged bytes
+// live no longer than they would have after plain reads. A thread's next Stage ends its
+// previous loading phase: whatever that phase staged and didn't open is dropped then.
+// Thread-safe.
+class AssetReadAhead {
+public:
+    static AssetReadAhead& Instance() {
+        static AssetReadAhead readAhead;
+        return readAhead;
+    }
+
+    // reads the files not in the pack and not staged yet; returns what this batch read
+    BatchReadStats Stage(const std::vector<std::string>& paths) {
+        std::vector<BatchFile> files;
+        uint64_t batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch = ++batches;
+            std::thread::id thread = std::this_thread::get_id();
+            for (const std::string& path : paths) {
+                std::string key = PackKey(path);
+                auto it = staged.find(key);
+                if (it != staged.end()) {
+                    ++it->second.opens;
+                    it->second.stagedBy = batch;
+                    it->second.thread = thread;
+                    continue;
+                }
+                if (AssetPack::Mounted().Contains(path))
+                    continue;
+                // claimed, so a concurrent Stage doesn't read it too
+                Staged& claim = staged[key];
+                claim.opens = 1;
+                claim.readBy = claim.stagedBy = batch;
+                claim.thread = thread;
+                BatchFile file;
+                file.path = path;
+                files.push_back(file);
+            }
+            // this thread's earlier phase is over
+            for (auto it = staged.begin(); it != staged.end();) {
+                if (it->second.thread == thread && it->second.stagedBy != batch)
+                    it = staged.erase(it);
+                else
+                    ++it;
+            }
+        }
+        if (files.empty())
+            return BatchReadStats();
+
+        BatchReadStats stats = BatchRead(files);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const BatchFile& file : files) {
+            // only into this batch's own claims: Clear may have dropped one meanwhile, and
+            // the opens it was staged for may all have gone to disk already
+            auto it = staged.find(PackKey(file.path));
+            if (it == staged.end() || it->second.readBy != batch)
+                continue;
+            if (file.ok && it->second.opens > 0)
+                it->second.bytes = file.bytes;
+            else
+                staged.erase(it);
+        }
+        totals.engine = stats.engine;
+        totals.files += stats.files;
+        totals.bytes += stats.bytes;
+        totals.requests += stats.requests;
+        totals.maxInFlight = std::max(totals.maxInFlight, stats.maxInFlight);
+        totals.seconds += stats.seconds;
+        return stats;
+    }
+
+    // the staged file's first `prefix` bytes; a whole-file read hands the buffer over
+    bool Take(const std::string& path, AssetView& view, size_t prefix) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = staged.find(PackKey(path));
+        if (it == staged.end())
+            return false;
+        Staged& entry = it->second;
+        if (!entry.bytes) {
+            // still being read: this open goes to disk, but it's one of the opens staged for
+            if (prefix == std::numeric_limits<size_t>::max() && entry.opens > 0)
+                --entry.opens;
+            return false;
+        }
+        view = AssetView();
+        view.ok = true;
+        view.data = entry.bytes->data();
+        view.size = std::min(entry.bytes->size(), prefix);
+        view.owned = entry.bytes;
+        if (view.size == entry.bytes->size() && --entry.opens == 0)
+            staged.erase(it);
+        return true;
+    }
+
+    // forgets files that were staged but never opened
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        staged.clear();
+    }
+
+    // everything read ahead so far
+    BatchReadStats Totals() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totals;
+    }
+
+private:
+    struct Staged {
+        std::shared_ptr<std::vector<unsigned char>> bytes; // null until the batch has read it
+        size_t opens = 0;       // whole opens left before it's dropped
+        uint64_t readBy = 0;    // the Stage call reading it
+        uint64_t stagedBy = 0;  // the latest Stage call that asked for it
+        std::thread::id thread; // and the thread that made that call
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Staged> staged;
+    uint64_t batches = 0;
+    BatchReadStats totals;
+
+    AssetReadAhead() = default;
+    AssetReadAhead(const AssetReadAhead&) = delete;
+    AssetReadAhead& operator=(const AssetReadAhead&) = delete;
+};
+
+// A file's contents from the mounted pack, from the read-ahead batch, or from disk when
+// neither has it. `prefix` limits how much is read, for loaders that only want a header.
+inline AssetView OpenAsset(const std::string& path, size_t prefix = std::numeric_limits<size_t>::max()) {
+    AssetView view;
+    if (AssetPack::Mounted().Find(path, view, prefix))
+        return view;
+    if (AssetReadAhead::Instance().Take(path, view, prefix))
+        return view;
+
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        return view;
+    auto bytes = std::make_shared<std::vector<unsigned char>>(std::min<size_t>((size_t)in.tellg(), prefix));
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(bytes->data()), bytes->size()))
+        return view;
+    view.ok = true;
+    view.data = bytes->data();
+    view.size = bytes->size();
+    view.owned = std::move(bytes);
+    return view;
+}
+
+#endif //SOLAR_SYSTEM_ASSET_PACK_H
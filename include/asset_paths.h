@@ -0,0 +1,60 @@
+#ifndef SOLAR_SYSTEM_ASSET_PATHS_H
+#define SOLAR_SYSTEM_ASSET_PATHS_H
+
+#include <string>
+#include <cerrno>
+#include <sys/stat.h>
+
+// Release builds define SOLAR_COOKED_ONLY and read nothing but solar_cook's outputs; other
+// builds import the source assets unless started with --cooked.
+#ifndef SOLAR_COOKED_ONLY
+#define SOLAR_COOKED_ONLY 0
+#endif
+
+inline bool& UseCookedAssets() {
+    static bool cooked = SOLAR_COOKED_ONLY != 0;
+    return cooked;
+}
+
+// cooked files mirror the source tree under cooked/, e.g.
+// resources/objects/Sun/Sun.obj -> cooked/resources/objects/Sun/Sun.obj.smesh
+inline std::string CookedPath(const std::string& source, const char* extension) {
+    std::string path = source;
+    while (path.compare(0, 2, "./") == 0)
+        path.erase(0, 2);
+    return "cooked/" + path + extension;
+}
+
+inline std::string CookedMeshPath(const std::string& source) {
+    return CookedPath(source, ".smesh");
+}
+
+inline std::string CookedTexturePath(const std::string& source) {
+    return CookedPath(source, ".stex");
+}
+
+// a cube map has several sources, so it is cooked under a name of its own
+inline std::string CookedCubemapPath(const std::string& name) {
+    return CookedPath(name, ".scube");
+}
+
+inline std::string CookedShaderPath(const std::string& vertexPath, const std::string& fragmentPath,
+                                    const std::string& geometryPath = "") {
+    std::string name = vertexPath.substr(vertexPath.find_last_of('/') + 1) + "+" +
+                       fragmentPath.substr(fragmentPath.find_last_of('/') + 1);
+    if (!geometryPath.empty())
+        name += "+" + geometryPath.substr(geometryPath.find_last_of('/') + 1);
+    return "cooked/shaders/" + name + ".sprog";
+}
+
+// mkdir -p for the directory part of path
+inline bool MakeParentDirectories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        std::string dir = path.substr(0, slash);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+    }
+    return true;
+}
+
+#endif //SOLAR_SYSTEM_ASSET_PATHS_H
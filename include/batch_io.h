@@ -0,0 +1,377 @@
+#ifndef SOLAR_SYSTEM_BATCH_IO_H
+#define SOLAR_SYSTEM_BATCH_IO_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Reads a whole loading phase's files in one go instead of one blocking read after another,
+// so on cold caches and network mounts the requests overlap. Files are cut into chunks and
+// all chunks go to the kernel through one io_uring, up to BATCH_QUEUE_DEPTH in flight;
+// where io_uring isn't available (old kernels, seccomp filters) BATCH_QUEUE_DEPTH threads
+// pread the chunks instead. Buffers come back whole, ready for the memory-based decoders
+// (stbi_load_from_memory, the cooked format parsers) through AssetReadAhead and OpenAsset.
+
+const unsigned BATCH_QUEUE_DEPTH = 32;
+const size_t BATCH_CHUNK_BYTES = (size_t)1 << 20;
+
+struct BatchFile {
+    std::string path;
+    std::shared_ptr<std::vector<unsigned char>> bytes;
+    bool ok = false;
+};
+
+struct BatchReadStats {
+    const char* engine = "";
+    size_t files = 0;
+    size_t bytes = 0;
+    size_t requests = 0;    // chunk reads issued, resubmitted short reads included
+    unsigned maxInFlight = 0; // queue depth reached
+    double seconds = 0.0;
+};
+
+// off to compare against the thread-pool path (--no-io-uring)
+inline bool& BatchIoUseUring() {
+    static bool use = true;
+    return use;
+}
+
+namespace batch_detail {
+
+struct Chunk {
+    size_t file;
+    size_t offset;
+    size_t size;
+    size_t done = 0;
+    iovec iov;
+};
+
+// the part of liburing the batch needs: one ring, READV submissions, completions
+class Uring {
+public:
+    bool Open(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return false;
+
+        sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            sqBytes = cqBytes = std::max(sqBytes, cqBytes);
+        sqRing = mmap(nullptr, sqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            sqRing = nullptr;
+            return false;
+        }
+        cqRing = single ? sqRing
+                        : mmap(nullptr, cqBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_CQ_RING);
+        sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMap = mmap(nullptr, sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQES);
+        if (cqRing == MAP_FAILED || sqeMap == MAP_FAILED) {
+            if (cqRing == MAP_FAILED)
+                cqRing = nullptr;
+            if (sqeMap != MAP_FAILED)
+                munmap(sqeMap, sqesBytes);
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+        unsigned char* sq = static_cast<unsigned char*>(sqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        unsigned char* cq = static_cast<unsigned char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        capacity = params.sq_entries;
+        return true;
+    }
+
+    ~Uring() {
+        if (sqes)
+            munmap(sqes, sqesBytes);
+        if (cqRing && cqRing != sqRing)
+            munmap(cqRing, cqBytes);
+        if (sqRing)
+            munmap(sqRing, sqBytes);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    unsigned Capacity() const { return capacity; }
+
+    void QueueRead(int file, iovec* iov, size_t offset, uint64_t userData) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = file;
+        sqe.addr = (uint64_t)(uintptr_t)iov;
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++queued;
+    }
+
+    // submits what was queued and waits for at least one completion
+    bool SubmitAndWait() {
+        for (;;) {
+            long result = syscall(__NR_io_uring_enter, fd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (result >= 0) {
+                queued -= std::min<unsigned>(queued, (unsigned)result);
+                return true;
+            }
+            if (errno != EINTR)
+                return false;
+        }
+    }
+
+    // waits for a completion without submitting anything
+    bool Wait() {
+        for (;;) {
+            if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0)
+                return true;
+            if (errno != EINTR)
+                return false;
+        }
+    }
+
+    // reads queued but never handed to the kernel
+    unsigned Unsubmitted() const { return queued; }
+
+    // calls fn(userData, result) for every completion there is
+    template<typename F>
+    void Reap(F fn) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            fn(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int fd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqBytes = 0, cqBytes = 0, sqesBytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned *sqTail = nullptr, *sqArray = nullptr, *cqHead = nullptr, *cqTail = nullptr;
+    unsigned sqMask = 0, cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned capacity = 0;
+    unsigned queued = 0;
+};
+
+// false if the ring couldn't be set up; failed chunks mark their file as failed. When the
+// ring breaks down part-way the reads it still has in flight are waited out, so the caller
+// can read the unfinished chunks again; files whose reads couldn't be waited out are marked
+// in `stranded`, as the kernel may still write into their buffers.
+inline bool ReadWithUring(std::vector<Chunk>& chunks, const std::vector<int>& fds, std::vector<char>& failed,
+                          std::vector<char>& stranded, BatchReadStats& stats) {
+    Uring ring;
+    if (!ring.Open(BATCH_QUEUE_DEPTH))
+        return false;
+    stats.engine = "io_uring";
+    unsigned depth = std::min(BATCH_QUEUE_DEPTH, ring.Capacity());
+
+    std::vector<size_t> retry; // chunks whose read came back short
+    std::vector<char> inKernel(chunks.size(), 0);
+    size_t next = 0, completed = 0;
+    unsigned inFlight = 0;
+    auto complete = [&](uint64_t index, int result) {
+        --inFlight;
+        Chunk& chunk = chunks[index];
+        inKernel[index] = 0;
+        if (result <= 0) {
+            failed[chunk.file] = 1;
+            ++completed;
+            return;
+        }
+        chunk.done += (size_t)result;
+        chunk.iov.iov_base = static_cast<unsigned char*>(chunk.iov.iov_base) + result;
+        chunk.iov.iov_len -= (size_t)result;
+        if (chunk.done < chunk.size)
+            retry.push_back((size_t)index);
+        else
+            ++completed;
+    };
+    while (completed < chunks.size()) {
+        while (inFlight < depth && (!retry.empty() || next < chunks.size())) {
+            size_t index;
+            if (!retry.empty()) {
+                index = retry.back();
+                retry.pop_back();
+            } else {
+                index = next++;
+            }
+            Chunk& chunk = chunks[index];
+            ring.QueueRead(fds[chunk.file], &chunk.iov, chunk.offset + chunk.done, index);
+            inKernel[index] = 1;
+            ++inFlight;
+            ++stats.requests;
+        }
+        stats.maxInFlight = std::max(stats.maxInFlight, inFlight);
+        if (!ring.SubmitAndWait()) {
+            // the ring broke down; once the submitted reads are back, whatever is left is read
+            // the slow way by the caller
+            unsigned submitted = inFlight - ring.Unsubmitted();
+            while (submitted > 0 && ring.Wait()) {
+                ring.Reap([&](uint64_t index, int result) {
+                    --submitted;
+                    complete(index, result);
+                });
+            }
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                if (chunks[i].done < chunks[i].size)
+                    failed[chunks[i].file] = 1;
+                if (submitted > 0 && inKernel[i])
+                    stranded[chunks[i].file] = 1;
+            }
+            return true;
+        }
+        ring.Reap(complete);
+    }
+    return true;
+}
+
+inline void ReadWithThreads(std::vector<Chunk>& chunks, const std::vector<int>& fds, std::vector<char>& failed,
+                            BatchReadStats& stats) {
+    stats.engine = "threads";
+    unsigned threads = (unsigned)std::min<size_t>(BATCH_QUEUE_DEPTH, chunks.size());
+    stats.maxInFlight = std::max(stats.maxInFlight, threads);
+    stats.requests += chunks.size();
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < chunks.size(); i = next++) {
+            Chunk& chunk = chunks[i];
+            while (chunk.done < chunk.size) {
+                ssize_t n = pread(fds[chunk.file], static_cast<unsigned char*>(chunk.iov.iov_base),
+                                  chunk.size - chunk.done, (off_t)(chunk.offset + chunk.done));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0) {
+                    failed[chunk.file] = 1;
+                    break;
+                }
+                chunk.done += (size_t)n;
+                chunk.iov.iov_base = static_cast<unsigned char*>(chunk.iov.iov_base) + n;
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread& t : pool)
+        t.join();
+}
+
+} // namespace batch_detail
+
+// buffers a broken ring may still write into; kept until exit
+inline std::vector<std::shared_ptr<std::vector<unsigned char>>>& StrandedBuffers() {
+    static auto* buffers = new std::vector<std::shared_ptr<std::vector<unsigned char>>>();
+    return *buffers;
+}
+
+// reads every file whole; files that can't be opened or read come back with ok = false
+inline BatchReadStats BatchRead(std::vector<BatchFile>& files) {
+    using namespace batch_detail;
+    auto start = std::chrono::steady_clock::now();
+    BatchReadStats stats;
+
+    std::vector<int> fds(files.size(), -1);
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < files.size(); ++i) {
+        BatchFile& file = files[i];
+        file.ok = false;
+        fds[i] = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (fds[i] < 0 || fstat(fds[i], &info) != 0)
+            continue;
+        file.bytes = std::make_shared<std::vector<unsigned char>>((size_t)info.st_size);
+        for (size_t offset = 0; offset < file.bytes->size(); offset += BATCH_CHUNK_BYTES) {
+            Chunk chunk;
+            chunk.file = i;
+            chunk.offset = offset;
+            chunk.size = std::min(BATCH_CHUNK_BYTES, file.bytes->size() - offset);
+            chunk.iov.iov_base = file.bytes->data() + offset;
+            chunk.iov.iov_len = chunk.size;
+            chunks.push_back(chunk);
+        }
+        file.ok = true;
+    }
+
+    std::vector<char> uringFailed(files.size(), 0);
+    std::vector<char> stranded(files.size(), 0);
+    std::vector<char> failed(files.size(), 0);
+    bool viaUring =
+            !chunks.empty() && BatchIoUseUring() && ReadWithUring(chunks, fds, uringFailed, stranded, stats);
+    if (!viaUring) {
+        ReadWithThreads(chunks, fds, failed, stats);
+    } else {
+        // a ring that gave up part-way leaves its unread chunks to the threads; a file the kernel
+        // may still be writing into is read again whole, into a new buffer
+        std::vector<Chunk> rest;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!stranded[i])
+                continue;
+            StrandedBuffers().push_back(files[i].bytes);
+            files[i].bytes = std::make_shared<std::vector<unsigned char>>(files[i].bytes->size());
+        }
+        for (Chunk chunk : chunks) {
+            if (stranded[chunk.file]) {
+                chunk.done = 0;
+                chunk.iov.iov_base = files[chunk.file].bytes->data() + chunk.offset;
+                chunk.iov.iov_len = chunk.size;
+            }
+            if (chunk.done < chunk.size && uringFailed[chunk.file])
+                rest.push_back(chunk);
+        }
+        if (!rest.empty())
+            ReadWithThreads(rest, fds, failed, stats);
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (fds[i] >= 0)
+            ::close(fds[i]);
+        if (failed[i])
+            files[i].ok = false;
+        if (files[i].ok) {
+            ++stats.files;
+            stats.bytes += files[i].bytes->size();
+        } else {
+            files[i].bytes.reset();
+        }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+#endif //SOLAR_SYSTEM_BATCH_IO_H
@@ -7,12 +7,11 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include "asset_pack.h"
 
+// from the mounted asset pack when it has the file
 std::string readFileContents(std::string path) {
-    std::ifstream in(path);
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    return buffer.str();
+    return OpenAsset(path).String();
 }
 
 
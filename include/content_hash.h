@@ -0,0 +1,40 @@
+#ifndef SOLAR_SYSTEM_CONTENT_HASH_H
+#define SOLAR_SYSTEM_CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+// 64-bit FNV-1a, good enough to tell asset files apart
+inline uint64_t HashBytes(const unsigned char* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline uint64_t HashString(const std::string& s, uint64_t hash = 14695981039346656037ull) {
+    return HashBytes(reinterpret_cast<const unsigned char*>(s.data()), s.size(), hash);
+}
+
+inline bool ReadFileBytes(const std::string& path, std::vector<unsigned char>& bytes) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        return false;
+    bytes.resize((size_t)in.tellg());
+    in.seekg(0);
+    return (bool)in.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+}
+
+// hash of a file's contents folded into `hash`; a missing file changes the hash too
+inline uint64_t HashFile(const std::string& path, uint64_t hash = 14695981039346656037ull) {
+    std::vector<unsigned char> bytes;
+    if (!ReadFileBytes(path, bytes))
+        return HashString("<missing>" + path, hash);
+    return HashBytes(bytes.data(), bytes.size(), hash);
+}
+
+#endif //SOLAR_SYSTEM_CONTENT_HASH_H
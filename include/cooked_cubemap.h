@@ -0,0 +1,222 @@
+#ifndef SOLAR_SYSTEM_COOKED_CUBEMAP_H
+#define SOLAR_SYSTEM_COOKED_CUBEMAP_H
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include "glad/glad.h"
+#include "stb_image.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "cooked_texture.h"
+#include "asset_pack.h"
+#include "load_report.h"
+#include "decode_memory_gate.h"
+
+// Cube maps (the skybox) as solar_cook writes them: one .scube holding the six faces as
+// .stex images, block compressed with full mip chains, read in one go and uploaded without
+// decoding anything. Without a cooked file the faces are decoded from their source images
+// in parallel and get CPU-built mips, so the sky is mip-mapped either way. Faces are in
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order and have to be square and of one size.
+
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+const int CUBE_FACES = 6;
+
+struct CookedCubemapHeader {
+    char magic[4];
+    uint32_t faces;
+    uint32_t offsets[CUBE_FACES]; // of each face's .stex image, from the start of the file
+    uint32_t sizes[CUBE_FACES];
+};
+
+const char COOKED_CUBEMAP_MAGIC[4] = {'S', 'C', 'U', 'B'};
+
+// the six faces, either cooked or decoded
+struct CubemapImage {
+    std::vector<CookedTexture> cooked;
+    std::vector<MipChain> decoded;
+    DecodeReservation reservation; // the decoded faces' share of the DecodeMemoryGate
+
+    size_t Bytes() const {
+        size_t bytes = 0;
+        for (const CookedTexture& face : cooked)
+            bytes += face.Bytes();
+        for (const MipChain& face : decoded)
+            bytes += face.Bytes();
+        return bytes;
+    }
+};
+
+inline bool WriteCookedCubemap(const std::string& path, const std::vector<CookedTexture>& faces) {
+    if (faces.size() != CUBE_FACES)
+        return false;
+    std::vector<std::string> images(CUBE_FACES);
+    for (int i = 0; i < CUBE_FACES; ++i) {
+        std::ostringstream image;
+        if (!WriteCookedTexture(image, faces[i]))
+            return false;
+        images[i] = image.str();
+    }
+
+    CookedCubemapHeader header;
+    std::memcpy(header.magic, COOKED_CUBEMAP_MAGIC, 4);
+    header.faces = CUBE_FACES;
+    uint32_t offset = sizeof(header);
+    for (int i = 0; i < CUBE_FACES; ++i) {
+        header.offsets[i] = offset;
+        header.sizes[i] = (uint32_t)images[i].size();
+        offset += header.sizes[i];
+    }
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const std::string& image : images)
+        out.write(image.data(), image.size());
+    return (bool)out;
+}
+
+inline bool ParseCookedCubemap(const unsigned char* data, size_t size, std::vector<CookedTexture>& faces) {
+    CookedCubemapHeader header;
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, COOKED_CUBEMAP_MAGIC, 4) != 0 || header.faces != CUBE_FACES)
+        return false;
+    faces.assign(CUBE_FACES, CookedTexture());
+    for (int i = 0; i < CUBE_FACES; ++i) {
+        if ((size_t)header.offsets[i] + header.sizes[i] > size ||
+            !ParseCookedTexture(data + header.offsets[i], header.sizes[i], faces[i]))
+            return false;
+        if (faces[i].levels[0].width != faces[i].levels[0].height ||
+            faces[i].levels[0].width != faces[0].levels[0].width ||
+            faces[i].levels.size() != faces[0].levels.size() || faces[i].format != faces[0].format)
+            return false;
+    }
+    return true;
+}
+
+// decodes the faces' source images, one face per worker; each face's stages go to the
+// load report under its own path. The six faces are uploaded together, so they reserve
+// their peak from the DecodeMemoryGate as one image, waiting for room, and hold the
+// finished chains' share in `reservation`. The caller mustn't hold decoded images of its own.
+inline bool DecodeCubemapFaces(const std::vector<std::string>& paths, bool srgb, MipFilter filter,
+                               std::vector<MipChain>& faces, DecodeReservation& reservation) {
+    if (paths.size() != CUBE_FACES)
+        return false;
+    faces.assign(CUBE_FACES, MipChain());
+    AssetReadAhead::Instance().Stage(paths);
+    std::vector<AssetView> files(CUBE_FACES);
+    std::vector<size_t> peaks(CUBE_FACES, 0);
+    ParallelFor(CUBE_FACES, [&](size_t i) {
+        {
+            ScopedLoadTimer timer(paths[i], "skybox", LoadStage::Read);
+            files[i] = OpenAsset(paths[i]);
+        }
+        int width, height, channels;
+        if (files[i].ok && stbi_info_from_memory(files[i].data, (int)files[i].size, &width, &height, &channels))
+            peaks[i] = DecodeMemoryGate::DecodeBytes(width, height, channels);
+    });
+    size_t peak = 0;
+    for (size_t bytes : peaks)
+        peak += bytes;
+    DecodeMemoryGate::Instance().Reserve(peak);
+    reservation = DecodeReservation(peak);
+
+    ParallelFor(CUBE_FACES, [&](size_t i) {
+        const AssetView& file = files[i];
+        if (!file.ok)
+            return;
+        LoadReport::Instance().AddBytes(paths[i], "skybox", file.size);
+        int width, height, channels;
+        unsigned char* data;
+        {
+            ScopedLoadTimer timer(paths[i], "skybox", LoadStage::Decode);
+            data = stbi_load_from_memory(file.data, (int)file.size, &width, &height, &channels, 0);
+        }
+        if (!data)
+            return;
+        ScopedLoadTimer timer(paths[i], "skybox", LoadStage::Mips);
+        faces[i] = GenerateMipChain(data, width, height, channels, srgb, filter);
+        stbi_image_free(data);
+    });
+    size_t bytes = 0;
+    for (const MipChain& face : faces)
+        bytes += face.Bytes();
+    reservation.Shrink(bytes);
+
+    for (const MipChain& face : faces) {
+        if (face.levels.empty() || face.levels[0].width != face.levels[0].height ||
+            face.levels[0].width != faces[0].levels[0].width || face.channels != faces[0].channels)
+            return false;
+    }
+    return true;
+}
+
+// creates the cube map texture with every face's mip chain and trilinear filtering
+inline unsigned int UploadCubemap(const CubemapImage& image, bool srgb) {
+    unsigned int id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+    size_t levels = 0;
+    if (!image.cooked.empty()) {
+        for (int i = 0; i < CUBE_FACES; ++i) {
+            const CookedTexture& face = image.cooked[i];
+            GLenum format = face.format;
+            if (srgb && format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                format = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+            else if (srgb && format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            for (size_t l = 0; l < face.levels.size(); ++l) {
+                const CookedTextureLevel& level = face.levels[l];
+                glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, (GLint)l, format, level.width,
+                                       level.height, 0, (GLsizei)level.blocks.size(), level.blocks.data());
+            }
+            levels = face.levels.size();
+        }
+    } else {
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int i = 0; i < CUBE_FACES; ++i) {
+            const MipChain& face = image.decoded[i];
+            GLenum format = GL_RGB, internalFormat = srgb ? GL_SRGB8 : GL_RGB8;
+            if (face.channels == 1) {
+                format = GL_RED;
+                internalFormat = GL_R8;
+            } else if (face.channels == 2) {
+                format = GL_RG;
+                internalFormat = GL_RG8;
+            } else if (face.channels == 4) {
+                format = GL_RGBA;
+                internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+            }
+            for (size_t l = 0; l < face.levels.size(); ++l) {
+                const MipLevel& level = face.levels[l];
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, (GLint)l, internalFormat, level.width, level.height,
+                             0, format, GL_UNSIGNED_BYTE, level.pixels.data());
+            }
+            levels = face.levels.size();
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return id;
+}
+
+#endif //SOLAR_SYSTEM_COOKED_CUBEMAP_H
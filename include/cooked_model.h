@@ -0,0 +1,176 @@
+#ifndef SOLAR_SYSTEM_COOKED_MODEL_H
+#define SOLAR_SYSTEM_COOKED_MODEL_H
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include "model_import.h"
+#include "content_hash.h"
+#include "asset_pack.h"
+
+// .smesh: an ImportedModel as solar_cook wrote it, LOD chains included. Loading one is a
+// single read and a few memcpys; vertices are stored in the in-memory Vertex layout and
+// indices as 16 bits (the importer already split meshes at 65536 vertices).
+//
+//   "SMSH" u32 version
+//   string directory, vec3 boundsCenter, f32 boundsRadius, u32 meshCount
+//   per mesh: u32 vertexCount, Vertex[vertexCount]
+//             u32 textureCount, (string type, string path)[textureCount]
+//             u32 levelCount (full detail first), (f32 error, u32 indexCount, u16[indexCount])[levelCount]
+//   strings are u32 length + bytes
+
+const char COOKED_MODEL_MAGIC[4] = {'S', 'M', 'S', 'H'};
+const uint32_t COOKED_MODEL_VERSION = 1;
+
+namespace smesh_detail {
+
+struct Writer {
+    std::vector<unsigned char> bytes;
+
+    void raw(const void* data, size_t size) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        bytes.insert(bytes.end(), p, p + size);
+    }
+    void u32(uint32_t v) { raw(&v, sizeof(v)); }
+    void f32(float v) { raw(&v, sizeof(v)); }
+    void str(const std::string& s) {
+        u32((uint32_t)s.size());
+        raw(s.data(), s.size());
+    }
+    void indices(const std::vector<unsigned int>& list, float error) {
+        f32(error);
+        u32((uint32_t)list.size());
+        size_t at = bytes.size();
+        bytes.resize(at + list.size() * sizeof(uint16_t));
+        uint16_t* out = reinterpret_cast<uint16_t*>(&bytes[at]);
+        for (size_t i = 0; i < list.size(); ++i)
+            out[i] = (uint16_t)list[i];
+    }
+};
+
+struct Reader {
+    const unsigned char* at;
+    const unsigned char* end;
+
+    bool raw(void* data, size_t size) {
+        if ((size_t)(end - at) < size)
+            return false;
+        memcpy(data, at, size);
+        at += size;
+        return true;
+    }
+    bool u32(uint32_t& v) { return raw(&v, sizeof(v)); }
+    bool f32(float& v) { return raw(&v, sizeof(v)); }
+    bool str(std::string& s) {
+        uint32_t size;
+        if (!u32(size) || (size_t)(end - at) < size)
+            return false;
+        s.assign(reinterpret_cast<const char*>(at), size);
+        at += size;
+        return true;
+    }
+    bool indices(std::vector<unsigned int>& list, float& error) {
+        uint32_t count;
+        if (!f32(error) || !u32(count) || (size_t)(end - at) / sizeof(uint16_t) < count)
+            return false;
+        list.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            uint16_t index;
+            memcpy(&index, at + i * sizeof(uint16_t), sizeof(index));
+            list[i] = index;
+        }
+        at += count * sizeof(uint16_t);
+        return true;
+    }
+};
+
+} // namespace smesh_detail
+
+inline bool WriteCookedModel(const std::string& path, const ImportedModel& model) {
+    smesh_detail::Writer out;
+    out.raw(COOKED_MODEL_MAGIC, sizeof(COOKED_MODEL_MAGIC));
+    out.u32(COOKED_MODEL_VERSION);
+    out.str(model.directory);
+    out.raw(&model.boundsCenter, sizeof(model.boundsCenter));
+    out.f32(model.boundsRadius);
+    out.u32((uint32_t)model.meshes.size());
+    for (const ImportedMesh& mesh : model.meshes) {
+        out.u32((uint32_t)mesh.vertices.size());
+        out.raw(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        out.u32((uint32_t)mesh.textures.size());
+        for (const TextureRef& texture : mesh.textures) {
+            out.str(texture.type);
+            out.str(texture.path);
+        }
+        out.u32((uint32_t)mesh.lods.size() + 1);
+        out.indices(mesh.indices, 0.0f);
+        for (const LodLevel& lod : mesh.lods)
+            out.indices(lod.indices, lod.error);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    return file && file.write(reinterpret_cast<const char*>(out.bytes.data()), out.bytes.size());
+}
+
+// only the bounding sphere, from the start of the file; false if there is no usable .smesh
+inline bool ReadCookedModelBounds(const std::string& path, glm::vec3& center, float& radius) {
+    AssetView head = OpenAsset(path, 4096);
+    if (!head.ok)
+        return false;
+    smesh_detail::Reader in{head.data, head.data + head.size};
+
+    char magic[4];
+    uint32_t version;
+    std::string directory;
+    return in.raw(magic, sizeof(magic)) && memcmp(magic, COOKED_MODEL_MAGIC, sizeof(magic)) == 0 &&
+           in.u32(version) && version == COOKED_MODEL_VERSION && in.str(directory) &&
+           in.raw(&center, sizeof(center)) && in.f32(radius);
+}
+
+inline bool ReadCookedModel(const std::string& path, ImportedModel& model) {
+    AssetView bytes = OpenAsset(path);
+    if (!bytes.ok)
+        return false;
+    smesh_detail::Reader in{bytes.data, bytes.data + bytes.size};
+
+    char magic[4];
+    uint32_t version, meshCount;
+    if (!in.raw(magic, sizeof(magic)) || memcmp(magic, COOKED_MODEL_MAGIC, sizeof(magic)) != 0 ||
+        !in.u32(version) || version != COOKED_MODEL_VERSION)
+        return false;
+    if (!in.str(model.directory) || !in.raw(&model.boundsCenter, sizeof(model.boundsCenter)) ||
+        !in.f32(model.boundsRadius) || !in.u32(meshCount))
+        return false;
+
+    model.meshes.clear();
+    model.meshes.resize(meshCount);
+    for (ImportedMesh& mesh : model.meshes) {
+        uint32_t vertexCount, textureCount, levelCount;
+        if (!in.u32(vertexCount) || (size_t)(in.end - in.at) / sizeof(Vertex) < vertexCount)
+            return false;
+        mesh.vertices.resize(vertexCount);
+        in.raw(mesh.vertices.data(), vertexCount * sizeof(Vertex));
+
+        if (!in.u32(textureCount))
+            return false;
+        mesh.textures.resize(textureCount);
+        for (TextureRef& texture : mesh.textures) {
+            if (!in.str(texture.type) || !in.str(texture.path))
+                return false;
+        }
+
+        float error;
+        if (!in.u32(levelCount) || levelCount == 0 || !in.indices(mesh.indices, error))
+            return false;
+        mesh.lods.resize(levelCount - 1);
+        for (LodLevel& lod : mesh.lods) {
+            if (!in.indices(lod.indices, lod.error))
+                return false;
+        }
+    }
+    return true;
+}
+
+#endif //SOLAR_SYSTEM_COOKED_MODEL_H
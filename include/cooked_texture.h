@@ -0,0 +1,303 @@
+#ifndef SOLAR_SYSTEM_COOKED_TEXTURE_H
+#define SOLAR_SYSTEM_COOKED_TEXTURE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "glad/glad.h"
+#include "mipmap.h"
+#include "parallel.h"
+
+// Block-compressed, pre-mipped textures written by solar_cook (.stex) and uploaded as is
+// at run time: no image decoding and no mip generation on load, and 4-8x less VRAM.
+//   1 channel  -> BC4 (RGTC1)
+//   2, 3       -> BC1 (DXT1)
+//   4 channels -> BC3 (DXT5)
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+struct CookedTextureHeader {
+    char magic[4];
+    uint32_t format; // GL compressed internal format
+    uint32_t width, height, levels, channels, srgb;
+};
+
+const char COOKED_TEXTURE_MAGIC[4] = {'S', 'T', 'E', 'X'};
+
+struct CookedTextureLevel {
+    uint32_t width = 0, height = 0;
+    std::vector<unsigned char> blocks;
+};
+
+struct CookedTexture {
+    GLenum format = 0;
+    int channels = 0;
+    bool srgb = false;
+    std::vector<CookedTextureLevel> levels;
+
+    size_t Bytes() const {
+        size_t bytes = 0;
+        for (const CookedTextureLevel& level : levels)
+            bytes += level.blocks.size();
+        return bytes;
+    }
+};
+
+namespace bc_detail {
+
+inline uint16_t To565(const float c[3]) {
+    int r = std::min(31, std::max(0, (int)(c[0] * 31.0f / 255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, (int)(c[1] * 63.0f / 255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, (int)(c[2] * 31.0f / 255.0f + 0.5f)));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void From565(uint16_t c, float out[3]) {
+    out[0] = ((c >> 11) & 31) * 255.0f / 31.0f;
+    out[1] = ((c >> 5) & 63) * 255.0f / 63.0f;
+    out[2] = (c & 31) * 255.0f / 31.0f;
+}
+
+// 16 RGBA texels -> 8 byte BC1 block. Endpoints are the extremes of the block along its
+// principal colour axis (a few power iterations on the covariance), pulled in slightly.
+inline void EncodeBC1(const uint8_t rgba[64], uint8_t out[8]) {
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += rgba[i * 4 + c] / 16.0f;
+
+    float cov[6] = {0, 0, 0, 0, 0, 0}; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; ++i) {
+        float d[3] = {rgba[i * 4] - mean[0], rgba[i * 4 + 1] - mean[1], rgba[i * 4 + 2] - mean[2]};
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int it = 0; it < 4; ++it) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+        if (len <= 0.0f)
+            break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+
+    float lo = 1e30f, hi = -1e30f;
+    for (int i = 0; i < 16; ++i) {
+        float t = (rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    float axisLen2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float inset = (hi - lo) / 16.0f;
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        float scale = axisLen2 > 0.0f ? axis[c] / axisLen2 : 0.0f;
+        e0[c] = mean[c] + (hi - inset) * scale;
+        e1[c] = mean[c] + (lo + inset) * scale;
+    }
+
+    uint16_t c0 = To565(e0), c1 = To565(e1);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        float palette[4][3];
+        From565(c0, palette[0]);
+        From565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestDist = 1e30f;
+            for (int p = 0; p < 4; ++p) {
+                float dist = 0.0f;
+                for (int c = 0; c < 3; ++c) {
+                    float d = rgba[i * 4 + c] - palette[p][c];
+                    dist += d * d;
+                }
+                if (dist < bestDist) {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = (uint8_t)c0; out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)c1; out[3] = (uint8_t)(c1 >> 8);
+    for (int b = 0; b < 4; ++b)
+        out[4 + b] = (uint8_t)(indices >> (8 * b));
+}
+
+// 16 single channel values -> 8 byte BC4 block (also the alpha half of BC3), 8-value mode
+inline void EncodeBC4(const uint8_t values[16], uint8_t out[8]) {
+    uint8_t lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, values[i]);
+        hi = std::max(hi, values[i]);
+    }
+    out[0] = hi;
+    out[1] = lo;
+    uint64_t indices = 0;
+    if (hi != lo) {
+        float palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int p = 1; p < 7; ++p)
+            palette[p + 1] = ((7 - p) * hi + p * lo) / 7.0f;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestDist = 1e30f;
+            for (int p = 0; p < 8; ++p) {
+                float d = std::fabs(values[i] - palette[p]);
+                if (d < bestDist) {
+                    bestDist = d;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (int b = 0; b < 6; ++b)
+        out[2 + b] = (uint8_t)(indices >> (8 * b));
+}
+
+inline GLenum FormatFor(int channels) {
+    if (channels == 1)
+        return GL_COMPRESSED_RED_RGTC1;
+    if (channels == 4)
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+inline size_t BlockBytes(GLenum format) {
+    return format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8;
+}
+
+inline void CompressLevel(const MipLevel& level, int channels, GLenum format, CookedTextureLevel& out) {
+    const int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+    const size_t blockBytes = BlockBytes(format);
+    out.width = level.width;
+    out.height = level.height;
+    out.blocks.resize((size_t)blocksX * blocksY * blockBytes);
+    ParallelFor((size_t)blocksY, [&](size_t by) {
+        uint8_t rgba[64], single[16];
+        for (int bx = 0; bx < blocksX; ++bx) {
+            // gather the 4x4 block, repeating edge texels of levels that aren't multiples of 4
+            for (int i = 0; i < 16; ++i) {
+                int x = std::min(bx * 4 + (i & 3), level.width - 1);
+                int y = std::min((int)by * 4 + (i >> 2), level.height - 1);
+                const unsigned char* p = &level.pixels[((size_t)y * level.width + x) * channels];
+                rgba[i * 4 + 0] = p[0];
+                rgba[i * 4 + 1] = channels > 1 ? p[1] : p[0];
+                rgba[i * 4 + 2] = channels > 2 ? p[2] : (channels == 2 ? 0 : p[0]);
+                rgba[i * 4 + 3] = channels == 4 ? p[3] : 255;
+                single[i] = format == GL_COMPRESSED_RED_RGTC1 ? p[0] : rgba[i * 4 + 3];
+            }
+            uint8_t* block = &out.blocks[((size_t)by * blocksX + bx) * blockBytes];
+            if (format == GL_COMPRESSED_RED_RGTC1) {
+                EncodeBC4(single, block);
+            } else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                EncodeBC4(single, block);
+                EncodeBC1(rgba, block + 8);
+            } else {
+                EncodeBC1(rgba, block);
+            }
+        }
+    }, 4);
+}
+
+} // namespace bc_detail
+
+inline CookedTexture CompressMipChain(const MipChain& chain) {
+    CookedTexture texture;
+    texture.channels = chain.channels;
+    texture.srgb = chain.srgb;
+    texture.format = bc_detail::FormatFor(chain.channels);
+    texture.levels.resize(chain.levels.size());
+    for (size_t i = 0; i < chain.levels.size(); ++i)
+        bc_detail::CompressLevel(chain.levels[i], chain.channels, texture.format, texture.levels[i]);
+    return texture;
+}
+
+inline bool WriteCookedTexture(std::ostream& out, const CookedTexture& texture) {
+    CookedTextureHeader header;
+    std::memcpy(header.magic, COOKED_TEXTURE_MAGIC, 4);
+    header.format = texture.format;
+    header.width = texture.levels.empty() ? 0 : texture.levels[0].width;
+    header.height = texture.levels.empty() ? 0 : texture.levels[0].height;
+    header.levels = (uint32_t)texture.levels.size();
+    header.channels = texture.channels;
+    header.srgb = texture.srgb;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const CookedTextureLevel& level : texture.levels) {
+        uint32_t sizes[3] = {level.width, level.height, (uint32_t)level.blocks.size()};
+        out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        out.write(reinterpret_cast<const char*>(level.blocks.data()), level.blocks.size());
+    }
+    return (bool)out;
+}
+
+inline bool WriteCookedTexture(const std::string& path, const CookedTexture& texture) {
+    std::ofstream out(path, std::ios::binary);
+    return out && WriteCookedTexture(out, texture);
+}
+
+// parses a .stex image already read into memory; levels before firstLevel get their sizes
+// but not their blocks
+inline bool ParseCookedTexture(const unsigned char* data, size_t size, CookedTexture& texture,
+                               size_t firstLevel = 0) {
+    CookedTextureHeader header;
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, COOKED_TEXTURE_MAGIC, 4) != 0)
+        return false;
+    texture.format = header.format;
+    texture.channels = (int)header.channels;
+    texture.srgb = header.srgb != 0;
+    texture.levels.resize(header.levels);
+    size_t offset = sizeof(header);
+    for (size_t i = 0; i < texture.levels.size(); ++i) {
+        CookedTextureLevel& level = texture.levels[i];
+        uint32_t sizes[3];
+        if (offset + sizeof(sizes) > size)
+            return false;
+        std::memcpy(sizes, data + offset, sizeof(sizes));
+        offset += sizeof(sizes);
+        if (offset + sizes[2] > size)
+            return false;
+        level.width = sizes[0];
+        level.height = sizes[1];
+        if (i >= firstLevel)
+            level.blocks.assign(data + offset, data + offset + sizes[2]);
+        offset += sizes[2];
+    }
+    return !texture.levels.empty();
+}
+
+// levels from firstLevel on become the texture's levels 0, 1, ...
+inline void UploadCookedTexture(GLenum target, const CookedTexture& texture, size_t firstLevel = 0) {
+    for (size_t i = firstLevel; i < texture.levels.size(); ++i) {
+        const CookedTextureLevel& level = texture.levels[i];
+        glCompressedTexImage2D(target, (GLint)(i - firstLevel), texture.format, level.width, level.height, 0,
+                               (GLsizei)level.blocks.size(), level.blocks.data());
+    }
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)(texture.levels.size() - firstLevel) - 1);
+}
+
+#endif //SOLAR_SYSTEM_COOKED_TEXTURE_H
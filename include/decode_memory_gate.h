@@ -0,0 +1,127 @@
+#ifndef SOLAR_SYSTEM_DECODE_MEMORY_GATE_H
+#define SOLAR_SYSTEM_DECODE_MEMORY_GATE_H
+
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+// Caps the memory decoded images take before they are uploaded. A decode reserves its peak
+// (the decoded image, its base level copy and the smaller levels) before stb_image allocates
+// anything, trims the reservation to the finished mip chain, and holds that until the chain
+// has been uploaded (see DecodeReservation). An image bigger than the whole ceiling still
+// runs, alone.
+//
+// Chains waiting for their upload can only be let go by the render thread, so a thread that
+// holds decoded images of its own, or the render thread itself, must not wait here: batches
+// use TryReserve and leave what doesn't fit for later, and the render thread's own decode
+// (an image nobody prefetched, uploaded right away) uses ForceReserve, which can take the
+// total over the ceiling by that one image.
+class DecodeMemoryGate {
+public:
+    // never destroyed: reservations are still released by other statics' destructors
+    static DecodeMemoryGate& Instance() {
+        static DecodeMemoryGate* gate = new DecodeMemoryGate();
+        return *gate;
+    }
+
+    void SetCeiling(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ceiling = bytes;
+        }
+        released.notify_all();
+    }
+
+    size_t Ceiling() const { return ceiling; }
+    // highest total reserved so far
+    size_t PeakReserved() const { return peak; }
+
+    // waits for room
+    void Reserve(size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [&]() { return fits(bytes); });
+        take(bytes);
+    }
+
+    // reserves only if there is room now
+    bool TryReserve(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!fits(bytes))
+            return false;
+        take(bytes);
+        return true;
+    }
+
+    // reserves without waiting, room or not
+    void ForceReserve(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        take(bytes);
+    }
+
+    void Release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reserved -= bytes;
+        }
+        released.notify_all();
+    }
+
+    // the bytes decoding a width x height x channels image holds at its peak
+    static size_t DecodeBytes(int width, int height, int channels) {
+        size_t image = (size_t)width * height * channels;
+        return image * 2 + image / 3;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t ceiling = (size_t)768 << 20;
+    size_t reserved = 0;
+    size_t peak = 0;
+
+    DecodeMemoryGate() = default;
+
+    bool fits(size_t bytes) const { return reserved == 0 || reserved + bytes <= ceiling; }
+
+    void take(size_t bytes) {
+        reserved += bytes;
+        peak = std::max(peak, reserved);
+    }
+};
+
+// A share of the gate, released when it's destroyed; it moves along with the decoded image
+// it stands for.
+class DecodeReservation {
+public:
+    DecodeReservation() = default;
+    // takes over `bytes` already reserved from the gate
+    explicit DecodeReservation(size_t bytes) : bytes(bytes) {}
+    DecodeReservation(DecodeReservation&& other) noexcept : bytes(other.bytes) { other.bytes = 0; }
+    DecodeReservation& operator=(DecodeReservation&& other) noexcept {
+        if (this != &other) {
+            Release();
+            bytes = other.bytes;
+            other.bytes = 0;
+        }
+        return *this;
+    }
+    ~DecodeReservation() { Release(); }
+
+    // gives back what the image no longer needs
+    void Shrink(size_t to) {
+        if (to < bytes) {
+            DecodeMemoryGate::Instance().Release(bytes - to);
+            bytes = to;
+        }
+    }
+
+    void Release() { Shrink(0); }
+
+    size_t Bytes() const { return bytes; }
+
+private:
+    size_t bytes = 0;
+};
+
+#endif //SOLAR_SYSTEM_DECODE_MEMORY_GATE_H
@@ -0,0 +1,156 @@
+#ifndef SOLAR_SYSTEM_FRAME_UNIFORMS_H
+#define SOLAR_SYSTEM_FRAME_UNIFORMS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+#include "texture_cache.h"
+
+// What every program reads the same way within a frame, as two std140 uniform blocks the
+// shaders declare at fixed bindings:
+//
+//   layout(std140, binding = 0) uniform Frame  { mat4 projection; mat4 view; vec3 ViewPos; float time; };
+//   layout(std140, binding = 1) uniform Lights { PointLight light; SpotLight spotLight; };
+//
+// Both are written once a frame into a persistently mapped buffer and stay bound for every
+// draw, instead of being set uniform by uniform in each program. The buffer holds
+// FRAME_UNIFORM_SLOTS frames; a fence per slot keeps the CPU from overwriting a frame the
+// GPU is still reading.
+
+const GLuint FRAME_BLOCK_BINDING = 0;
+const GLuint LIGHTS_BLOCK_BINDING = 1;
+const int FRAME_UNIFORM_SLOTS = 3;
+
+// the blocks' std140 layouts: vec3s take 16 bytes unless a scalar fills the last four,
+// structs round up to 16
+struct FrameBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float time;
+};
+
+struct PointLightBlock {
+    glm::vec3 position;
+    float pad0;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float constant;
+    float linear;
+    float quadratic;
+    float pad3[2];
+};
+
+struct SpotLightBlock {
+    glm::vec3 position;
+    float pad0;
+    glm::vec3 direction;
+    float cutOff;
+    float outerCutOff;
+    float constant;
+    float linear;
+    float quadratic;
+    glm::vec3 ambient;
+    float pad1;
+    glm::vec3 diffuse;
+    float pad2;
+    glm::vec3 specular;
+    float pad3;
+};
+
+struct LightsBlock {
+    PointLightBlock light;
+    SpotLightBlock spotLight;
+};
+
+static_assert(sizeof(FrameBlock) == 144 && offsetof(FrameBlock, time) == 140, "Frame block isn't std140");
+static_assert(sizeof(PointLightBlock) == 80 && offsetof(PointLightBlock, constant) == 60,
+              "PointLight isn't std140");
+static_assert(sizeof(SpotLightBlock) == 96 && offsetof(SpotLightBlock, ambient) == 48,
+              "SpotLight isn't std140");
+static_assert(sizeof(LightsBlock) == 176 && offsetof(LightsBlock, spotLight) == 80, "Lights block isn't std140");
+
+class FrameUniforms {
+public:
+    // needs a current GL context
+    FrameUniforms() {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        lightsOffset = alignUp(sizeof(FrameBlock), (size_t)alignment);
+        slotBytes = alignUp(lightsOffset + sizeof(LightsBlock), (size_t)alignment);
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr)(slotBytes * FRAME_UNIFORM_SLOTS), nullptr, flags);
+        mapped = static_cast<unsigned char*>(
+                glMapBufferRange(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)(slotBytes * FRAME_UNIFORM_SLOTS), flags));
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    ~FrameUniforms() {
+        if (!TextureCache::Instance().ContextAlive())
+            return;
+        for (GLsync& fence : fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        if (mapped) {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    FrameUniforms(const FrameUniforms&) = delete;
+    FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+    // writes this frame's blocks into the next slot and binds them; call before the frame's
+    // first draw
+    void Write(const FrameBlock& frame, const LightsBlock& lights) {
+        if (!mapped)
+            return;
+        slot = (slot + 1) % FRAME_UNIFORM_SLOTS;
+        if (fences[slot]) {
+            // only waits when the GPU is FRAME_UNIFORM_SLOTS frames behind
+            while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fences[slot]);
+            fences[slot] = nullptr;
+        }
+        size_t base = slot * slotBytes;
+        memcpy(mapped + base, &frame, sizeof(frame));
+        memcpy(mapped + base + lightsOffset, &lights, sizeof(lights));
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, buffer, (GLintptr)base, sizeof(FrameBlock));
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, buffer, (GLintptr)(base + lightsOffset),
+                          sizeof(LightsBlock));
+    }
+
+    // marks the end of the frame's draws, after which the slot may be reused
+    void EndFrame() {
+        if (mapped && !fences[slot])
+            fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // bytes sent per frame through the blocks
+    static size_t FrameBytes() { return sizeof(FrameBlock) + sizeof(LightsBlock); }
+
+private:
+    GLuint buffer = 0;
+    unsigned char* mapped = nullptr;
+    size_t lightsOffset = 0;
+    size_t slotBytes = 0;
+    int slot = 0;
+    GLsync fences[FRAME_UNIFORM_SLOTS] = {};
+
+    static size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+};
+
+#endif //SOLAR_SYSTEM_FRAME_UNIFORMS_H
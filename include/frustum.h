@@ -0,0 +1,41 @@
+#ifndef SOLAR_SYSTEM_FRUSTUM_H
+#define SOLAR_SYSTEM_FRUSTUM_H
+
+#include <cmath>
+#include "glm/glm.hpp"
+
+// The six clip planes of a view-projection matrix (Gribb & Hartmann), for sphere tests.
+struct Frustum {
+    glm::vec4 planes[6]; // xyz = inward normal, w = distance; normalised
+
+    static Frustum FromMatrix(const glm::mat4& m) {
+        // rows of the column-major matrix
+        glm::vec4 row[4];
+        for (int r = 0; r < 4; ++r)
+            row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+        Frustum f;
+        f.planes[0] = row[3] + row[0]; // left
+        f.planes[1] = row[3] - row[0]; // right
+        f.planes[2] = row[3] + row[1]; // bottom
+        f.planes[3] = row[3] - row[1]; // top
+        f.planes[4] = row[3] + row[2]; // near
+        f.planes[5] = row[3] - row[2]; // far
+        for (glm::vec4& p : f.planes) {
+            float length = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+            if (length > 0.0f)
+                p = p * (1.0f / length);
+        }
+        return f;
+    }
+
+    bool Intersects(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& p : planes) {
+            if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif //SOLAR_SYSTEM_FRUSTUM_H
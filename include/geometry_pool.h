@@ -0,0 +1,320 @@
+#ifndef SOLAR_SYSTEM_GEOMETRY_POOL_H
+#define SOLAR_SYSTEM_GEOMETRY_POOL_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "glad/glad.h"
+#include "Error.h"
+#include "vertex.h"
+#include "instance.h"
+#include "index_narrowing.h"
+
+// layout consumed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// where a mesh lives inside the shared buffers
+struct GeometryRange {
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    GLint  baseVertex = 0;
+    GLuint vertexCount = 0;
+};
+
+// All static geometry is suballocated from one vertex buffer and one index buffer that
+// share a single VAO. Indices are stored relative to the mesh's base vertex, so 16-bit
+// indices are enough for every mesh (Model splits anything bigger on import).
+// The VAO also reads InstanceData from a per-frame instance buffer (UploadInstances);
+// draws pick their first instance with baseInstance.
+// Indirect commands go into a persistently mapped buffer split into INDIRECT_FRAMES regions,
+// one per frame in flight: each MultiDraw appends to the current frame's region, and a fence
+// per region keeps the CPU from overwriting commands the GPU hasn't read yet (as in
+// FrameUniforms).
+class GeometryPool {
+public:
+    static const GLenum INDEX_TYPE = GL_UNSIGNED_SHORT;
+    static const int INDIRECT_FRAMES = 3;
+
+    static GeometryPool& Instance() {
+        static GeometryPool pool;
+        return pool;
+    }
+
+    GeometryRange Allocate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
+        ASSERT(vertices.size() <= MAX_SHORT_INDEXED_VERTICES, "Mesh too big for the geometry pool, split it first");
+        if (!vao)
+            init();
+
+        GeometryRange range;
+        range.baseVertex = (GLint)vertexCount;
+        range.vertexCount = (GLuint)vertices.size();
+        range.firstIndex = (GLuint)indexCount;
+        range.indexCount = (GLuint)indices.size();
+
+        reserve(vertexCount + vertices.size(), indexCount + indices.size());
+
+        std::vector<uint16_t> packed = NarrowIndices(indices);
+        // uploads go through the copy target so whatever VAO is bound stays untouched
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(uint16_t), packed.size() * sizeof(uint16_t),
+                        packed.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        vertexCount += vertices.size();
+        indexCount += indices.size();
+        return range;
+    }
+
+    // appends another index list (e.g. a LOD) that draws from the vertices of an existing range
+    GeometryRange AllocateIndices(const GeometryRange& base, const std::vector<unsigned int>& indices) {
+        GeometryRange range = base;
+        range.firstIndex = (GLuint)indexCount;
+        range.indexCount = (GLuint)indices.size();
+
+        reserve(vertexCount, indexCount + indices.size());
+
+        std::vector<uint16_t> packed = NarrowIndices(indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(uint16_t), packed.size() * sizeof(uint16_t),
+                        packed.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        indexCount += indices.size();
+        return range;
+    }
+
+    // copies a range back out of the GPU buffers, widening the indices again; lets meshes
+    // drop their CPU copies and get them back only when something needs them
+    void ReadBack(const GeometryRange& range, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) const {
+        vertices.resize(range.vertexCount);
+        std::vector<uint16_t> packed(range.indexCount);
+        glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, range.baseVertex * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, range.firstIndex * sizeof(uint16_t), packed.size() * sizeof(uint16_t), packed.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        indices.assign(packed.begin(), packed.end());
+    }
+
+    DrawElementsIndirectCommand Command(const GeometryRange& range, GLuint instances = 1, GLuint baseInstance = 0) const {
+        return DrawElementsIndirectCommand{range.indexCount, instances, range.firstIndex, range.baseVertex, baseInstance};
+    }
+
+    void Bind() const {
+        glBindVertexArray(vao);
+    }
+
+    void Draw(const GeometryRange& range) const {
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, INDEX_TYPE,
+                                 (void*)(range.firstIndex * sizeof(uint16_t)), range.baseVertex);
+    }
+
+    // draws `instances` copies reading InstanceData from baseInstance on
+    void Draw(const GeometryRange& range, GLuint instances, GLuint baseInstance) const {
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, INDEX_TYPE,
+                                                      (void*)(range.firstIndex * sizeof(uint16_t)),
+                                                      (GLsizei)instances, range.baseVertex, baseInstance);
+    }
+
+    // replaces the instance buffer's contents; the buffer is orphaned first, so draws still in
+    // flight keep last frame's instances
+    void UploadInstances(const std::vector<InstanceData>& instances) {
+        if (!vao)
+            init();
+        size_t bytes = instances.size() * sizeof(InstanceData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, instanceBuffer);
+        if (bytes > instanceCapacity)
+            instanceCapacity = bytes * 2;
+        glBufferData(GL_COPY_WRITE_BUFFER, instanceCapacity, nullptr, GL_STREAM_DRAW);
+        if (bytes)
+            glBufferSubData(GL_COPY_WRITE_BUFFER, 0, bytes, instances.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // appends the commands to this frame's part of the indirect buffer and submits them with
+    // a single call. The pool VAO has to be bound.
+    void MultiDraw(const std::vector<DrawElementsIndirectCommand>& commands) {
+        if (commands.empty())
+            return;
+        size_t bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+        if (indirectUsed + bytes > indirectFrameBytes)
+            growIndirect(indirectUsed + bytes);
+        if (!indirectMapped)
+            return;
+        if (indirectFences[indirectFrame]) {
+            // only waits when the GPU is INDIRECT_FRAMES frames behind
+            while (glClientWaitSync(indirectFences[indirectFrame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) ==
+                   GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(indirectFences[indirectFrame]);
+            indirectFences[indirectFrame] = nullptr;
+        }
+        size_t offset = indirectFrame * indirectFrameBytes + indirectUsed;
+        memcpy(indirectMapped + offset, commands.data(), bytes);
+        indirectUsed += bytes;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, INDEX_TYPE, (const void*)offset, (GLsizei)commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // marks the end of the frame's draws; the next MultiDraw starts on the next region
+    void EndFrame() {
+        if (indirectUsed == 0)
+            return;
+        indirectFences[indirectFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        indirectFrame = (indirectFrame + 1) % INDIRECT_FRAMES;
+        indirectUsed = 0;
+    }
+
+    unsigned int VAO() const { return vao; }
+    size_t VertexBytes() const { return vertexCount * sizeof(Vertex); }
+    size_t IndexBytes() const { return indexCount * sizeof(uint16_t); }
+
+private:
+    unsigned int vao = 0, vbo = 0, ebo = 0, indirectBuffer = 0, instanceBuffer = 0;
+    size_t vertexCount = 0, vertexCapacity = 0;
+    size_t indexCount = 0, indexCapacity = 0;
+    unsigned char* indirectMapped = nullptr;
+    size_t indirectFrameBytes = 0; // per region
+    size_t indirectUsed = 0;       // in the current region
+    int indirectFrame = 0;
+    GLsync indirectFences[INDIRECT_FRAMES] = {};
+    size_t instanceCapacity = 0;
+
+    GeometryPool() = default;
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    void init() {
+        glGenVertexArrays(1, &vao);
+        // never empty, so programs that read instances can't read past it
+        instanceCapacity = 64 * sizeof(InstanceData);
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, instanceBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, instanceCapacity, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        reserve(1 << 16, 1 << 18);
+    }
+
+    // replaces the indirect buffer with one whose regions hold at least frameBytes. Commands
+    // already submitted keep the old buffer alive until the GPU is done with it, so nothing is
+    // copied and no fence is waited on; the current frame carries on at the new buffer's start.
+    void growIndirect(size_t frameBytes) {
+        if (indirectBuffer) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            glDeleteBuffers(1, &indirectBuffer);
+        }
+        for (GLsync& fence : indirectFences) {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        indirectFrameBytes = std::max(frameBytes, std::max(indirectFrameBytes * 2, (size_t)16384));
+        indirectUsed = 0;
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr total = (GLsizeiptr)(indirectFrameBytes * INDIRECT_FRAMES);
+        glGenBuffers(1, &indirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferStorage(GL_DRAW_INDIRECT_BUFFER, total, nullptr, flags);
+        indirectMapped = static_cast<unsigned char*>(glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, total, flags));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // grows a buffer to newBytes, keeping the first usedBytes of its contents
+    static unsigned int regrow(unsigned int buffer, size_t usedBytes, size_t newBytes) {
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+        if (buffer && usedBytes) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+        }
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return grown;
+    }
+
+    void reserve(size_t vertices, size_t indices) {
+        bool changed = false;
+        if (vertices > vertexCapacity) {
+            size_t capacity = std::max(vertices, vertexCapacity * 2);
+            vbo = regrow(vbo, vertexCount * sizeof(Vertex), capacity * sizeof(Vertex));
+            vertexCapacity = capacity;
+            changed = true;
+        }
+        if (indices > indexCapacity) {
+            size_t capacity = std::max(indices, indexCapacity * 2);
+            ebo = regrow(ebo, indexCount * sizeof(uint16_t), capacity * sizeof(uint16_t));
+            indexCapacity = capacity;
+            changed = true;
+        }
+        if (changed)
+            setupVertexArray();
+    }
+
+    void setupVertexArray() {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+        // positions
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Position)));
+        glEnableVertexAttribArray(0);
+
+        // normals
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Normal)));
+        glEnableVertexAttribArray(1);
+
+        // tex coordinates
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, TexCoords)));
+        glEnableVertexAttribArray(2);
+
+        // tangents
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Tangent)));
+        glEnableVertexAttribArray(3);
+
+        // bitangents
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Bitangent)));
+        glEnableVertexAttribArray(4);
+
+        // per instance: the model matrix, a column per location
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (GLuint column = 0; column < 4; ++column) {
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offsetof(InstanceData, Model) + column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribDivisor(5 + column, 1);
+        }
+
+        // per instance: the material
+        glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, Ambient)));
+        glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, Diffuse)));
+        glVertexAttribPointer(11, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, Specular)));
+        glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, Shininess)));
+        glVertexAttribIPointer(13, 2, GL_INT, sizeof(InstanceData), (void*)(offsetof(InstanceData, SurfaceLayer)));
+        for (GLuint location = 9; location <= 13; ++location) {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+#endif //SOLAR_SYSTEM_GEOMETRY_POOL_H
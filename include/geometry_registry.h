@@ -0,0 +1,52 @@
+#ifndef SOLAR_SYSTEM_GEOMETRY_REGISTRY_H
+#define SOLAR_SYSTEM_GEOMETRY_REGISTRY_H
+
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include "mesh.h"
+#include "model_import.h"
+
+// Geometry already in the GeometryPool, by content: a mesh whose vertices, indices and LODs
+// hash (HashGeometry) and measure the same as one uploaded before gets that mesh's pool
+// ranges instead of its own copy, whichever model or file it came from. The pool never frees
+// ranges, so a registered mesh stays valid after the model that uploaded it is gone.
+// Meshes built from the same entry share their ranges, which is what lets the renderer
+// batch them. GL thread only.
+class GeometryRegistry {
+public:
+    static GeometryRegistry& Instance() {
+        static GeometryRegistry registry;
+        return registry;
+    }
+
+    // the pool geometry of an identical mesh uploaded earlier, or nullptr
+    const Mesh* Find(const ImportedMesh& mesh) const {
+        auto it = meshes.find(mesh.geometryHash);
+        if (mesh.geometryHash == 0 || it == meshes.end())
+            return nullptr;
+        const Mesh& found = *it->second;
+        if (found.range.vertexCount != mesh.vertices.size() || found.range.indexCount != mesh.indices.size() ||
+            found.lods.size() != mesh.lods.size() + 1)
+            return nullptr;
+        return &found;
+    }
+
+    // remembers where `uploaded` (built from `source`) put its geometry
+    void Add(const ImportedMesh& source, const Mesh& uploaded) {
+        if (source.geometryHash == 0 || meshes.count(source.geometryHash))
+            return;
+        meshes[source.geometryHash].reset(new Mesh(uploaded, std::vector<Texture>()));
+    }
+
+    size_t Meshes() const { return meshes.size(); }
+
+private:
+    std::unordered_map<uint64_t, std::unique_ptr<Mesh>> meshes;
+
+    GeometryRegistry() = default;
+    GeometryRegistry(const GeometryRegistry&) = delete;
+    GeometryRegistry& operator=(const GeometryRegistry&) = delete;
+};
+
+#endif //SOLAR_SYSTEM_GEOMETRY_REGISTRY_H
@@ -0,0 +1,57 @@
+#ifndef SOLAR_SYSTEM_IMPORT_STATS_H
+#define SOLAR_SYSTEM_IMPORT_STATS_H
+
+#include <cstddef>
+
+// what importing one model cost; summed over all models in ImportTotals()
+struct ImportStats {
+    size_t fileBytes = 0;      // size of the source file
+    size_t geometryBytes = 0;  // vertex + index data produced
+    size_t meshes = 0;
+    size_t cpuResidentBytes = 0; // geometry kept in host memory after import
+    size_t gpuResidentBytes = 0; // geometry in the GeometryPool
+    size_t rssReleasedBytes = 0; // measured drop of the process's RSS when the CPU copies went
+    size_t sharedMeshes = 0;     // meshes that reused identical geometry already in the pool
+    size_t sharedBytes = 0;      // pool bytes those meshes didn't upload again
+    size_t allocations = 0;    // operator new calls while converting Assimp data into meshes
+    size_t allocatedBytes = 0;
+    size_t buildAllocations = 0; // and while moving those into Meshes and the GeometryPool
+    size_t buildAllocatedBytes = 0;
+    double readSeconds = 0.0;    // Assimp parsing
+    double convertSeconds = 0.0; // Assimp arrays -> Mesh + upload
+    double tangentSeconds = 0.0; // tangent space generation
+    double lodSeconds = 0.0;     // LOD chain generation
+
+    // source bytes per second through parsing and conversion
+    double ThroughputMBps() const {
+        double seconds = readSeconds + convertSeconds;
+        return seconds > 0.0 ? fileBytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+
+    ImportStats& operator+=(const ImportStats& o) {
+        fileBytes += o.fileBytes;
+        geometryBytes += o.geometryBytes;
+        meshes += o.meshes;
+        cpuResidentBytes += o.cpuResidentBytes;
+        gpuResidentBytes += o.gpuResidentBytes;
+        rssReleasedBytes += o.rssReleasedBytes;
+        sharedMeshes += o.sharedMeshes;
+        sharedBytes += o.sharedBytes;
+        allocations += o.allocations;
+        allocatedBytes += o.allocatedBytes;
+        buildAllocations += o.buildAllocations;
+        buildAllocatedBytes += o.buildAllocatedBytes;
+        readSeconds += o.readSeconds;
+        convertSeconds += o.convertSeconds;
+        tangentSeconds += o.tangentSeconds;
+        lodSeconds += o.lodSeconds;
+        return *this;
+    }
+};
+
+inline ImportStats& ImportTotals() {
+    static ImportStats totals;
+    return totals;
+}
+
+#endif //SOLAR_SYSTEM_IMPORT_STATS_H
@@ -0,0 +1,67 @@
+#ifndef SOLAR_SYSTEM_INDEX_NARROWING_H
+#define SOLAR_SYSTEM_INDEX_NARROWING_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// largest vertex count 16-bit indices can address
+const size_t MAX_SHORT_INDEXED_VERTICES = 0x10000;
+
+// packs 32-bit indices into 16-bit ones; every index must be below MAX_SHORT_INDEXED_VERTICES
+inline std::vector<uint16_t> NarrowIndices(const std::vector<unsigned int>& indices) {
+    std::vector<uint16_t> packed(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+        packed[i] = (uint16_t)indices[i];
+    return packed;
+}
+
+template<typename V>
+struct IndexedChunk {
+    std::vector<V> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// splits a triangle list into chunks that reference at most maxVertices vertices each,
+// so every chunk can be drawn with 16-bit indices. Triangles are never split; vertices
+// shared across a chunk boundary are duplicated.
+template<typename V>
+std::vector<IndexedChunk<V>> SplitForIndexLimit(const std::vector<V>& vertices,
+                                                const std::vector<unsigned int>& indices,
+                                                size_t maxVertices = MAX_SHORT_INDEXED_VERTICES) {
+    std::vector<IndexedChunk<V>> chunks;
+    const unsigned int unmapped = 0xFFFFFFFFu;
+    std::vector<unsigned int> remap(vertices.size(), unmapped);
+    std::vector<unsigned int> touched;
+
+    chunks.emplace_back();
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        IndexedChunk<V>* chunk = &chunks.back();
+
+        unsigned int fresh = 0;
+        for (size_t k = 0; k < 3; ++k)
+            if (remap[indices[t + k]] == unmapped)
+                ++fresh;
+
+        if (chunk->vertices.size() + fresh > maxVertices) {
+            for (unsigned int v : touched)
+                remap[v] = unmapped;
+            touched.clear();
+            chunks.emplace_back();
+            chunk = &chunks.back();
+        }
+
+        for (size_t k = 0; k < 3; ++k) {
+            unsigned int old = indices[t + k];
+            if (remap[old] == unmapped) {
+                remap[old] = (unsigned int)chunk->vertices.size();
+                chunk->vertices.push_back(vertices[old]);
+                touched.push_back(old);
+            }
+            chunk->indices.push_back(remap[old]);
+        }
+    }
+    return chunks;
+}
+
+#endif //SOLAR_SYSTEM_INDEX_NARROWING_H
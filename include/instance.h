@@ -0,0 +1,17 @@
+#ifndef SOLAR_SYSTEM_INSTANCE_H
+#define SOLAR_SYSTEM_INSTANCE_H
+
+#include "glm/glm.hpp"
+
+// Per-instance attributes of the geometry pool's VAO (locations 5 to 13, advancing once
+// per instance), as someVS reads them: where a body is and what its material looks like.
+struct InstanceData {
+    glm::mat4 Model;
+    glm::vec3 Ambient;
+    glm::vec3 Diffuse;
+    glm::vec3 Specular;
+    float Shininess;
+    glm::ivec2 SurfaceLayer; // SurfaceAtlas tier and layer; x < 0 samples the material's own map
+};
+
+#endif //SOLAR_SYSTEM_INSTANCE_H
@@ -0,0 +1,148 @@
+#ifndef SOLAR_SYSTEM_INSTANCE_BATCHER_H
+#define SOLAR_SYSTEM_INSTANCE_BATCHER_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "glad/glad.h"
+#include "geometry_pool.h"
+#include "instance.h"
+#include "render_stats.h"
+#include "shader.h"
+
+// A frame's InstanceData, with the bodies that share geometry drawn together.
+//
+// Every body drawn with a program that reads instances (someVS) is added once a frame. Bodies
+// added with their mesh join a batch with every other body of the same program and mesh; a
+// batch is one glMultiDrawElementsIndirect with a command per LOD level in use, each command
+// instancing the bodies drawn at that level. Bodies added without a mesh (they bind textures
+// or set uniforms of their own) only get an instance, which they draw from BaseInstance.
+// Upload orders the instances so that every command's are contiguous and writes them to the
+// geometry pool's instance buffer, so draw calls grow with the meshes in use, not the bodies.
+
+struct InstanceBatch {
+    Shader* shader = nullptr;
+    float depth = 0.0f; // distance of the nearest instance
+    std::vector<DrawElementsIndirectCommand> commands;
+    size_t instances = 0;
+    size_t trianglesDrawn = 0;
+    size_t trianglesFullDetail = 0;
+};
+
+class InstanceBatcher {
+public:
+    void Clear() {
+        entries.clear();
+        batches.clear();
+    }
+
+    // a body that draws itself; returns its handle for BaseInstance
+    size_t Add(const InstanceData& data) {
+        Entry entry;
+        entry.data = data;
+        entries.push_back(entry);
+        return entries.size() - 1;
+    }
+
+    // a body that can share its draw: `mesh` is the full detail range of its mesh, `lod` the
+    // range it's drawn with this frame
+    size_t Add(const InstanceData& data, Shader& shader, const GeometryRange& mesh, const GeometryRange& lod,
+               float depth) {
+        Entry entry;
+        entry.data = data;
+        entry.batched = true;
+        entry.shader = &shader;
+        entry.mesh = mesh;
+        entry.lod = lod;
+        entry.depth = depth;
+        entries.push_back(entry);
+        return entries.size() - 1;
+    }
+
+    bool Batched(size_t handle) const { return entries[handle].batched; }
+    GLuint BaseInstance(size_t handle) const { return entries[handle].slot; }
+
+    // builds the batches and uploads the instances; call after the frame's last Add
+    void Upload() {
+        order.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+            order[i] = i;
+        // batched instances first, by program, mesh and LOD; the rest keep their order
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            const Entry& ea = entries[a];
+            const Entry& eb = entries[b];
+            if (ea.batched != eb.batched)
+                return ea.batched;
+            if (!ea.batched)
+                return false;
+            if (ea.shader != eb.shader)
+                return ea.shader->ID < eb.shader->ID;
+            if (ea.mesh.firstIndex != eb.mesh.firstIndex)
+                return ea.mesh.firstIndex < eb.mesh.firstIndex;
+            return ea.lod.firstIndex < eb.lod.firstIndex;
+        });
+
+        instances.clear();
+        batches.clear();
+        const GeometryPool& pool = GeometryPool::Instance();
+        const Entry* previous = nullptr;
+        for (size_t i : order) {
+            Entry& entry = entries[i];
+            entry.slot = (GLuint)instances.size();
+            instances.push_back(entry.data);
+            if (!entry.batched)
+                continue;
+
+            if (!previous || previous->shader != entry.shader || previous->mesh.firstIndex != entry.mesh.firstIndex) {
+                InstanceBatch batch;
+                batch.shader = entry.shader;
+                batch.depth = entry.depth;
+                batches.push_back(batch);
+            }
+            previous = &entry;
+            InstanceBatch& batch = batches.back();
+            if (batch.commands.empty() || batch.commands.back().firstIndex != entry.lod.firstIndex)
+                batch.commands.push_back(pool.Command(entry.lod, 0, entry.slot));
+            batch.commands.back().instanceCount++;
+            batch.instances++;
+            batch.depth = std::min(batch.depth, entry.depth);
+            batch.trianglesDrawn += entry.lod.indexCount / 3;
+            batch.trianglesFullDetail += entry.mesh.indexCount / 3;
+        }
+        GeometryPool::Instance().UploadInstances(instances);
+    }
+
+    const std::vector<InstanceBatch>& Batches() const { return batches; }
+
+    // batch.shader has to be in use
+    static void Draw(const InstanceBatch& batch) {
+        GeometryPool& pool = GeometryPool::Instance();
+        pool.Bind();
+        pool.MultiDraw(batch.commands);
+        glBindVertexArray(0);
+
+        RenderStats& stats = FrameStats();
+        stats.trianglesDrawn += batch.trianglesDrawn;
+        stats.trianglesFullDetail += batch.trianglesFullDetail;
+        stats.drawCalls++;
+        stats.instancesBatched += batch.instances;
+    }
+
+private:
+    struct Entry {
+        InstanceData data;
+        bool batched = false;
+        Shader* shader = nullptr;
+        GeometryRange mesh;
+        GeometryRange lod;
+        float depth = 0.0f;
+        GLuint slot = 0;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<size_t> order;
+    std::vector<InstanceData> instances;
+    std::vector<InstanceBatch> batches;
+};
+
+#endif //SOLAR_SYSTEM_INSTANCE_BATCHER_H
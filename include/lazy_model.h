@@ -0,0 +1,388 @@
+#ifndef SOLAR_SYSTEM_LAZY_MODEL_H
+#define SOLAR_SYSTEM_LAZY_MODEL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "model.h"
+#include "frustum.h"
+#include "cooked_model.h"
+#include "render_stats.h"
+#include "sphere_mesh.h"
+#include "surface_atlas.h"
+
+// Models that load the first time they are needed. A LazyModel starts out as a handle: a
+// bounding sphere (read from the head of the cooked .smesh, when there is one) and the coarsest
+// level of the shared sphere in a flat colour, drawn in the model's place. Bodies that use the
+// shared sphere themselves only have their textures to load. Once the body is in view, or in
+// the view the camera is heading towards, the ModelLoader thread imports the file and decodes
+// its textures; the GL half (geometry pool, texture upload) is finished on the render thread
+// by ModelLoader::Update within a per-frame time budget. Nothing is loaded before the first
+// frame, so start-up time doesn't depend on how many bodies the scene has.
+
+struct ModelLoadJob {
+    std::string path;
+    bool sphere = false; // drawn with SharedSphereMesh; `imported` holds just the texture refs
+    bool gamma = false;
+    MeshResidency residency = MeshResidency::GpuOnly;
+    std::atomic<bool> cancelled{false};
+
+    // written by the loader thread, read on the render thread once the job is handed back
+    ImportedModel imported;
+    ImportStats stats;
+    TextureCache::DecodedBatch textures;
+    bool ok = false;
+
+    // built by ModelLoader::Update on the render thread
+    std::unique_ptr<Model> model;
+    bool finished = false;
+};
+
+class ModelLoader {
+public:
+    static ModelLoader& Instance() {
+        static ModelLoader loader;
+        return loader;
+    }
+
+    // GL work Update may do per frame; one model is always finished so loads can't stall
+    static constexpr double FINISH_BUDGET_MS = 4.0;
+
+    void Submit(const std::shared_ptr<ModelLoadJob>& job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!loader.joinable())
+                loader = std::thread([this]() { loaderLoop(); });
+            queue.push_back(job);
+            ++pending;
+        }
+        wake.notify_one();
+    }
+
+    // finishes imported models on the GL thread; call once per frame
+    void Update() {
+        auto start = std::chrono::steady_clock::now();
+        for (;;) {
+            std::shared_ptr<ModelLoadJob> job;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (imported.empty())
+                    return;
+                job = imported.front();
+                imported.pop_front();
+            }
+            finish(*job);
+            --pending;
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (ms >= FINISH_BUDGET_MS)
+                return;
+        }
+    }
+
+    // models submitted but not finished yet
+    size_t Pending() const { return pending; }
+    size_t Loaded() const { return loaded; }
+
+    ~ModelLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (loader.joinable())
+            loader.join();
+    }
+
+private:
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<ModelLoadJob>> queue;
+    std::deque<std::shared_ptr<ModelLoadJob>> imported;
+    bool stopping = false;
+    std::atomic<size_t> pending{0};
+    size_t loaded = 0;
+
+    ModelLoader() = default;
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    void finish(ModelLoadJob& job) {
+        job.finished = true;
+        if (job.cancelled || !job.ok) {
+            if (!job.cancelled)
+                std::cout << "Failed to load a model: " << job.path << std::endl;
+            return;
+        }
+        TextureCache::Instance().Adopt(job.textures);
+        if (job.sphere) {
+            job.model.reset(new Model(SharedSphereMesh(), job.imported.directory, job.imported.meshes[0].textures,
+                                      job.gamma));
+        } else {
+            job.model.reset(new Model(job.path, job.imported, job.stats, job.gamma, job.residency));
+        }
+        job.imported = ImportedModel();
+        ++loaded;
+    }
+
+    // imports one model at a time; the import itself spreads over ParallelFor workers
+    void loaderLoop() {
+        for (;;) {
+            std::shared_ptr<ModelLoadJob> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+                job = queue.front();
+                queue.pop_front();
+            }
+            if (!job->cancelled) {
+                job->ok = job->sphere || Model::Import(job->path, job->imported, job->stats);
+                if (job->ok) {
+                    job->textures = TextureCache::Decode(Model::TextureRequests(job->imported),
+                                                         TextureCache::Instance().mipFilter);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            imported.push_back(job);
+        }
+    }
+};
+
+class LazyModel {
+public:
+    // proxyColor is what the body looks like until its model is in
+    LazyModel(std::string path, glm::vec3 proxyColor, bool gamma = false,
+              MeshResidency residency = MeshResidency::GpuOnly)
+            : path(std::move(path)), proxyColor(proxyColor), gamma(gamma), residency(residency) {
+        hasBounds = ReadCookedModelBounds(CookedMeshPath(this->path), boundsCenter, boundsRadius);
+    }
+
+    // a body drawn with the shared sphere (unit radius) and the given surface textures
+    LazyModel(SphereSurface surface, glm::vec3 proxyColor, bool gamma = false)
+            : path(surface.directory), proxyColor(proxyColor), gamma(gamma), residency(MeshResidency::GpuOnly),
+              hasBounds(true), boundsRadius(1.0f) {
+        sphereSurface.directory = std::move(surface.directory);
+        sphereSurface.meshes.resize(1);
+        sphereSurface.meshes[0].textures = std::move(surface.textures);
+    }
+
+    LazyModel(const LazyModel&) = delete;
+    LazyModel& operator=(const LazyModel&) = delete;
+
+    ~LazyModel() {
+        if (job)
+            job->cancelled = true;
+        if (proxyTexture && TextureCache::Instance().ContextAlive())
+            glDeleteTextures(1, &proxyTexture);
+    }
+
+    void SetShaderTextureNamePrefix(std::string prefix) {
+        texturePrefix = prefix;
+        if (model)
+            model->SetShaderTextureNamePrefix(prefix);
+    }
+
+    // Once loaded, the body's surface map is copied into `atlas` and the model's own
+    // textures are released; the body is then drawn with the layer from SurfaceLayer.
+    void SetSurfaceAtlas(SurfaceAtlas* atlas) { surfaceAtlas = atlas; }
+
+    // Called every frame with the body's model matrix. Starts the load once the bounding
+    // sphere is in `view` or in `ahead`, the frustum the camera is moving into. Without a
+    // cooked .smesh the bounds aren't known up front, so such models are requested at once
+    // (still in the background). The same test decides whether a loaded model's textures
+    // are in use this frame.
+    void Update(const glm::mat4& transform, const Frustum& view, const Frustum& ahead) {
+        this->transform = transform;
+        if (job && job->finished && !model) {
+            model = std::move(job->model);
+            job.reset();
+            if (model) {
+                model->SetShaderTextureNamePrefix(texturePrefix);
+                // a surface map that failed to load shows the proxy colour instead
+                for (Mesh& mesh : model->meshes) {
+                    for (Texture& texture : mesh.textures) {
+                        if (texture.id == 0 && texture.type == "texture_diffuse") {
+                            if (!proxyTexture)
+                                proxyTexture = makeProxyTexture();
+                            texture.id = proxyTexture;
+                        }
+                    }
+                    mesh.ResolveBindings();
+                }
+                addToAtlas();
+                boundsCenter = model->boundsCenter;
+                boundsRadius = model->boundsRadius;
+                hasBounds = true;
+            } else {
+                failed = true;
+            }
+        }
+
+        inSight = !hasBounds;
+        if (hasBounds) {
+            glm::vec3 center = glm::vec3(transform * glm::vec4(boundsCenter, 1.0f));
+            float scale = std::max(glm::length(glm::vec3(transform[0])),
+                                   std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+            float radius = boundsRadius * scale;
+            inSight = view.Intersects(center, radius) || ahead.Intersects(center, radius);
+        }
+        if (model || job || failed)
+            return;
+        if (inSight) {
+            job = std::make_shared<ModelLoadJob>();
+            job->path = path;
+            job->sphere = !sphereSurface.meshes.empty();
+            job->imported = sphereSurface;
+            job->gamma = gamma;
+            job->residency = residency;
+            ModelLoader::Instance().Submit(job);
+        }
+    }
+
+    // also requests the textures' mip detail, while the body is in sight
+    void SelectLod(float pixelsPerUnit) {
+        if (!model)
+            return;
+        model->SelectLod(pixelsPerUnit);
+        if (inSight)
+            model->RequestTextures(pixelsPerUnit);
+    }
+
+    // the model once it's loaded, the proxy sphere until then
+    void Draw(Shader& shader) {
+        if (model) {
+            model->Draw(shader);
+            return;
+        }
+        if (!hasBounds)
+            return;
+        shader.setMat4("model", InstanceTransform());
+        drawProxy(0);
+    }
+
+    // the same for programs that read InstanceData (someVS), with the body's instance at
+    // baseInstance; its Model has to be InstanceTransform()
+    void DrawInstance(Shader& shader, GLuint baseInstance) {
+        if (model) {
+            model->Draw(shader, baseInstance);
+            return;
+        }
+        if (hasBounds)
+            drawProxy(baseInstance);
+    }
+
+    // the model matrix to draw with: the body's transform, or the proxy sphere's in its place
+    glm::mat4 InstanceTransform() const {
+        if (model)
+            return transform;
+        return glm::scale(glm::translate(transform, boundsCenter), glm::vec3(boundsRadius));
+    }
+
+    // The geometry of a body that binds nothing of its own (loaded, one mesh, in the surface
+    // atlas), which other bodies with the same mesh can be drawn with: the mesh's full detail
+    // range and the LOD range drawn this frame. False if the body has to draw itself.
+    bool SharedGeometry(GeometryRange& mesh, GeometryRange& lod) const {
+        if (!model || model->meshes.size() != 1 || surfaceLayer.x < 0)
+            return false;
+        mesh = model->meshes[0].range;
+        lod = model->meshes[0].Lod(model->CurrentLod()).range;
+        return true;
+    }
+
+    // {tier, layer} in the surface atlas, or {-1, -1} while the body draws its own textures
+    glm::ivec2 SurfaceLayer() const { return surfaceLayer; }
+
+    // what the body binds to draw, for sorting draws by material: nothing of its own once
+    // it's in the atlas (0), otherwise its first texture
+    uint32_t MaterialKey() const {
+        if (surfaceLayer.x >= 0)
+            return 0;
+        if (model && !model->meshes.empty() && !model->meshes[0].textures.empty())
+            return model->meshes[0].textures[0].id;
+        return proxyTexture;
+    }
+
+    bool Loaded() const { return model != nullptr; }
+    Model* Get() { return model.get(); }
+
+private:
+    std::string path;
+    glm::vec3 proxyColor;
+    bool gamma;
+    MeshResidency residency;
+    std::string texturePrefix;
+
+    bool hasBounds = false;
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    glm::mat4 transform = glm::mat4(1.0f);
+    bool inSight = false;
+
+    ImportedModel sphereSurface; // directory and texture refs only, for sphere bodies
+
+    std::shared_ptr<ModelLoadJob> job;
+    std::unique_ptr<Model> model;
+    bool failed = false;
+    unsigned int proxyTexture = 0;
+    SurfaceAtlas* surfaceAtlas = nullptr;
+    glm::ivec2 surfaceLayer = glm::ivec2(-1);
+
+    // only bodies whose whole material is one loaded diffuse map go into the atlas, since
+    // that's all the atlas replaces
+    void addToAtlas() {
+        if (!surfaceAtlas || model->meshes.size() != 1 || model->meshes[0].textures.size() != 1)
+            return;
+        const Texture& texture = model->meshes[0].textures[0];
+        if (texture.type != "texture_diffuse" || texture.id == proxyTexture)
+            return;
+        surfaceLayer = surfaceAtlas->Add(texture.id);
+        if (surfaceLayer.x >= 0)
+            model->ReleaseTextures();
+    }
+
+    void drawProxy(GLuint baseInstance) {
+        if (!proxyTexture)
+            proxyTexture = makeProxyTexture();
+        glBindTextures(MaterialTextureUnit(TextureSlot::Diffuse, 0), 1, &proxyTexture);
+
+        const GeometryRange& sphere = SharedSphereMesh().lods.back().range;
+        GeometryPool& pool = GeometryPool::Instance();
+        pool.Bind();
+        pool.Draw(sphere, 1, baseInstance);
+        glBindVertexArray(0);
+
+        RenderStats& stats = FrameStats();
+        stats.trianglesDrawn += sphere.indexCount / 3;
+        stats.trianglesFullDetail += sphere.indexCount / 3;
+        stats.drawCalls++;
+    }
+
+    // 1x1 texture in the proxy colour, so the proxy goes through the body's usual shader
+    unsigned int makeProxyTexture() const {
+        unsigned char texel[4];
+        for (int c = 0; c < 3; ++c)
+            texel[c] = (unsigned char)std::round(glm::clamp(proxyColor[c], 0.0f, 1.0f) * 255.0f);
+        texel[3] = 255;
+        unsigned int id;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        return id;
+    }
+};
+
+#endif //SOLAR_SYSTEM_LAZY_MODEL_H
@@ -0,0 +1,220 @@
+#ifndef SOLAR_SYSTEM_LOAD_REPORT_H
+#define SOLAR_SYSTEM_LOAD_REPORT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "asset_pack.h"
+
+// Where loading time goes, per asset and per stage: every loader (models, textures, the
+// skybox, shaders) times its stages with ScopedLoadTimer or LoadReport::Add, so a slow start
+// can be pinned on one file and one step. The viewer writes the report on exit and when L is
+// pressed, as load_report.json and a text table in load_report.txt. Stages may be recorded
+// from any thread; loads that run on several workers add up their time.
+
+enum class LoadStage {
+    Read,     // file or pack bytes into memory
+    Parse,    // model file parsing (Assimp, OBJ) or cooked format parsing
+    Convert,  // importer data -> ImportedModel
+    Tangents, // tangent space generation
+    Lod,      // LOD chain generation
+    Decode,   // image decoding
+    Mips,     // CPU mip chain
+    Upload,   // GL uploads (textures, geometry pool)
+    Binary,   // program binary load
+    Compile,  // shader compilation
+    Link,     // program linking
+    Count
+};
+
+inline const char* LoadStageName(LoadStage stage) {
+    static const char* const names[] = {"read", "parse", "convert", "tangents", "lod", "decode",
+                                        "mips", "upload", "binary", "compile", "link"};
+    return names[(int)stage];
+}
+
+class LoadReport {
+public:
+    static LoadReport& Instance() {
+        static LoadReport report;
+        return report;
+    }
+
+    struct Asset {
+        std::string kind; // "model", "texture", "skybox", "shader"
+        size_t bytes = 0; // source bytes read
+        double seconds[(int)LoadStage::Count] = {};
+
+        double TotalSeconds() const {
+            double total = 0.0;
+            for (double s : seconds)
+                total += s;
+            return total;
+        }
+    };
+
+    void Add(const std::string& asset, const char* kind, LoadStage stage, double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Asset& entry = at(asset, kind);
+        entry.seconds[(int)stage] += seconds;
+    }
+
+    void AddBytes(const std::string& asset, const char* kind, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        at(asset, kind).bytes += bytes;
+    }
+
+    size_t Assets() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return assets.size();
+    }
+
+    // one row per asset, slowest first, with a column for each stage that took any time
+    std::string Text() const {
+        std::vector<std::pair<std::string, Asset>> rows = sorted();
+        bool used[(int)LoadStage::Count] = {};
+        Asset total;
+        size_t nameWidth = 5;
+        for (const auto& row : rows) {
+            for (int s = 0; s < (int)LoadStage::Count; ++s) {
+                used[s] = used[s] || row.second.seconds[s] > 0.0;
+                total.seconds[s] += row.second.seconds[s];
+            }
+            total.bytes += row.second.bytes;
+            nameWidth = std::max(nameWidth, row.first.size());
+        }
+
+        std::ostringstream out;
+        char cell[64];
+        auto line = [&](const std::string& name, const std::string& kind, const Asset& asset) {
+            out << name << std::string(nameWidth + 2 - name.size(), ' ');
+            snprintf(cell, sizeof(cell), "%-8s%10.1f", kind.c_str(), asset.bytes / 1024.0);
+            out << cell;
+            for (int s = 0; s < (int)LoadStage::Count; ++s) {
+                if (used[s]) {
+                    snprintf(cell, sizeof(cell), "%12.2f", asset.seconds[s] * 1000.0);
+                    out << cell;
+                }
+            }
+            snprintf(cell, sizeof(cell), "%12.2f%10.1f\n", asset.TotalSeconds() * 1000.0, throughput(asset));
+            out << cell;
+        };
+
+        out << "asset" << std::string(nameWidth - 3, ' ');
+        snprintf(cell, sizeof(cell), "%-8s%10s", "kind", "KB");
+        out << cell;
+        for (int s = 0; s < (int)LoadStage::Count; ++s) {
+            if (used[s]) {
+                snprintf(cell, sizeof(cell), "%12s", (std::string(LoadStageName((LoadStage)s)) + " ms").c_str());
+                out << cell;
+            }
+        }
+        snprintf(cell, sizeof(cell), "%12s%10s\n", "total ms", "MB/s");
+        out << cell;
+        for (const auto& row : rows)
+            line(row.first, row.second.kind, row.second);
+        line("total", "", total);
+        return out.str();
+    }
+
+    std::string Json() const {
+        std::vector<std::pair<std::string, Asset>> rows = sorted();
+        std::ostringstream out;
+        out << "{\n  \"assets\": [";
+        for (size_t i = 0; i < rows.size(); ++i) {
+            const Asset& asset = rows[i].second;
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << escape(rows[i].first) << "\", \"kind\": \""
+                << escape(asset.kind) << "\", \"bytes\": " << asset.bytes << ", \"stages_ms\": {";
+            bool first = true;
+            for (int s = 0; s < (int)LoadStage::Count; ++s) {
+                if (asset.seconds[s] > 0.0) {
+                    out << (first ? "" : ", ") << '"' << LoadStageName((LoadStage)s)
+                        << "\": " << asset.seconds[s] * 1000.0;
+                    first = false;
+                }
+            }
+            out << "}, \"total_ms\": " << asset.TotalSeconds() * 1000.0
+                << ", \"mb_per_s\": " << throughput(asset) << '}';
+        }
+        out << "\n  ]\n}\n";
+        return out.str();
+    }
+
+    // writes <base>.json and <base>.txt
+    bool Write(const std::string& base = "load_report") const {
+        std::ofstream json(base + ".json", std::ios::trunc), text(base + ".txt", std::ios::trunc);
+        json << Json();
+        text << Text();
+        return json && text;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, Asset> assets;
+
+    LoadReport() = default;
+    LoadReport(const LoadReport&) = delete;
+    LoadReport& operator=(const LoadReport&) = delete;
+
+    Asset& at(const std::string& asset, const char* kind) {
+        Asset& entry = assets[PackKey(asset)];
+        if (entry.kind.empty())
+            entry.kind = kind;
+        return entry;
+    }
+
+    std::vector<std::pair<std::string, Asset>> sorted() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::pair<std::string, Asset>> rows(assets.begin(), assets.end());
+        std::stable_sort(rows.begin(), rows.end(), [](const std::pair<std::string, Asset>& a,
+                                                      const std::pair<std::string, Asset>& b) {
+            return a.second.TotalSeconds() > b.second.TotalSeconds();
+        });
+        return rows;
+    }
+
+    static double throughput(const Asset& asset) {
+        double seconds = asset.TotalSeconds();
+        return seconds > 0.0 ? asset.bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+
+    static std::string escape(const std::string& s) {
+        std::string escaped;
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char)c >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// adds the time from construction to destruction to one stage of an asset
+class ScopedLoadTimer {
+public:
+    ScopedLoadTimer(std::string asset, const char* kind, LoadStage stage)
+            : asset(std::move(asset)), kind(kind), stage(stage), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedLoadTimer() {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LoadReport::Instance().Add(asset, kind, stage, seconds);
+    }
+
+    ScopedLoadTimer(const ScopedLoadTimer&) = delete;
+    ScopedLoadTimer& operator=(const ScopedLoadTimer&) = delete;
+
+private:
+    std::string asset;
+    const char* kind;
+    LoadStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif //SOLAR_SYSTEM_LOAD_REPORT_H
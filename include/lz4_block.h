@@ -0,0 +1,166 @@
+#ifndef SOLAR_SYSTEM_LZ4_BLOCK_H
+#define SOLAR_SYSTEM_LZ4_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// The LZ4 block format (no frame header, no checksums), so asset pack chunks can be
+// compressed by solar_cook and inflated at load time without another dependency. The
+// compressor is the plain greedy single-hash variant: fast enough for cooking and its
+// output is read by any LZ4 block decoder. The decoder checks every length and offset
+// against both buffers, so a damaged pack fails the read instead of overrunning memory.
+//
+// A block is a run of sequences: token (literal length << 4 | match length - 4), extra
+// literal length bytes, literals, u16 little-endian offset, extra match length bytes.
+// The last sequence is literals only and the last match ends at least 5 bytes before the end.
+
+namespace lz4_detail {
+
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;
+const size_t MATCH_FIND_LIMIT = 12;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 16;
+
+inline uint32_t Read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t HashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+inline unsigned char* WriteLength(unsigned char* op, size_t length) {
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+// literals [literals, literals + literalCount), then a match of matchLength at offset (0 = none)
+inline unsigned char* WriteSequence(unsigned char* op, const unsigned char* literals, size_t literalCount,
+                                    size_t offset, size_t matchLength) {
+    unsigned char* token = op++;
+    *token = (unsigned char)((literalCount >= 15 ? 15 : literalCount) << 4);
+    if (literalCount >= 15)
+        op = WriteLength(op, literalCount - 15);
+    memcpy(op, literals, literalCount);
+    op += literalCount;
+    if (offset == 0)
+        return op;
+
+    *op++ = (unsigned char)(offset & 0xFF);
+    *op++ = (unsigned char)(offset >> 8);
+    size_t extra = matchLength - MIN_MATCH;
+    *token |= (unsigned char)(extra >= 15 ? 15 : extra);
+    if (extra >= 15)
+        op = WriteLength(op, extra - 15);
+    return op;
+}
+
+} // namespace lz4_detail
+
+// worst-case compressed size of `size` bytes (incompressible input grows slightly)
+inline size_t Lz4CompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+// compresses into dst (at least Lz4CompressBound(size) bytes); returns the compressed size
+inline size_t Lz4Compress(const unsigned char* src, size_t size, unsigned char* dst) {
+    using namespace lz4_detail;
+    unsigned char* op = dst;
+    size_t anchor = 0;
+    if (size > MATCH_FIND_LIMIT) {
+        std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0); // position + 1, 0 = empty
+        const size_t lastMatchStart = size - MATCH_FIND_LIMIT;
+        const size_t matchEndLimit = size - LAST_LITERALS;
+        size_t i = 0;
+        unsigned misses = 0;
+        while (i <= lastMatchStart) {
+            uint32_t sequence = Read32(src + i);
+            uint32_t& slot = table[HashSequence(sequence)];
+            size_t candidate = slot;
+            slot = (uint32_t)(i + 1);
+            if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || Read32(src + candidate - 1) != sequence) {
+                // step faster through data that doesn't compress
+                i += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (i + length < matchEndLimit && src[match + length] == src[i + length])
+                ++length;
+            op = WriteSequence(op, src + anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+        }
+    }
+    return (size_t)(WriteSequence(op, src + anchor, size - anchor, 0, 0) - dst);
+}
+
+// true if src is a well-formed block that inflates to exactly dstSize bytes
+inline bool Lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize) {
+    using namespace lz4_detail;
+    const unsigned char* ip = src;
+    const unsigned char* const inEnd = src + srcSize;
+    unsigned char* op = dst;
+    unsigned char* const outEnd = dst + dstSize;
+
+    auto readLength = [&](size_t& length) {
+        unsigned char b;
+        do {
+            if (ip >= inEnd)
+                return false;
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    };
+
+    for (;;) {
+        if (ip >= inEnd)
+            return false;
+        unsigned token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(literals))
+            return false;
+        if ((size_t)(inEnd - ip) < literals || (size_t)(outEnd - op) < literals)
+            return false;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == inEnd)
+            return op == outEnd;
+
+        if (inEnd - ip < 2)
+            return false;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst))
+            return false;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(length))
+            return false;
+        length += MIN_MATCH;
+        if ((size_t)(outEnd - op) < length)
+            return false;
+
+        const unsigned char* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            // overlapping copy repeats the last `offset` bytes
+            for (size_t k = 0; k < length; ++k)
+                *op++ = match[k];
+        }
+    }
+}
+
+#endif //SOLAR_SYSTEM_LZ4_BLOCK_H
@@ -0,0 +1,62 @@
+#ifndef SOLAR_SYSTEM_MATERIAL_SLOTS_H
+#define SOLAR_SYSTEM_MATERIAL_SLOTS_H
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+// Material samplers follow the loader's naming, "<prefix>texture_<kind><n>" with n from 1
+// (material.texture_diffuse1, texture_specular2, ...), and each one has a texture unit of its
+// own that doesn't depend on the program or the mesh: kind k's n-th texture is always on
+// MATERIAL_FIRST_UNIT + k * TEXTURES_PER_SLOT + n - 1. Programs point their samplers at
+// these units once, when linked (see Shader), and meshes bind their textures straight to
+// them (see Mesh::BindTextures), so drawing a material sets no uniforms.
+// Unit 0 is left to the code that binds textures by hand (the ISS, the skybox), units 14
+// and 15 to the virtual textures, 16 and up to the surface atlas.
+
+enum class TextureSlot {
+    Diffuse,
+    Specular,
+    Normal,
+    Height,
+    Count
+};
+
+const int MATERIAL_FIRST_UNIT = 1;
+const int TEXTURES_PER_SLOT = 3;
+const int MATERIAL_UNITS = (int)TextureSlot::Count * TEXTURES_PER_SLOT;
+
+// "texture_diffuse" etc. (Texture::type) -> slot
+inline bool ParseTextureSlot(const std::string& type, TextureSlot& slot) {
+    static const char* const names[] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+    for (int i = 0; i < (int)TextureSlot::Count; ++i) {
+        if (type == names[i]) {
+            slot = (TextureSlot)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// the unit of the slot's index-th texture (from 0), or -1 past TEXTURES_PER_SLOT
+inline int MaterialTextureUnit(TextureSlot slot, int index) {
+    if (index < 0 || index >= TEXTURES_PER_SLOT)
+        return -1;
+    return MATERIAL_FIRST_UNIT + (int)slot * TEXTURES_PER_SLOT + index;
+}
+
+// the unit a sampler uniform named after the convention above belongs to, or -1
+inline int MaterialSamplerUnit(const std::string& uniform) {
+    size_t dot = uniform.rfind('.');
+    std::string name = dot == std::string::npos ? uniform : uniform.substr(dot + 1);
+    size_t digits = name.find_first_of("0123456789");
+    if (digits == std::string::npos || digits == 0 ||
+        name.find_first_not_of("0123456789", digits) != std::string::npos)
+        return -1;
+    TextureSlot slot;
+    if (!ParseTextureSlot(name.substr(0, digits), slot))
+        return -1;
+    return MaterialTextureUnit(slot, std::atoi(name.c_str() + digits) - 1);
+}
+
+#endif //SOLAR_SYSTEM_MATERIAL_SLOTS_H
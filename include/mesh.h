@@ -3,19 +3,16 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
 #include <Error.h>
+#include "geometry_pool.h"
+#include "material_slots.h"
+#include "vertex.h"
 #include "glm/glm.hpp"
 #include "glad/glad.h"
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
-};
-
 struct Texture {
     unsigned int id;
     std::string type; // texture_diffuse, texture_specular, texture_normal, texture_height
@@ -23,6 +20,18 @@ struct Texture {
 };
 
 
+// what a Mesh keeps in host memory once its geometry is in the GeometryPool
+enum class MeshResidency {
+    CpuAndGpu,  // full vertices and indices stay on the CPU
+    CompactCpu, // only positions and 16-bit indices, enough for picking and bounds
+    GpuOnly     // only bounds; RestoreCpuGeometry reads the rest back from the pool
+};
+
+struct MeshLod {
+    GeometryRange range;
+    float error; // geometric deviation from LOD 0, in model units
+};
+
 class Mesh {
 public:
     std::vector<Vertex> vertices;
@@ -30,87 +39,163 @@ public:
     std::vector<Texture> textures;
 
     unsigned int vao;
+    GeometryRange range; // where the mesh lives in the shared geometry buffers
+    std::vector<MeshLod> lods; // lods[0] is the full detail mesh
     std::string glslIdentifierPrefix;
 
-    Mesh(const std::vector<Vertex>& vs, const std::vector<unsigned int>& is,
-         const std::vector<Texture>& ts)
-         : vertices(vs), indices(is), textures(ts){
+    MeshResidency residency = MeshResidency::CpuAndGpu;
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+    std::vector<glm::vec3> positions;    // CompactCpu only
+    std::vector<uint16_t> compactIndices; // CompactCpu only
+    bool ownsGeometry = true;             // false when the pool range belongs to another mesh
+
+    // takes the buffers by value so callers can move them in without a copy
+    Mesh(std::vector<Vertex> vs, std::vector<unsigned int> is, std::vector<Texture> ts)
+         : vertices(std::move(vs)), indices(std::move(is)), textures(std::move(ts)){
         setupMesh();
     }
 
-    void Draw(Shader& shader) {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-
-        for(unsigned int i = 1; i <= textures.size(); i++) {
-            glActiveTexture(GL_TEXTURE0 + i);
-            std::string name = textures[i-1].type;
-            std::string number;
-
-            if(name == "texture_diffuse") {
-                number = std::to_string(diffuseNr++);
-            } else if(name == "texture_specular") {
-                number = std::to_string(specularNr++);
-            } else if(name == "texture_normal") {
-                number = std::to_string(normalNr++);
-            } else if(name == "texture_height") {
-                number = std::to_string(heightNr++);
-            } else {
-                ASSERT(false, "Unknown texture type");
-            }
+    // draws another mesh's pool range and LODs with its own textures, e.g. one sphere shared
+    // by every planet; no geometry of its own
+    Mesh(const Mesh& geometry, std::vector<Texture> ts)
+         : textures(std::move(ts)), vao(geometry.vao), range(geometry.range),
+           lods(geometry.lods), residency(MeshResidency::GpuOnly), boundsMin(geometry.boundsMin),
+           boundsMax(geometry.boundsMax), ownsGeometry(false) {}
 
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i-1].id);
-        }
+    void Draw(Shader& shader) {
+        BindTextures();
 
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        GeometryPool::Instance().Draw(range);
 
         // deactivating all the objects we used
         glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE0);
     }
-private:
-    unsigned vbo, ebo;
 
-    void setupMesh() {
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
+    // binds the mesh's textures to their material units (see material_slots.h) in one call;
+    // the programs' samplers already point there
+    void BindTextures() {
+        if (!bindingsResolved)
+            ResolveBindings();
+        if (!unitTextures.empty())
+            glBindTextures(MATERIAL_FIRST_UNIT, (GLsizei)unitTextures.size(), unitTextures.data());
+    }
 
-        glBindVertexArray(vao);
+    // builds the binding table from `textures`; call again after changing them
+    void ResolveBindings() {
+        int count[(int)TextureSlot::Count] = {};
+        unitTextures.clear();
+        for (const Texture& texture : textures) {
+            TextureSlot slot;
+            if (!ParseTextureSlot(texture.type, slot)) {
+                ASSERT(false, "Unknown texture type");
+                continue;
+            }
+            int unit = MaterialTextureUnit(slot, count[(int)slot]++);
+            if (unit < 0)
+                continue; // more textures of one kind than there are units for it
+            size_t index = (size_t)(unit - MATERIAL_FIRST_UNIT);
+            if (unitTextures.size() <= index)
+                unitTextures.resize(index + 1, 0);
+            unitTextures[index] = texture.id;
+        }
+        bindingsResolved = true;
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    // registers a simplified index list that draws from this mesh's vertices
+    void AddLod(const std::vector<unsigned int>& lodIndices, float error) {
+        lods.push_back(MeshLod{GeometryPool::Instance().AllocateIndices(range, lodIndices), error});
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+    // drops the CPU copies the chosen residency doesn't keep
+    void SetResidency(MeshResidency mode) {
+        if (mode == residency)
+            return;
+        if (mode == MeshResidency::CpuAndGpu) {
+            RestoreCpuGeometry();
+            return;
+        }
+        if (mode == MeshResidency::CompactCpu && positions.empty()) {
+            if (vertices.empty())
+                RestoreCpuGeometry();
+            positions.reserve(vertices.size());
+            for (const Vertex& v : vertices)
+                positions.push_back(v.Position);
+            compactIndices.assign(indices.begin(), indices.end()); // < 65536 vertices per mesh
+        }
+        if (mode == MeshResidency::GpuOnly) {
+            std::vector<glm::vec3>().swap(positions);
+            std::vector<uint16_t>().swap(compactIndices);
+        }
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+        residency = mode;
+    }
 
-        // positions
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Position)));
-        glEnableVertexAttribArray(0);
+    // brings vertices and indices back from the geometry pool if they were released
+    void RestoreCpuGeometry() {
+        if (vertices.empty() && range.vertexCount > 0)
+            GeometryPool::Instance().ReadBack(range, vertices, indices);
+        std::vector<glm::vec3>().swap(positions);
+        std::vector<uint16_t>().swap(compactIndices);
+        residency = MeshResidency::CpuAndGpu;
+    }
 
-        // normals
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Normal)));
-        glEnableVertexAttribArray(1);
+    // host memory held for this mesh's geometry
+    size_t CpuBytes() const {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+               positions.capacity() * sizeof(glm::vec3) + compactIndices.capacity() * sizeof(uint16_t) +
+               lods.capacity() * sizeof(MeshLod);
+    }
 
-        // tex coordinates
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, TexCoords)));
-        glEnableVertexAttribArray(2);
+    // pool memory used by this mesh's vertices and all of its LOD index lists
+    size_t GpuBytes() const {
+        if (!ownsGeometry)
+            return 0;
+        size_t bytes = range.vertexCount * sizeof(Vertex);
+        for (const MeshLod& lod : lods)
+            bytes += lod.range.indexCount * sizeof(uint16_t);
+        return bytes;
+    }
 
-        // tangents
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Tangent)));
-        glEnableVertexAttribArray(3);
+    const MeshLod& Lod(size_t level) const {
+        return lods[std::min(level, lods.size() - 1)];
+    }
 
-        // bitangents
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Bitangent)));
-        glEnableVertexAttribArray(4);
+    // true when both draw the same pool geometry (see GeometryRegistry)
+    bool SharesGeometryWith(const Mesh& other) const {
+        return range.firstIndex == other.range.firstIndex && range.baseVertex == other.range.baseVertex &&
+               range.indexCount == other.range.indexCount;
+    }
 
-        glBindVertexArray(0);
+    bool SharesTexturesWith(const Mesh& other) const {
+        if (textures.size() != other.textures.size())
+            return false;
+        for (size_t i = 0; i < textures.size(); ++i) {
+            if (textures[i].id != other.textures[i].id || textures[i].type != other.textures[i].type)
+                return false;
+        }
+        return glslIdentifierPrefix == other.glslIdentifierPrefix;
     }
+private:
+    // texture per material unit, from MATERIAL_FIRST_UNIT on (0 where the mesh has none)
+    std::vector<GLuint> unitTextures;
+    bool bindingsResolved = false;
 
+    // geometry is suballocated from the global pool instead of owning a VAO/VBO/EBO per mesh
+    void setupMesh() {
+        GeometryPool& pool = GeometryPool::Instance();
+        range = pool.Allocate(vertices, indices);
+        vao = pool.VAO();
+        if (!vertices.empty()) {
+            boundsMin = boundsMax = vertices[0].Position;
+            for (const Vertex& v : vertices) {
+                boundsMin = glm::min(boundsMin, v.Position);
+                boundsMax = glm::max(boundsMax, v.Position);
+            }
+        }
+        lods.push_back(MeshLod{range, 0.0f});
+    }
 };
 
 
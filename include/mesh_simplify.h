@@ -0,0 +1,255 @@
+#ifndef SOLAR_SYSTEM_MESH_SIMPLIFY_H
+#define SOLAR_SYSTEM_MESH_SIMPLIFY_H
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include "vertex.h"
+
+// Quadric error metric mesh simplification (Garland & Heckbert) used to build LOD chains.
+// Collapses always move a vertex onto one of its neighbours, so every level reuses the
+// original vertex buffer and only the index list changes. Vertices on UV seams (several
+// vertices at one position) and on open borders are never moved, which keeps seams intact.
+
+struct Quadric {
+    // upper triangle of the symmetric 4x4 matrix
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    void AddPlane(const glm::vec3& n, float d, double w) {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+        a22 += w * n.z * n.z; a23 += w * n.z * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+        return *this;
+    }
+
+    // weighted squared distance of p to the accumulated planes
+    double Error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                 + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                 + a22 * z * z + 2 * a23 * z
+                 + a33;
+        return e > 0 ? e : 0;
+    }
+};
+
+struct LodLevel {
+    std::vector<unsigned int> indices;
+    float error; // approximate deviation from the full detail mesh, in model units
+};
+
+// Simplifies the triangle list down to about targetIndexCount indices. maxError receives
+// the largest RMS plane distance introduced by a collapse.
+inline std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex>& vertices,
+                                              const std::vector<unsigned int>& indices,
+                                              size_t targetIndexCount, float& maxError) {
+    maxError = 0.0f;
+    const size_t vertexCount = vertices.size();
+    const size_t triCount = indices.size() / 3;
+
+    // weld vertices by position; a position shared by several vertices is a UV/normal seam
+    std::vector<unsigned int> rep(vertexCount);
+    std::vector<unsigned int> wedges(vertexCount, 0);
+    {
+        struct Key {
+            uint32_t x, y, z;
+            bool operator==(const Key& o) const { return x == o.x && y == o.y && z == o.z; }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& k) const { return (k.x * 73856093u) ^ (k.y * 19349663u) ^ (k.z * 83492791u); }
+        };
+        std::unordered_map<Key, unsigned int, KeyHash> firstAt;
+        firstAt.reserve(vertexCount);
+        for (unsigned int i = 0; i < vertexCount; ++i) {
+            Key k;
+            std::memcpy(&k.x, &vertices[i].Position.x, 4);
+            std::memcpy(&k.y, &vertices[i].Position.y, 4);
+            std::memcpy(&k.z, &vertices[i].Position.z, 4);
+            rep[i] = firstAt.emplace(k, i).first->second;
+            wedges[rep[i]]++;
+        }
+    }
+
+    std::vector<char> locked(vertexCount, 0);
+    for (unsigned int i = 0; i < vertexCount; ++i)
+        locked[i] = wedges[rep[i]] > 1;
+
+    // border edges (used by a single triangle) lock their end points too
+    {
+        std::unordered_map<uint64_t, int> edgeUse;
+        edgeUse.reserve(indices.size());
+        for (size_t t = 0; t < triCount; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                uint64_t a = rep[indices[3 * t + k]], b = rep[indices[3 * t + (k + 1) % 3]];
+                if (a > b) std::swap(a, b);
+                edgeUse[(a << 32) | b]++;
+            }
+        }
+        for (size_t t = 0; t < triCount; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                unsigned int a = indices[3 * t + k], b = indices[3 * t + (k + 1) % 3];
+                uint64_t ra = rep[a], rb = rep[b];
+                if (ra > rb) std::swap(ra, rb);
+                if (edgeUse[(ra << 32) | rb] == 1)
+                    locked[a] = locked[b] = 1;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t < triCount; ++t) {
+        const glm::vec3& p0 = vertices[indices[3 * t]].Position;
+        const glm::vec3& p1 = vertices[indices[3 * t + 1]].Position;
+        const glm::vec3& p2 = vertices[indices[3 * t + 2]].Position;
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float area2 = glm::length(n);
+        if (area2 <= 0.0f)
+            continue;
+        n = n / area2;
+        for (int k = 0; k < 3; ++k)
+            quadrics[rep[indices[3 * t + k]]].AddPlane(n, -glm::dot(n, p0), area2 * 0.5);
+    }
+
+    std::vector<unsigned int> tris(indices);
+    std::vector<char> removed(triCount, 0);
+    std::vector<std::vector<unsigned int>> adjacency(vertexCount);
+    for (unsigned int t = 0; t < triCount; ++t)
+        for (int k = 0; k < 3; ++k)
+            adjacency[tris[3 * t + k]].push_back(t);
+
+    auto collapseCost = [&](unsigned int from, unsigned int to) {
+        Quadric q = quadrics[rep[from]];
+        q += quadrics[rep[to]];
+        return q.weight > 0 ? q.Error(vertices[to].Position) / q.weight : 0.0;
+    };
+
+    struct Candidate {
+        double cost;
+        unsigned int from, to;
+        bool operator<(const Candidate& o) const { return cost > o.cost; } // min-heap
+    };
+    std::priority_queue<Candidate> heap;
+    auto pushEdgesOf = [&](unsigned int t) {
+        for (int k = 0; k < 3; ++k) {
+            unsigned int a = tris[3 * t + k], b = tris[3 * t + (k + 1) % 3];
+            if (!locked[a]) heap.push(Candidate{collapseCost(a, b), a, b});
+            if (!locked[b]) heap.push(Candidate{collapseCost(b, a), b, a});
+        }
+    };
+    for (unsigned int t = 0; t < triCount; ++t)
+        pushEdgesOf(t);
+
+    std::vector<char> collapsed(vertexCount, 0);
+    size_t liveTris = triCount;
+
+    while (liveTris * 3 > targetIndexCount && !heap.empty()) {
+        Candidate c = heap.top();
+        heap.pop();
+        unsigned int u = c.from, v = c.to;
+        if (collapsed[u] || collapsed[v] || u == v)
+            continue;
+
+        double cost = collapseCost(u, v);
+        if (cost > c.cost * 1.0001 + 1e-12) {
+            // quadrics changed since this entry was queued
+            heap.push(Candidate{cost, u, v});
+            continue;
+        }
+
+        bool adjacent = false, flips = false;
+        for (unsigned int t : adjacency[u]) {
+            if (removed[t]) continue;
+            const unsigned int* tri = &tris[3 * t];
+            if (tri[0] == v || tri[1] == v || tri[2] == v) {
+                adjacent = true;
+                continue;
+            }
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; ++k) {
+                p[k] = vertices[tri[k]].Position;
+                q[k] = tri[k] == u ? vertices[v].Position : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.2f * glm::length(before) * glm::length(after)) {
+                flips = true;
+                break;
+            }
+        }
+        if (!adjacent || flips)
+            continue;
+
+        collapsed[u] = 1;
+        quadrics[rep[v]] += quadrics[rep[u]];
+        maxError = std::max(maxError, (float)std::sqrt(cost));
+
+        for (unsigned int t : adjacency[u]) {
+            if (removed[t]) continue;
+            unsigned int* tri = &tris[3 * t];
+            for (int k = 0; k < 3; ++k)
+                if (tri[k] == u) tri[k] = v;
+            if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+                removed[t] = 1;
+                --liveTris;
+            } else {
+                adjacency[v].push_back(t);
+            }
+        }
+        adjacency[u].clear();
+
+        for (unsigned int t : adjacency[v])
+            if (!removed[t])
+                pushEdgesOf(t);
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(liveTris * 3);
+    for (size_t t = 0; t < triCount; ++t)
+        if (!removed[t])
+            result.insert(result.end(), &tris[3 * t], &tris[3 * t] + 3);
+    return result;
+}
+
+// Builds progressively coarser index lists, each about half of the previous one. Stops when
+// the mesh gets small or the simplifier can no longer make real progress (e.g. everything
+// left is locked on seams).
+inline std::vector<LodLevel> GenerateLodChain(const std::vector<Vertex>& vertices,
+                                              const std::vector<unsigned int>& indices,
+                                              size_t maxLevels = 4, size_t minTriangles = 128) {
+    std::vector<LodLevel> chain;
+    const std::vector<unsigned int>* source = &indices;
+    float error = 0.0f;
+    for (size_t level = 0; level < maxLevels; ++level) {
+        size_t target = source->size() / 2;
+        if (target / 3 < minTriangles)
+            break;
+        float levelError;
+        std::vector<unsigned int> simplified = SimplifyMesh(vertices, *source, target, levelError);
+        if (simplified.size() > source->size() * 9 / 10)
+            break;
+        error += levelError; // levels are built from each other, so their errors add up
+        chain.push_back(LodLevel{std::move(simplified), error});
+        source = &chain.back().indices;
+    }
+    return chain;
+}
+
+#endif //SOLAR_SYSTEM_MESH_SIMPLIFY_H
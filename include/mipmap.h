@@ -0,0 +1,327 @@
+#ifndef SOLAR_SYSTEM_MIPMAP_H
+#define SOLAR_SYSTEM_MIPMAP_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "parallel.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// CPU mip chain generation. Colour channels of sRGB images are filtered in linear light
+// and re-encoded, so dark/bright detail doesn't shift brightness as it shrinks (which is
+// what glGenerateMipmap does on GL_RGB8 data). Each level is filtered from full precision
+// float rows of the previous one, streamed through the chain in strips so memory stays
+// bounded for large images; rows are spread over worker threads and the inner loops work
+// on plain float arrays (SSE2 where available).
+
+enum class MipFilter {
+    Box,    // 2x2 average, cheap
+    Kaiser  // 6-tap Kaiser-windowed sinc, sharper
+};
+
+struct MipLevel {
+    int width = 0, height = 0;
+    std::vector<unsigned char> pixels; // tightly packed, `channels` bytes per texel
+};
+
+struct MipChain {
+    int channels = 0;
+    bool srgb = false;
+    std::vector<MipLevel> levels;
+
+    size_t Bytes() const {
+        size_t bytes = 0;
+        for (const MipLevel& level : levels)
+            bytes += level.pixels.size();
+        return bytes;
+    }
+};
+
+namespace mip_detail {
+
+const int LINEAR_TO_SRGB_STEPS = 4096;
+
+struct SrgbTables {
+    float toLinear[256];
+    uint8_t toSrgb[LINEAR_TO_SRGB_STEPS + 1];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i <= LINEAR_TO_SRGB_STEPS; ++i) {
+            float l = (float)i / LINEAR_TO_SRGB_STEPS;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = (uint8_t)std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f));
+        }
+    }
+};
+
+inline const SrgbTables& Tables() {
+    static const SrgbTables tables; // thread-safe initialisation
+    return tables;
+}
+
+// channels that hold colour (as opposed to alpha / data) in an sRGB image
+inline bool IsColorChannel(int channel, int channels) {
+    return channels >= 3 ? channel < 3 : channels == 1 ? true : channel == 0;
+}
+
+// source rows converted to float per step, and so the most a level takes in at once
+const int STRIP_ROWS = 64;
+
+// rows [firstRow, firstRow + rows) of an 8-bit level as floats (linear light for sRGB colour)
+inline void DecodeRows(const MipLevel& level, int channels, bool srgb, int firstRow, int rows,
+                       std::vector<float>& out) {
+    const float* toLinear = Tables().toLinear;
+    const size_t rowLen = (size_t)level.width * channels;
+    out.resize(rows * rowLen);
+    ParallelFor((size_t)rows, [&](size_t y) {
+        const unsigned char* in = &level.pixels[(firstRow + y) * rowLen];
+        float* row = &out[y * rowLen];
+        for (int c = 0; c < channels; ++c) {
+            bool linearize = srgb && IsColorChannel(c, channels);
+            for (size_t i = c; i < rowLen; i += channels)
+                row[i] = linearize ? toLinear[in[i]] : in[i] / 255.0f;
+        }
+    }, 16);
+}
+
+inline void EncodeRows(const float* in, int firstRow, int rows, int channels, bool srgb, MipLevel& level) {
+    const uint8_t* toSrgb = Tables().toSrgb;
+    const size_t rowLen = (size_t)level.width * channels;
+    ParallelFor((size_t)rows, [&](size_t y) {
+        const float* row = in + y * rowLen;
+        unsigned char* out = &level.pixels[(firstRow + y) * rowLen];
+        for (int c = 0; c < channels; ++c) {
+            bool encode = srgb && IsColorChannel(c, channels);
+            for (size_t i = c; i < rowLen; i += channels) {
+                float v = std::min(1.0f, std::max(0.0f, row[i]));
+                out[i] = encode ? toSrgb[(int)(v * LINEAR_TO_SRGB_STEPS + 0.5f)] : (uint8_t)(v * 255.0f + 0.5f);
+            }
+        }
+    }, 16);
+}
+
+// dst[i] = (a[i] + b[i]) * 0.5
+inline void AverageRows(const float* a, const float* b, float* dst, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), half));
+#endif
+    for (; i < n; ++i)
+        dst[i] = (a[i] + b[i]) * 0.5f;
+}
+
+struct KaiserKernel {
+    // taps at source distances -2.5 .. 2.5 from the destination texel centre
+    float weights[6];
+
+    KaiserKernel() {
+        auto bessel0 = [](double x) {
+            double sum = 1.0, term = 1.0;
+            for (int k = 1; k < 16; ++k) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        };
+        const double alpha = 4.0, width = 3.0, pi = 3.14159265358979;
+        double total = 0.0;
+        for (int i = 0; i < 6; ++i) {
+            double d = i - 2.5;
+            double x = d / 2.0; // sinc at half the source frequency
+            double sinc = std::sin(pi * x) / (pi * x);
+            double r = d / width;
+            double window = bessel0(alpha * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel0(alpha);
+            weights[i] = (float)(sinc * window);
+            total += weights[i];
+        }
+        for (int i = 0; i < 6; ++i)
+            weights[i] = (float)(weights[i] / total);
+    }
+};
+
+inline const float* KaiserWeights() {
+    static const KaiserKernel kernel;
+    return kernel.weights;
+}
+
+// One level of the chain, produced strip by strip from the rows of the level above it:
+// source rows are filtered horizontally as they arrive, and each output row is the
+// vertical filter over the few filtered rows it covers (2 for the box, 6 for Kaiser).
+// Only the filtered rows later output rows still need are kept.
+struct LevelStream {
+    int sw = 0, sh = 0;   // source level
+    int dw = 0, dh = 0;   // this level
+    int channels = 0;
+    bool kaiser = false;
+    std::vector<float> window; // filtered source rows [windowFirst, windowFirst + windowRows)
+    int windowFirst = 0, windowRows = 0;
+    int nextRow = 0;           // next row of this level to produce
+
+    int firstSource(int y) const { return kaiser ? std::max(2 * y - 2, 0) : std::min(2 * y, sh - 1); }
+    int lastSource(int y) const { return kaiser ? std::min(2 * y + 3, sh - 1) : std::min(2 * y + 1, sh - 1); }
+
+    void filterRow(const float* in, float* out) const {
+        if (kaiser) {
+            const float* w = KaiserWeights();
+            for (int x = 0; x < dw; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    float sum = 0.0f;
+                    for (int t = 0; t < 6; ++t) {
+                        int sx = std::min(std::max(2 * x - 2 + t, 0), sw - 1);
+                        sum += w[t] * in[sx * channels + c];
+                    }
+                    out[x * channels + c] = sum;
+                }
+            }
+            return;
+        }
+        for (int x = 0; x < dw; ++x) {
+            int x0 = std::min(x * 2, sw - 1), x1 = std::min(x * 2 + 1, sw - 1);
+            for (int c = 0; c < channels; ++c)
+                out[x * channels + c] = (in[x0 * channels + c] + in[x1 * channels + c]) * 0.5f;
+        }
+    }
+
+    const float* filtered(int sourceRow) const {
+        return &window[(size_t)(sourceRow - windowFirst) * dw * channels];
+    }
+
+    // takes the next `rows` source rows; returns how many rows of this level are now
+    // complete, written to `out` (starting at the old nextRow)
+    int Feed(const float* in, int rows, std::vector<float>& out) {
+        const size_t inLen = (size_t)sw * channels, rowLen = (size_t)dw * channels;
+
+        int keepFrom = std::min(firstSource(nextRow), windowFirst + windowRows);
+        if (keepFrom > windowFirst) {
+            window.erase(window.begin(), window.begin() + (keepFrom - windowFirst) * rowLen);
+            windowRows -= keepFrom - windowFirst;
+            windowFirst = keepFrom;
+        }
+        window.resize((windowRows + rows) * rowLen);
+        float* appended = &window[windowRows * rowLen];
+        ParallelFor((size_t)rows, [&](size_t y) { filterRow(in + y * inLen, appended + y * rowLen); }, 4);
+        windowRows += rows;
+
+        int first = nextRow;
+        while (nextRow < dh && lastSource(nextRow) < windowFirst + windowRows)
+            ++nextRow;
+        int produced = nextRow - first;
+        out.assign(produced * rowLen, 0.0f);
+        ParallelFor((size_t)produced, [&](size_t i) {
+            int y = first + (int)i;
+            float* row = &out[i * rowLen];
+            if (!kaiser) {
+                AverageRows(filtered(std::min(2 * y, sh - 1)), filtered(std::min(2 * y + 1, sh - 1)), row, rowLen);
+                return;
+            }
+            const float* w = KaiserWeights();
+            for (int t = 0; t < 6; ++t) {
+                const float* src = filtered(std::min(std::max(2 * y - 2 + t, 0), sh - 1));
+                const float wt = w[t];
+                size_t k = 0;
+#if defined(__SSE2__)
+                const __m128 wv = _mm_set1_ps(wt);
+                for (; k + 4 <= rowLen; k += 4)
+                    _mm_storeu_ps(row + k, _mm_add_ps(_mm_loadu_ps(row + k), _mm_mul_ps(wv, _mm_loadu_ps(src + k))));
+#endif
+                for (; k < rowLen; ++k)
+                    row[k] += wt * src[k];
+            }
+        }, 4);
+        return produced;
+    }
+};
+
+} // namespace mip_detail
+
+// Builds the full chain down to 1x1 over `base`, the full-resolution level. All levels are
+// produced in one pass over the base, STRIP_ROWS rows at a time, each strip cascading down
+// the chain as far as it completes rows. Besides the 8-bit levels themselves the working
+// memory is a few float rows per level, not a float copy of the image.
+// Levels finer than firstKept (the base included) are passed through but not kept: they stay
+// in the chain with their sizes and no pixels, for restoring a texture's dropped levels.
+inline MipChain GenerateMipChain(MipLevel base, int channels, bool srgb, MipFilter filter = MipFilter::Box,
+                                 size_t firstKept = 0) {
+    MipChain chain;
+    chain.channels = channels;
+    chain.srgb = srgb;
+    const int width = base.width, height = base.height;
+    chain.levels.push_back(std::move(base));
+
+    std::vector<mip_detail::LevelStream> streams;
+    int w = width, h = height;
+    while (w > 1 || h > 1) {
+        mip_detail::LevelStream stream;
+        stream.sw = w;
+        stream.sh = h;
+        stream.dw = std::max(1, w / 2);
+        stream.dh = std::max(1, h / 2);
+        stream.channels = channels;
+        stream.kaiser = filter == MipFilter::Kaiser && w >= 6 && h >= 6;
+        streams.push_back(std::move(stream));
+
+        MipLevel level;
+        level.width = streams.back().dw;
+        level.height = streams.back().dh;
+        if (chain.levels.size() >= firstKept)
+            level.pixels.resize((size_t)level.width * level.height * channels);
+        chain.levels.push_back(std::move(level));
+        w = streams.back().dw;
+        h = streams.back().dh;
+    }
+
+    std::vector<float> strip, next;
+    for (int y = 0; y < height; y += mip_detail::STRIP_ROWS) {
+        int rows = std::min(mip_detail::STRIP_ROWS, height - y);
+        mip_detail::DecodeRows(chain.levels[0], channels, srgb, y, rows, strip);
+        for (size_t s = 0; s < streams.size() && rows > 0; ++s) {
+            int first = streams[s].nextRow;
+            rows = streams[s].Feed(strip.data(), rows, next);
+            if (s + 1 >= firstKept)
+                mip_detail::EncodeRows(next.data(), first, rows, channels, srgb, chain.levels[s + 1]);
+            strip.swap(next);
+        }
+    }
+    if (firstKept > 0)
+        std::vector<unsigned char>().swap(chain.levels[0].pixels);
+    return chain;
+}
+
+// the same from tightly packed 8-bit pixels, which are copied into the base level
+inline MipChain GenerateMipChain(const unsigned char* pixels, int width, int height, int channels,
+                                 bool srgb, MipFilter filter = MipFilter::Box) {
+    MipLevel base;
+    base.width = width;
+    base.height = height;
+    base.pixels.assign(pixels, pixels + (size_t)width * height * channels);
+    return GenerateMipChain(std::move(base), channels, srgb, filter);
+}
+
+struct MipSource {
+    const unsigned char* pixels;
+    int width, height, channels;
+    bool srgb;
+};
+
+// Generates the chains of several textures at once, one texture per worker.
+inline std::vector<MipChain> GenerateMipChains(const std::vector<MipSource>& sources,
+                                               MipFilter filter = MipFilter::Box) {
+    std::vector<MipChain> chains(sources.size());
+    ParallelFor(sources.size(), [&](size_t i) {
+        const MipSource& s = sources[i];
+        chains[i] = GenerateMipChain(s.pixels, s.width, s.height, s.channels, s.srgb, filter);
+    });
+    return chains;
+}
+
+#endif //SOLAR_SYSTEM_MIPMAP_H
@@ -5,12 +5,23 @@
 #include <string>
 #include "shader.h"
 #include "mesh.h"
+#include "geometry_registry.h"
 #include "Error.h"
+#include "render_stats.h"
+#include "texture_cache.h"
+#include "import_stats.h"
+#include "alloc_stats.h"
+#include "model_import.h"
+#include "cooked_model.h"
+#include "asset_paths.h"
+#include "load_report.h"
+#include "parallel.h"
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
 #include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
 
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false);
 
@@ -20,175 +31,351 @@ public:
     std::vector<Mesh> meshes;
     std::string directory;
     bool gammaCorrection;
+    MeshResidency residency;
+
+    // bounding sphere in model space
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+
+    ImportStats importStats;
+
+    size_t currentLod = 0;
+    // largest on-screen geometric error (pixels) a LOD may have to be picked
+    static constexpr float LOD_PIXEL_ERROR = 1.0f;
+    // a coarser LOD is only taken once its error drops this far below the limit, so bodies
+    // hovering around a threshold don't flip between levels every frame
+    static constexpr float LOD_HYSTERESIS = 0.75f;
+
+    // geometry only lives on the GPU by default; see MeshResidency
+    Model(std::string const &path, bool gamma = false, MeshResidency residency = MeshResidency::GpuOnly)
+            : gammaCorrection(gamma), residency(residency) {
+        ImportedModel imported;
+        if (!Import(path, imported, importStats)) {
+            if (UseCookedAssets())
+                ASSERT(false, "Missing or stale cooked model, run solar_cook!");
+            else
+                ASSERT(false, "Failed to load a model!");
+            return;
+        }
+        build(path, imported);
+    }
 
-    Model(std::string const &path, bool gamma = false) : gammaCorrection(gamma) {
-        loadModel(path);
+    // builds the model from data Import already produced, e.g. on a loader thread
+    Model(std::string const &path, ImportedModel &imported, const ImportStats &stats, bool gamma = false,
+          MeshResidency residency = MeshResidency::GpuOnly)
+            : gammaCorrection(gamma), residency(residency), importStats(stats) {
+        build(path, imported);
     }
 
-    void Draw(Shader &shader) {
-        for (Mesh &mesh : meshes) {
-            mesh.Draw(shader);
+    // every image the materials reference, with whether it holds sRGB colour
+    static std::vector<std::pair<std::string, bool>> TextureRequests(const ImportedModel &imported) {
+        std::vector<std::pair<std::string, bool>> requests;
+        for (const ImportedMesh &mesh : imported.meshes) {
+            for (const TextureRef &ref : mesh.textures)
+                requests.emplace_back(imported.directory + '/' + ref.path, ref.type == "texture_diffuse");
         }
+        return requests;
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
-        }
+    // a body drawn with shared geometry (see SharedSphereMesh) and its own textures, with
+    // paths relative to directory
+    Model(const Mesh &shared, const std::string &directory, const std::vector<TextureRef> &textureRefs,
+          bool gamma = false)
+            : directory(directory), gammaCorrection(gamma), residency(MeshResidency::GpuOnly) {
+        // the shared geometry is round, so half its widest extent is the bounding radius
+        glm::vec3 extent = shared.boundsMax - shared.boundsMin;
+        boundsCenter = (shared.boundsMin + shared.boundsMax) * 0.5f;
+        boundsRadius = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+        std::vector<Texture> textures;
+        for (const TextureRef &ref : textureRefs)
+            textures.push_back(loadTexture(ref));
+        meshes.emplace_back(shared, std::move(textures));
+        importStats.meshes = 1;
     }
 
-private:
-    void loadModel(std::string path) {
-        Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate |
-                                                       aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
-                                                       aiProcess_CalcTangentSpace);
-
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-            ASSERT(false, "Failed to load a model!");
-            return;
+    // the part of loading that doesn't need GL: the cooked .smesh in cooked mode, Assimp
+    // otherwise. Safe to call from any thread.
+    static bool Import(const std::string &path, ImportedModel &imported, ImportStats &stats) {
+        if (!UseCookedAssets()) {
+            if (!ImportModel(path, imported, stats))
+                return false;
+            hashGeometry(imported);
+            reportImport(path, stats, LoadStage::Parse);
+            return true;
         }
-        this->directory = path.substr(0, path.find_last_of('/'));
-        processNode(scene->mRootNode, scene);
+
+        auto start = std::chrono::steady_clock::now();
+        // release builds never run Assimp: meshes and LODs come prebuilt from solar_cook
+        std::string cooked = CookedMeshPath(path);
+        if (!ReadCookedModel(cooked, imported))
+            return false;
+        struct stat file;
+        stats.fileBytes = stat(cooked.c_str(), &file) == 0 ? (size_t)file.st_size : 0;
+        stats.meshes = imported.meshes.size();
+        hashGeometry(imported);
+        stats.readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        reportImport(path, stats, LoadStage::Read);
+        return true;
     }
 
-    void processNode(aiNode *node, const aiScene *scene) {
-        for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
-            aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+    // textures are shared through the TextureCache, so a Model owns references, not copies
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    ~Model() {
+        for (auto& entry : loaded_textures_map) {
+            TextureCache::Instance().Release(entry.second.id);
         }
+    }
 
-        for (unsigned int i = 0; i < node->mNumChildren; ++i) {
-            processNode(node->mChildren[i], scene);
+    // gives the textures back to the cache and draws without any, for models whose surface
+    // has been copied elsewhere (see SurfaceAtlas)
+    void ReleaseTextures() {
+        for (auto& entry : loaded_textures_map) {
+            TextureCache::Instance().Release(entry.second.id);
+        }
+        loaded_textures_map.clear();
+        for (Mesh& mesh : meshes) {
+            mesh.textures.clear();
+            mesh.ResolveBindings();
         }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene) {
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-        std::vector<Texture> textures;
+    // Meshes that share a material are submitted together with one glMultiDrawElementsIndirect;
+    // the only per-batch work left on the CPU is binding the material's textures. Programs that
+    // read InstanceData get the one at baseInstance.
+    void Draw(Shader &shader, GLuint baseInstance = 0) {
+        GeometryPool& pool = GeometryPool::Instance();
+        pool.Bind();
+
+        for (size_t first = 0; first < meshes.size();) {
+            size_t last = first + 1;
+            while (last < meshes.size() && meshes[last].SharesTexturesWith(meshes[first]))
+                ++last;
+
+            meshes[first].BindTextures();
+            drawCommands.clear();
+            RenderStats& stats = FrameStats();
+            for (size_t i = first; i < last; ++i) {
+                const GeometryRange& range = meshes[i].Lod(currentLod).range;
+                drawCommands.push_back(pool.Command(range, 1, baseInstance));
+                stats.trianglesDrawn += range.indexCount / 3;
+                stats.trianglesFullDetail += meshes[i].range.indexCount / 3;
+            }
+            pool.MultiDraw(drawCommands);
+            stats.drawCalls++;
 
-        for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
-            Vertex vertex;
-            vertex.Position.x = mesh->mVertices[i].x;
-            vertex.Position.y = mesh->mVertices[i].y;
-            vertex.Position.z = mesh->mVertices[i].z;
+            first = last;
+        }
 
-            if (mesh->HasNormals()) {
-                vertex.Normal.x = mesh->mNormals[i].x;
-                vertex.Normal.y = mesh->mNormals[i].y;
-                vertex.Normal.z = mesh->mNormals[i].z;
-            }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
 
-            if (mesh->mTextureCoords[0]) {
-                vertex.TexCoords.x = mesh->mTextureCoords[0][i].x;
-                vertex.TexCoords.y = mesh->mTextureCoords[0][i].y;
+    size_t CurrentLod() const { return currentLod; }
 
-                vertex.Tangent.x = mesh->mTangents[i].x;
-                vertex.Tangent.y = mesh->mTangents[i].y;
-                vertex.Tangent.z = mesh->mTangents[i].z;
+    size_t LodCount() const {
+        size_t count = 1;
+        for (const Mesh& mesh : meshes)
+            count = std::max(count, mesh.lods.size());
+        return count;
+    }
 
-                vertex.Bitangent.x = mesh->mBitangents[i].x;
-                vertex.Bitangent.y = mesh->mBitangents[i].y;
-                vertex.Bitangent.z = mesh->mBitangents[i].z;
+    // worst geometric error of any mesh at the given level, in model units
+    float LodError(size_t level) const {
+        float error = 0.0f;
+        for (const Mesh& mesh : meshes)
+            error = std::max(error, mesh.Lod(level).error);
+        return error;
+    }
 
-            } else {
-                vertex.TexCoords = glm::vec2(0.0);
+    // picks the coarsest LOD whose error stays under LOD_PIXEL_ERROR once projected;
+    // pixelsPerUnit is how many screen pixels one model-space unit covers at the body's distance
+    void SelectLod(float pixelsPerUnit) {
+        size_t wanted = 0;
+        for (size_t level = LodCount(); level-- > 0;) {
+            if (LodError(level) * pixelsPerUnit <= LOD_PIXEL_ERROR) {
+                wanted = level;
+                break;
             }
-            vertices.push_back(vertex);
         }
+        if (wanted > currentLod) {
+            // only go coarser if we are clearly past the threshold
+            while (wanted > currentLod && LodError(wanted) * pixelsPerUnit > LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+                --wanted;
+        }
+        currentLod = wanted;
+    }
 
-        for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
-            aiFace face = mesh->mFaces[i];
-
-            for (unsigned int j = 0; j < face.mNumIndices; ++j) {
-                indices.push_back(face.mIndices[j]);
+    // asks the texture cache for the mip detail the model needs this frame; surface maps
+    // wrap around the body, so their width covers about pi times its diameter
+    void RequestTextures(float pixelsPerUnit) {
+        float texels = 3.14159265f * 2.0f * boundsRadius * pixelsPerUnit;
+        for (const Mesh& mesh : meshes) {
+            for (const Texture& texture : mesh.textures) {
+                if (texture.id)
+                    TextureCache::Instance().Request(texture.id, texels);
             }
         }
+    }
 
+    // keeps ImportTotals() up to date with what the meshes hold now
+    void SetResidency(MeshResidency mode) {
+        ImportStats& totals = ImportTotals();
+        totals.cpuResidentBytes -= importStats.cpuResidentBytes;
+        totals.rssReleasedBytes -= importStats.rssReleasedBytes;
+        importStats.rssReleasedBytes += applyResidency(mode);
+        importStats.cpuResidentBytes = CpuBytes();
+        totals.cpuResidentBytes += importStats.cpuResidentBytes;
+        totals.rssReleasedBytes += importStats.rssReleasedBytes;
+    }
 
-        aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-
-        loadTextureMaterial(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
-
-        loadTextureMaterial(material, aiTextureType_SPECULAR, "texture_specular",
-                            textures);
+    size_t CpuBytes() const {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.CpuBytes();
+        return bytes;
+    }
 
-        loadTextureMaterial(material, aiTextureType_NORMALS, "texture_normal", textures);
+    size_t GpuBytes() const {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.GpuBytes();
+        return bytes;
+    }
 
-        loadTextureMaterial(material, aiTextureType_HEIGHT, "texture_height",
-                            textures);
+    void SetShaderTextureNamePrefix(std::string prefix) {
+        for (Mesh& mesh: meshes) {
+            mesh.glslIdentifierPrefix = prefix;
+        }
+    }
 
+private:
+    std::vector<DrawElementsIndirectCommand> drawCommands; // reused between frames
 
-        return Mesh(vertices, indices, textures);
+    static void hashGeometry(ImportedModel &imported) {
+        ParallelFor(imported.meshes.size(), [&](size_t i) {
+            imported.meshes[i].geometryHash = HashGeometry(imported.meshes[i]);
+        });
     }
 
-    void loadTextureMaterial(aiMaterial *mat, aiTextureType type, std::string typeName,
-                             std::vector<Texture> &textures) {
-
-        for (unsigned int i = 0; i < mat->GetTextureCount(type); ++i) {
-            aiString str;
-            mat->GetTexture(type, i, &str);
+    // pool bytes a mesh takes: its vertices and every LOD's 16-bit indices
+    static size_t poolBytes(const ImportedMesh &mesh) {
+        size_t indices = mesh.indices.size();
+        for (const LodLevel &lod : mesh.lods)
+            indices += lod.indices.size();
+        return mesh.vertices.size() * sizeof(Vertex) + indices * sizeof(uint16_t);
+    }
 
-            bool skip = false;
+    static void reportImport(const std::string &path, const ImportStats &stats, LoadStage readStage) {
+        LoadReport &report = LoadReport::Instance();
+        report.AddBytes(path, "model", stats.fileBytes);
+        report.Add(path, "model", readStage, stats.readSeconds);
+        report.Add(path, "model", LoadStage::Convert, stats.convertSeconds);
+        report.Add(path, "model", LoadStage::Tangents, stats.tangentSeconds);
+        report.Add(path, "model", LoadStage::Lod, stats.lodSeconds);
+    }
 
-            auto it = loaded_textures_map.find(str.C_Str());
-            if(it != loaded_textures_map.end()) {
-                skip = true;
-                textures.push_back(it->second);
-            }
+    // switches every mesh to `mode` and returns how far the process's RSS went down meanwhile;
+    // it's measured, so whatever other threads allocate at the same time shows up in it too
+    size_t applyResidency(MeshResidency mode) {
+        size_t before = ResidentBytes();
+        residency = mode;
+        for (Mesh &mesh : meshes)
+            mesh.SetResidency(mode);
+        size_t after = ResidentBytes();
+        return before > after ? before - after : 0;
+    }
 
-            if (!skip) {
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                loaded_textures_map[str.C_Str()] = texture;
+    void build(const std::string &path, ImportedModel &imported) {
+        this->directory = imported.directory;
+        boundsCenter = imported.boundsCenter;
+        boundsRadius = imported.boundsRadius;
+        prefetchTextures(imported);
+
+        size_t geometryBytes = 0;
+        // texture uploads are reported under the textures themselves
+        std::chrono::steady_clock::duration uploadTime{};
+        // the meshes' own allocations, texture loads left out
+        AllocationSnapshot buildAllocated;
+        meshes.reserve(imported.meshes.size());
+        for (ImportedMesh &source : imported.meshes) {
+            geometryBytes += source.vertices.size() * sizeof(Vertex) + source.indices.size() * sizeof(unsigned int);
+            std::vector<Texture> textures;
+            textures.reserve(source.textures.size());
+            for (const TextureRef &ref : source.textures)
+                textures.push_back(loadTexture(ref));
+            auto uploadStart = std::chrono::steady_clock::now();
+            AllocationSnapshot buildStart = AllocationSnapshot::ThisThread();
+            GeometryRegistry &registry = GeometryRegistry::Instance();
+            if (const Mesh *shared = registry.Find(source)) {
+                // the same geometry is in the pool already, maybe from another file
+                meshes.emplace_back(*shared, std::move(textures));
+                importStats.sharedMeshes++;
+                importStats.sharedBytes += poolBytes(source);
+            } else {
+                meshes.emplace_back(std::move(source.vertices), std::move(source.indices), std::move(textures));
+                // handing the levels to the geometry pool stays on this (the GL) thread
+                for (const LodLevel &lod : source.lods)
+                    meshes.back().AddLod(lod.indices, lod.error);
+                registry.Add(source, meshes.back());
             }
+            AllocationSnapshot built = AllocationSnapshot::ThisThread().Since(buildStart);
+            buildAllocated.count += built.count;
+            buildAllocated.bytes += built.bytes;
+            uploadTime += std::chrono::steady_clock::now() - uploadStart;
         }
+        LoadReport::Instance().Add(path, "model", LoadStage::Upload,
+                                   std::chrono::duration<double>(uploadTime).count());
+
+        // the CPU copies go once every mesh is in the pool
+        importStats.rssReleasedBytes = applyResidency(residency);
+        importStats.geometryBytes = geometryBytes;
+        importStats.buildAllocations = buildAllocated.count;
+        importStats.buildAllocatedBytes = buildAllocated.bytes;
+        importStats.cpuResidentBytes = CpuBytes();
+        importStats.gpuResidentBytes = GpuBytes();
+        ImportTotals() += importStats;
+
+        std::cout << "Imported " << path << ": " << importStats.fileBytes / 1024 << " KB at "
+                  << importStats.ThroughputMBps() << " MB/s, " << importStats.meshes << " meshes, "
+                  << importStats.allocations << " allocations while converting, "
+                  << importStats.buildAllocations << " while building meshes, LODs in "
+                  << importStats.lodSeconds * 1000.0 << " ms, resident " << importStats.cpuResidentBytes / 1024
+                  << " KB CPU / " << importStats.gpuResidentBytes / 1024 << " KB GPU (RSS down "
+                  << importStats.rssReleasedBytes / 1024 << " KB on the release), "
+                  << importStats.sharedMeshes << " meshes (" << importStats.sharedBytes / 1024
+                  << " KB) shared with earlier models" << std::endl;
+    }
 
+    // decodes every texture the materials reference (and builds their mips) in parallel
+    // before the meshes ask for them one by one
+    void prefetchTextures(const ImportedModel &imported) {
+        TextureCache::Instance().Prefetch(TextureRequests(imported));
+    }
+
+    Texture loadTexture(const TextureRef &ref) {
+        auto it = loaded_textures_map.find(ref.path);
+        if (it != loaded_textures_map.end())
+            return it->second;
+
+        Texture texture;
+        // only diffuse maps hold sRGB colour; the others are linear data
+        texture.id = TextureFromFile(ref.path.c_str(), this->directory, ref.type == "texture_diffuse");
+        texture.type = ref.type;
+        texture.path = ref.path;
+        loaded_textures_map[ref.path] = texture;
+        return texture;
     }
 };
 
+// textures come from the process-wide cache; the caller owns one reference to the result
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma)
 {
     std::string filename = std::string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureCache::Instance().Acquire(filename, gamma);
 }
 
 #endif //SOLAR_SYSTEM_MODEL_H
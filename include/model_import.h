@@ -0,0 +1,207 @@
+#ifndef SOLAR_SYSTEM_MODEL_IMPORT_H
+#define SOLAR_SYSTEM_MODEL_IMPORT_H
+
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
+#include "vertex.h"
+#include "index_narrowing.h"
+#include "mesh_simplify.h"
+#include "alloc_stats.h"
+#include "import_stats.h"
+#include "parallel.h"
+#include "content_hash.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// Everything a Model needs from a model file, without touching GL: the viewer turns it into
+// Meshes and textures, solar_cook writes it to a .smesh so release builds skip Assimp entirely.
+
+struct TextureRef {
+    std::string type; // "texture_diffuse", "texture_specular", ...
+    std::string path; // relative to the model's directory, as the material names it
+};
+
+struct ImportedMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<TextureRef> textures;
+    std::vector<LodLevel> lods; // coarser levels over the same vertices
+    uint64_t geometryHash = 0;  // HashGeometry, once Model::Import has run
+};
+
+// identifies a mesh's vertices, indices and LODs (not its textures), so identical geometry
+// in different files is stored once
+inline uint64_t HashGeometry(const ImportedMesh &mesh) {
+    uint64_t hash = HashBytes(reinterpret_cast<const unsigned char *>(mesh.vertices.data()),
+                              mesh.vertices.size() * sizeof(Vertex));
+    hash = HashBytes(reinterpret_cast<const unsigned char *>(mesh.indices.data()),
+                     mesh.indices.size() * sizeof(unsigned int), hash);
+    for (const LodLevel &lod : mesh.lods) {
+        hash = HashBytes(reinterpret_cast<const unsigned char *>(lod.indices.data()),
+                         lod.indices.size() * sizeof(unsigned int), hash);
+        hash = HashBytes(reinterpret_cast<const unsigned char *>(&lod.error), sizeof(lod.error), hash);
+    }
+    return hash;
+}
+
+struct ImportedModel {
+    std::string directory;
+    std::vector<ImportedMesh> meshes;
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+};
+
+namespace import_detail {
+
+inline void AppendTextureRefs(aiMaterial *material, aiTextureType type, const char *typeName,
+                              std::vector<TextureRef> &textures) {
+    for (unsigned int i = 0; i < material->GetTextureCount(type); ++i) {
+        aiString str;
+        material->GetTexture(type, i, &str);
+        textures.push_back(TextureRef{typeName, str.C_Str()});
+    }
+}
+
+// one pass over the Assimp arrays into buffers sized up front, which are then moved into
+// the output; the only allocations are the three vectors themselves
+inline void ProcessMesh(aiMesh *mesh, const aiScene *scene, std::vector<ImportedMesh> &meshes) {
+    std::vector<Vertex> vertices(mesh->mNumVertices);
+    std::vector<unsigned int> indices;
+    std::vector<TextureRef> textures;
+
+    const bool hasNormals = mesh->HasNormals();
+    const aiVector3D *uvs = mesh->mTextureCoords[0];
+    const bool hasTangents = uvs && mesh->mTangents && mesh->mBitangents;
+    for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+        Vertex &vertex = vertices[i];
+        const aiVector3D &p = mesh->mVertices[i];
+        vertex.Position = glm::vec3(p.x, p.y, p.z);
+
+        if (hasNormals) {
+            const aiVector3D &n = mesh->mNormals[i];
+            vertex.Normal = glm::vec3(n.x, n.y, n.z);
+        }
+
+        if (uvs) {
+            vertex.TexCoords = glm::vec2(uvs[i].x, uvs[i].y);
+        }
+        if (hasTangents) {
+            const aiVector3D &t = mesh->mTangents[i];
+            const aiVector3D &b = mesh->mBitangents[i];
+            vertex.Tangent = glm::vec3(t.x, t.y, t.z);
+            vertex.Bitangent = glm::vec3(b.x, b.y, b.z);
+        }
+    }
+
+    // after aiProcess_Triangulate nearly every face is a triangle
+    indices.reserve((size_t)mesh->mNumFaces * 3);
+    for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+        const aiFace &face = mesh->mFaces[i];
+        indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+    }
+
+    aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+    textures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) +
+                     material->GetTextureCount(aiTextureType_SPECULAR) +
+                     material->GetTextureCount(aiTextureType_NORMALS) +
+                     material->GetTextureCount(aiTextureType_HEIGHT));
+    AppendTextureRefs(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
+    AppendTextureRefs(material, aiTextureType_SPECULAR, "texture_specular", textures);
+    AppendTextureRefs(material, aiTextureType_NORMALS, "texture_normal", textures);
+    AppendTextureRefs(material, aiTextureType_HEIGHT, "texture_height", textures);
+
+    // meshes too big for 16-bit indices are split into submeshes that share the material
+    if (vertices.size() <= MAX_SHORT_INDEXED_VERTICES) {
+        meshes.push_back(ImportedMesh{std::move(vertices), std::move(indices), std::move(textures), {}});
+        return;
+    }
+    for (IndexedChunk<Vertex> &chunk : SplitForIndexLimit(vertices, indices)) {
+        meshes.push_back(ImportedMesh{std::move(chunk.vertices), std::move(chunk.indices), textures, {}});
+    }
+}
+
+inline void ProcessNode(aiNode *node, const aiScene *scene, std::vector<ImportedMesh> &meshes) {
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
+        ProcessMesh(scene->mMeshes[node->mMeshes[i]], scene, meshes);
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; ++i) {
+        ProcessNode(node->mChildren[i], scene, meshes);
+    }
+}
+
+} // namespace import_detail
+
+inline void ComputeBounds(ImportedModel &model) {
+    if (model.meshes.empty())
+        return;
+    glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+    for (const ImportedMesh &mesh : model.meshes) {
+        for (const Vertex &v : mesh.vertices) {
+            lo = glm::min(lo, v.Position);
+            hi = glm::max(hi, v.Position);
+        }
+    }
+    model.boundsCenter = (lo + hi) * 0.5f;
+    model.boundsRadius = 0.0f;
+    for (const ImportedMesh &mesh : model.meshes) {
+        for (const Vertex &v : mesh.vertices)
+            model.boundsRadius = std::max(model.boundsRadius, glm::length(v.Position - model.boundsCenter));
+    }
+}
+
+// Reads the file with Assimp, converts it and builds every mesh's LOD chain (in parallel).
+// Fills the read/convert/LOD timings and allocation counts of stats; false if Assimp fails.
+inline bool ImportModel(const std::string &path, ImportedModel &model, ImportStats &stats) {
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double>(to - from).count();
+    };
+
+    auto readStart = Clock::now();
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate |
+                                                   aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        return false;
+    auto readEnd = Clock::now();
+    // as a separate step so the load report can tell it apart from parsing
+    scene = importer.ApplyPostProcessing(aiProcess_CalcTangentSpace);
+    if (!scene)
+        return false;
+    auto tangentEnd = Clock::now();
+    model.directory = path.substr(0, path.find_last_of('/'));
+
+    auto convertStart = Clock::now();
+    // this thread only: the conversion itself, not what's decoded or uploaded elsewhere
+    AllocationSnapshot before = AllocationSnapshot::ThisThread();
+    model.meshes.clear();
+    model.meshes.reserve(scene->mNumMeshes);
+    import_detail::ProcessNode(scene->mRootNode, scene, model.meshes);
+    AllocationSnapshot allocated = AllocationSnapshot::ThisThread().Since(before);
+    auto convertEnd = Clock::now();
+
+    ParallelFor(model.meshes.size(), [&](size_t i) {
+        model.meshes[i].lods = GenerateLodChain(model.meshes[i].vertices, model.meshes[i].indices);
+    });
+    ComputeBounds(model);
+    auto lodEnd = Clock::now();
+
+    struct stat file;
+    stats.fileBytes = stat(path.c_str(), &file) == 0 ? (size_t)file.st_size : 0;
+    stats.meshes = model.meshes.size();
+    stats.allocations = allocated.count;
+    stats.allocatedBytes = allocated.bytes;
+    stats.readSeconds = seconds(readStart, readEnd);
+    stats.tangentSeconds = seconds(readEnd, tangentEnd);
+    stats.convertSeconds = seconds(convertStart, convertEnd);
+    stats.lodSeconds = seconds(convertEnd, lodEnd);
+    return true;
+}
+
+#endif //SOLAR_SYSTEM_MODEL_IMPORT_H
@@ -0,0 +1,162 @@
+#ifndef SOLAR_SYSTEM_PARALLEL_H
+#define SOLAR_SYSTEM_PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <exception>
+
+inline unsigned WorkerCount() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 4;
+}
+
+// set on worker threads so nested ParallelFor calls run inline instead of spawning more threads
+inline bool& InsideParallelFor() {
+    static thread_local bool inside = false;
+    return inside;
+}
+
+namespace parallel_detail {
+
+// one ParallelFor call: items [0, count) handed out `grain` at a time
+struct Job {
+    void (*run)(void* fn, size_t begin, size_t end);
+    void* fn;
+    size_t count;
+    size_t grain;
+    std::atomic<size_t> next{0};
+    unsigned helpers = 0;     // pool workers inside the job, guarded by the pool's mutex
+    std::exception_ptr error; // the first item that threw, guarded by the pool's mutex
+};
+
+// WorkerCount() - 1 threads started on first use and kept for the life of the process; the
+// thread calling ParallelFor is the last worker. Jobs from several threads can be in the
+// queue at once, the workers help with the oldest one that still has items left. An item that
+// throws ends its job early, on whichever thread it ran, and Run rethrows it to the caller
+// once the job is out of the queue and no worker is left inside it.
+class WorkerPool {
+public:
+    // never destroyed: the workers wait for jobs until the process exits
+    static WorkerPool& Instance() {
+        static WorkerPool* pool = new WorkerPool(WorkerCount() - 1);
+        return *pool;
+    }
+
+    void Run(Job& job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(&job);
+        }
+        wake.notify_all();
+        work(job);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = std::find(jobs.begin(), jobs.end(), &job);
+        if (it != jobs.end())
+            jobs.erase(it);
+        finished.wait(lock, [&]() { return job.helpers == 0; });
+        if (job.error)
+            std::rethrow_exception(job.error);
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    std::deque<Job*> jobs;
+    std::vector<std::thread> threads;
+
+    explicit WorkerPool(unsigned count) {
+        for (unsigned t = 0; t < count; ++t) {
+            threads.emplace_back([this]() { workerLoop(); });
+            threads.back().detach();
+        }
+    }
+
+    // runs the job's items until none are left; an exception hands out the rest as done and
+    // is kept in the job
+    void work(Job& job) {
+        try {
+            for (;;) {
+                size_t begin = job.next.fetch_add(job.grain);
+                if (begin >= job.count)
+                    break;
+                job.run(job.fn, begin, std::min(begin + job.grain, job.count));
+            }
+        } catch (...) {
+            job.next.store(job.count);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!job.error)
+                job.error = std::current_exception();
+        }
+    }
+
+    void workerLoop() {
+        InsideParallelFor() = true;
+        for (;;) {
+            Job* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return !jobs.empty(); });
+                job = jobs.front();
+                if (job->next.load() >= job->count) {
+                    // handed out completely; its caller only waits for the helpers now
+                    jobs.pop_front();
+                    continue;
+                }
+                ++job->helpers;
+            }
+            work(*job);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--job->helpers == 0)
+                finished.notify_all();
+        }
+    }
+};
+
+} // namespace parallel_detail
+
+// Runs fn(i) for every i in [0, count) on up to WorkerCount() threads of a pool that lives as
+// long as the process, so calls don't pay for starting threads. Work is handed out in chunks
+// through an atomic counter, so uneven items (big and small textures) balance out. The
+// calling thread takes part; a job of a single chunk runs inline without touching the pool,
+// anything bigger wakes the workers. If fn throws, the rest of the items are skipped and the
+// first exception is rethrown here.
+template<typename F>
+void ParallelFor(size_t count, F fn, size_t grain = 1) {
+    if (count == 0)
+        return;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    if (WorkerCount() <= 1 || chunks <= 1 || InsideParallelFor()) {
+        for (size_t i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    parallel_detail::Job job;
+    job.run = [](void* f, size_t begin, size_t end) {
+        F& body = *static_cast<F*>(f);
+        for (size_t i = begin; i < end; ++i)
+            body(i);
+    };
+    job.fn = &fn;
+    job.count = count;
+    job.grain = grain;
+
+    bool wasInside = InsideParallelFor();
+    InsideParallelFor() = true;
+    try {
+        parallel_detail::WorkerPool::Instance().Run(job);
+    } catch (...) {
+        InsideParallelFor() = wasInside;
+        throw;
+    }
+    InsideParallelFor() = wasInside;
+}
+
+#endif //SOLAR_SYSTEM_PARALLEL_H
@@ -0,0 +1,163 @@
+#ifndef SOLAR_SYSTEM_RENDER_QUEUE_H
+#define SOLAR_SYSTEM_RENDER_QUEUE_H
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "glad/glad.h"
+#include "render_stats.h"
+
+// A frame's draws, submitted in any order and executed in the order of their sort keys.
+//
+// The key packs, from the most significant bits down, the pass, the program, the material
+// and the view depth:
+//
+//   | pass (4) | program (12) | material (24) | depth (24) |
+//
+// so passes run in RenderPass order, each pass switches programs as rarely as it can, draws
+// with the same textures follow each other, and what's left is drawn front to back, which
+// lets early-Z reject the hidden fragments. The keys are radix sorted every frame; packets
+// with equal keys keep their submission order.
+//
+// Each packet carries the GL state it needs. Execute only sets what differs from the
+// previous packet, starting from the frame's defaults (depth test GL_LESS, back faces
+// culled), and leaves those defaults behind.
+
+enum class RenderPass : uint8_t {
+    Opaque,
+    Sky,      // drawn behind everything, after the opaque pass has filled the depth buffer
+};
+
+struct RenderState {
+    GLuint program = 0;
+    bool cullFace = true;
+    GLenum depthFunc = GL_LESS;
+};
+
+struct DrawPacket {
+    uint64_t key;
+    RenderState state;
+    std::function<void()> draw;
+};
+
+class RenderQueue {
+public:
+    static const int PROGRAM_BITS = 12;
+    static const int MATERIAL_BITS = 24;
+    static const int DEPTH_BITS = 24;
+
+    // depth is the distance from the camera, clamped to farPlane
+    uint64_t Key(RenderPass pass, GLuint program, uint32_t material, float depth, float farPlane) {
+        const uint64_t depthMax = ((uint64_t)1 << DEPTH_BITS) - 1;
+        uint64_t quantized = (uint64_t)(std::min(std::max(depth / farPlane, 0.0f), 1.0f) * (float)depthMax);
+        uint64_t key = (uint64_t)pass;
+        key = (key << PROGRAM_BITS) | programKey(program);
+        key = (key << MATERIAL_BITS) | (material & (((uint64_t)1 << MATERIAL_BITS) - 1));
+        key = (key << DEPTH_BITS) | quantized;
+        return key;
+    }
+
+    void Submit(uint64_t key, const RenderState& state, std::function<void()> draw) {
+        DrawPacket packet;
+        packet.key = key;
+        packet.state = state;
+        packet.draw = std::move(draw);
+        packets.push_back(std::move(packet));
+    }
+
+    // draws everything submitted since the last Execute, in key order
+    void Execute() {
+        sort();
+        RenderStats& stats = FrameStats();
+        RenderState current;
+        bool programKnown = false;
+        for (const SortEntry& entry : order) {
+            const DrawPacket& packet = packets[entry.index];
+            const RenderState& state = packet.state;
+            if (!programKnown || state.program != current.program) {
+                glUseProgram(state.program);
+                programKnown = true;
+                stats.stateChanges++;
+            } else {
+                stats.stateChangesElided++;
+            }
+            if (state.cullFace != current.cullFace) {
+                if (state.cullFace)
+                    glEnable(GL_CULL_FACE);
+                else
+                    glDisable(GL_CULL_FACE);
+                stats.stateChanges++;
+            } else {
+                stats.stateChangesElided++;
+            }
+            if (state.depthFunc != current.depthFunc) {
+                glDepthFunc(state.depthFunc);
+                stats.stateChanges++;
+            } else {
+                stats.stateChangesElided++;
+            }
+            current = state;
+            packet.draw();
+        }
+
+        RenderState defaults;
+        if (!current.cullFace)
+            glEnable(GL_CULL_FACE);
+        if (current.depthFunc != defaults.depthFunc)
+            glDepthFunc(defaults.depthFunc);
+        packets.clear();
+    }
+
+    size_t Submitted() const { return packets.size(); }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> order, scratch;
+    std::unordered_map<GLuint, uint32_t> programs;
+
+    // programs are numbered in the order they're first seen, which keeps the key stable
+    // from frame to frame
+    uint32_t programKey(GLuint program) {
+        auto it = programs.find(program);
+        if (it != programs.end())
+            return it->second;
+        uint32_t key = std::min((uint32_t)programs.size(), ((uint32_t)1 << PROGRAM_BITS) - 1);
+        programs[program] = key;
+        return key;
+    }
+
+    // least significant byte first; a byte every key shares is skipped
+    void sort() {
+        order.resize(packets.size());
+        scratch.resize(packets.size());
+        for (size_t i = 0; i < packets.size(); ++i) {
+            order[i].key = packets[i].key;
+            order[i].index = (uint32_t)i;
+        }
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for (const SortEntry& entry : order)
+                counts[(entry.key >> shift) & 0xff]++;
+            if (order.empty() || counts[(order[0].key >> shift) & 0xff] == order.size())
+                continue;
+            size_t offsets[256];
+            size_t offset = 0;
+            for (int b = 0; b < 256; ++b) {
+                offsets[b] = offset;
+                offset += counts[b];
+            }
+            for (const SortEntry& entry : order)
+                scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+            order.swap(scratch);
+        }
+    }
+};
+
+#endif //SOLAR_SYSTEM_RENDER_QUEUE_H
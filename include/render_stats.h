@@ -0,0 +1,26 @@
+#ifndef SOLAR_SYSTEM_RENDER_STATS_H
+#define SOLAR_SYSTEM_RENDER_STATS_H
+
+#include <cstddef>
+
+// counters gathered while drawing a frame; reset at the start of every frame
+struct RenderStats {
+    size_t drawCalls = 0;
+    size_t trianglesDrawn = 0;
+    size_t trianglesFullDetail = 0; // what the same draws would cost without LODs
+    size_t uniformCalls = 0;        // glUniform* calls through Shader (the shared blocks aside)
+    size_t stateChanges = 0;        // program, culling and depth test changes made by RenderQueue
+    size_t stateChangesElided = 0;  // ... and the ones it skipped as redundant
+    size_t instancesBatched = 0;    // bodies drawn as instances of a shared draw (InstanceBatcher)
+
+    void Reset() {
+        *this = RenderStats();
+    }
+};
+
+inline RenderStats& FrameStats() {
+    static RenderStats stats;
+    return stats;
+}
+
+#endif //SOLAR_SYSTEM_RENDER_STATS_H
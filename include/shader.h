@@ -5,61 +5,96 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <common.h>
+#include "asset_paths.h"
+#include "shader_cache.h"
+#include "asset_pack.h"
+#include "load_report.h"
+#include "render_stats.h"
+#include "material_slots.h"
 
+// A uniform's location resolved once, for uniforms set every frame: setting it through the
+// handle skips the name lookup, and T pins the glUniform* call to the uniform's type.
+template<typename T>
+struct Uniform {
+    GLint location = -1;
+};
+
+// a program's source files and the uniforms its users set on it, for programs that are both
+// built and read ahead (AssetReadAhead) from one table
+struct ShaderSources {
+    const char* vertex;
+    const char* fragment;
+    std::vector<std::string> uniforms;
+};
+
+// Programs know their active uniforms from link time (program interface reflection), so
+// setting one by name is a hash lookup instead of a glGetUniformLocation round trip into the
+// driver. The names the caller is going to set are checked right after linking, so the ones
+// that aren't active uniforms (misspelled, or unused and optimized out) are reported at
+// startup; any other unknown name is reported on its first use. Either way it's reported once
+// per program and otherwise ignored, as GL ignores location -1. Material samplers are pointed
+// at their fixed units (material_slots.h) right there as well.
 class Shader {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // hash of the source code, which keys the program binary cached by solar_cook
+    uint64_t sourceHash = 0;
+    // constructor generates the shader on the fly; `expected` lists the uniforms the caller
+    // sets on it
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::vector<std::string>& expected = {}) {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
 
         vertexPath = vertexPathString.c_str();
         fragmentPath= fragmentPathString.c_str();
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr) {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e) {
+        const std::string binaryPath = CookedShaderPath(vertexPathString, fragmentPathString,
+                                                        geometryPath ? geometryPath : "");
+        // load times are reported under "<vertex>+<fragment>"
+        const std::string reportName = vertexPathString + "+" + fragmentPathString;
+        using Clock = std::chrono::steady_clock;
+        auto since = [](Clock::time_point start) {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        };
+        auto stageStart = Clock::now();
+        // 1. retrieve the vertex/fragment source code from filePath (or the mounted asset pack)
+        AssetView vShaderFile = OpenAsset(vertexPathString);
+        AssetView fShaderFile = OpenAsset(fragmentPathString);
+        AssetView gShaderFile;
+        if (geometryPath != nullptr)
+            gShaderFile = OpenAsset(geometryPath);
+        if (!vShaderFile.ok || !fShaderFile.ok || (geometryPath != nullptr && !gShaderFile.ok)) {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
         }
+        std::string vertexCode = vShaderFile.String();
+        std::string fragmentCode = fShaderFile.String();
+        std::string geometryCode = gShaderFile.String();
+        sourceHash = HashString(geometryCode, HashString(fragmentCode, HashString(vertexCode)));
+        LoadReport& report = LoadReport::Instance();
+        report.AddBytes(reportName, "shader", vertexCode.size() + fragmentCode.size() + geometryCode.size());
+        report.Add(reportName, "shader", LoadStage::Read, since(stageStart));
+        // cooked builds skip compiling when the driver accepts the saved binary
+        if (UseCookedAssets()) {
+            stageStart = Clock::now();
+            ID = LoadProgramBinary(binaryPath, sourceHash);
+            report.Add(reportName, "shader", LoadStage::Binary, since(stageStart));
+            if (ID != 0) {
+                reflectUniforms(reportName);
+                Expect(expected);
+                return;
+            }
+        }
+        stageStart = Clock::now();
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -83,14 +118,20 @@ public:
             glCompileShader(geometry);
             checkCompileErrors(geometry, "GEOMETRY");
         }
+        report.Add(reportName, "shader", LoadStage::Compile, since(stageStart));
+        stageStart = Clock::now();
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        reflectUniforms(reportName);
+        Expect(expected);
+        report.Add(reportName, "shader", LoadStage::Link, since(stageStart));
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -98,59 +139,161 @@ public:
             glDeleteShader(geometry);
 
     }
+    explicit Shader(const ShaderSources& sources)
+            : Shader(sources.vertex, sources.fragment, nullptr, sources.uniforms) {}
     // activate the shader
     // ------------------------------------------------------------------------
     void use() {
         glUseProgram(ID);
     }
+    // the uniform's location, or -1 (reported the first time) when the program has no such
+    // active uniform
+    GLint Location(const std::string &name) const {
+        auto it = uniforms.find(name);
+        if (it != uniforms.end())
+            return it->second;
+        if (missing.insert(name).second)
+            std::cout << "Shader " << programName << ": no active uniform '" << name << "'" << std::endl;
+        return -1;
+    }
+    // reports each of `names` the program has no active uniform for
+    void Expect(const std::vector<std::string> &names) const {
+        for (const std::string &name : names)
+            Location(name);
+    }
+    template<typename T>
+    Uniform<T> Resolve(const std::string &name) const {
+        Uniform<T> uniform;
+        uniform.location = Location(name);
+        return uniform;
+    }
+    size_t ActiveUniforms() const { return uniforms.size(); }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(counted(Location(name)), (int)value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(counted(Location(name)), value);
+    }
+    // ------------------------------------------------------------------------
+    void setIntArray(const std::string &name, const int* values, int count) const {
+        glUniform1iv(counted(Location(name)), count, values);
+    }
+    // ------------------------------------------------------------------------
+    void setIVec2(const std::string &name, int x, int y) const {
+        glUniform2i(counted(Location(name)), x, y);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(counted(Location(name)), value);
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(counted(Location(name)), 1, &value[0]);
     }
     void setVec2(const std::string &name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(counted(Location(name)), x, y);
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(counted(Location(name)), 1, &value[0]);
     }
     void setVec3(const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(counted(Location(name)), x, y, z);
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(counted(Location(name)), 1, &value[0]);
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(counted(Location(name)), x, y, z, w);
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(counted(Location(name)), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(counted(Location(name)), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(counted(Location(name)), 1, GL_FALSE, &mat[0][0]);
+    }
+    // pre-resolved uniforms (see Resolve)
+    // ------------------------------------------------------------------------
+    void set(Uniform<bool> uniform, bool value) const {
+        glUniform1i(counted(uniform.location), (int)value);
+    }
+    void set(Uniform<int> uniform, int value) const {
+        glUniform1i(counted(uniform.location), value);
+    }
+    void set(Uniform<float> uniform, float value) const {
+        glUniform1f(counted(uniform.location), value);
+    }
+    void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const {
+        glUniform2fv(counted(uniform.location), 1, &value[0]);
+    }
+    void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const {
+        glUniform3fv(counted(uniform.location), 1, &value[0]);
+    }
+    void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const {
+        glUniform4fv(counted(uniform.location), 1, &value[0]);
+    }
+    void set(Uniform<glm::mat3> uniform, const glm::mat3 &mat) const {
+        glUniformMatrix3fv(counted(uniform.location), 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 &mat) const {
+        glUniformMatrix4fv(counted(uniform.location), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // every glUniform* call goes into the frame's statistics
+    static GLint counted(GLint location) {
+        ++FrameStats().uniformCalls;
+        return location;
+    }
+
+    // "<vertex>+<fragment>", for messages
+    std::string programName;
+    std::unordered_map<std::string, GLint> uniforms;
+    mutable std::unordered_set<std::string> missing;
+
+    // records every active uniform with a location (block members have none); arrays are
+    // listed as "name[0]", and are found under "name" and every "name[i]" as well.
+    // Material samplers get their units here, once per program.
+    void reflectUniforms(const std::string &name) {
+        programName = name;
+        uniforms.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+        glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxLength);
+        std::vector<GLchar> buffer((size_t)std::max(maxLength, 1));
+        const GLenum properties[] = {GL_LOCATION, GL_ARRAY_SIZE};
+        for (GLint i = 0; i < count; ++i) {
+            GLint values[2];
+            glGetProgramResourceiv(ID, GL_UNIFORM, (GLuint)i, 2, properties, 2, nullptr, values);
+            if (values[0] < 0)
+                continue;
+            GLsizei length = 0;
+            glGetProgramResourceName(ID, GL_UNIFORM, (GLuint)i, (GLsizei)buffer.size(), &length, buffer.data());
+            std::string uniform(buffer.data(), (size_t)length);
+            uniforms[uniform] = values[0];
+            int unit = MaterialSamplerUnit(uniform);
+            if (unit >= 0)
+                glProgramUniform1i(ID, values[0], unit);
+            size_t bracket = uniform.size() > 3 ? uniform.size() - 3 : std::string::npos;
+            if (bracket != std::string::npos && uniform.compare(bracket, 3, "[0]") == 0) {
+                std::string base = uniform.substr(0, bracket);
+                uniforms[base] = values[0];
+                for (GLint element = 1; element < values[1]; ++element)
+                    uniforms[base + "[" + std::to_string(element) + "]"] = values[0] + element;
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type) {
@@ -0,0 +1,82 @@
+#ifndef SOLAR_SYSTEM_SHADER_CACHE_H
+#define SOLAR_SYSTEM_SHADER_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include "glad/glad.h"
+#include "content_hash.h"
+#include "asset_pack.h"
+
+// Linked program binaries (.sprog) saved by solar_cook through glGetProgramBinary. Binaries
+// only load on the driver that produced them, so each one records a hash of the shader
+// sources and of the GL vendor/renderer/version strings; anything that doesn't match (or that
+// the driver rejects) returns 0 and the caller compiles from source as before.
+
+struct ProgramBinaryHeader {
+    char magic[4];
+    uint32_t format;
+    uint64_t sourceHash;
+    uint64_t driverHash;
+    uint32_t length;
+};
+
+const char PROGRAM_BINARY_MAGIC[4] = {'S', 'P', 'R', 'G'};
+
+inline uint64_t DriverHash() {
+    uint64_t hash = HashString("driver");
+    const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (GLenum name : names) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        hash = HashString(value ? value : "", hash);
+    }
+    return hash;
+}
+
+inline bool SaveProgramBinary(unsigned int program, const std::string& path, uint64_t sourceHash) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+    std::vector<char> binary((size_t)length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    ProgramBinaryHeader header;
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+    header.format = format;
+    header.sourceHash = sourceHash;
+    header.driverHash = DriverHash();
+    header.length = (uint32_t)length;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    return out && out.write(reinterpret_cast<const char*>(&header), sizeof(header)) &&
+           out.write(binary.data(), length);
+}
+
+// the linked program, or 0 if there is no usable binary for these sources on this driver
+inline unsigned int LoadProgramBinary(const std::string& path, uint64_t sourceHash) {
+    AssetView bytes = OpenAsset(path);
+    if (!bytes.ok || bytes.size < sizeof(ProgramBinaryHeader))
+        return 0;
+    ProgramBinaryHeader header;
+    memcpy(&header, bytes.data, sizeof(header));
+    if (memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+        header.sourceHash != sourceHash || header.driverHash != DriverHash() ||
+        bytes.size - sizeof(header) < header.length)
+        return 0;
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header.format, bytes.data + sizeof(header), (GLsizei)header.length);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+#endif //SOLAR_SYSTEM_SHADER_CACHE_H
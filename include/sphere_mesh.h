@@ -0,0 +1,221 @@
+#ifndef SOLAR_SYSTEM_SPHERE_MESH_H
+#define SOLAR_SYSTEM_SPHERE_MESH_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include "glm/glm.hpp"
+#include "vertex.h"
+#include "model_import.h"
+#include "mesh.h"
+#include "import_stats.h"
+
+// Procedural unit sphere shared by every body; only the textures differ between planets.
+// It is an icosahedron (with a vertex on each pole) subdivided MAX_SPHERE_SUBDIVISION times.
+// Subdividing only appends vertices, so every coarser subdivision indexes into the same
+// vertex buffer and they become the mesh's LOD levels, finest first.
+// Texture coordinates are equirectangular like the planet maps (v = 0 at the north pole).
+// Triangles crossing the date line get copies of their vertices with u + 1 and every triangle
+// touching a pole its own copy of the pole, so nothing smears across the seam.
+
+const int MAX_SPHERE_SUBDIVISION = 6; // 81920 triangles, ~41K vertices (fits 16-bit indices)
+const int MIN_SPHERE_SUBDIVISION = 1; // 80 triangles
+
+namespace sphere_detail {
+
+const float PI = 3.14159265358979f;
+
+inline glm::vec3 OnSphere(float longitude, float y) {
+    float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+    return glm::vec3(r * std::cos(longitude), y, -r * std::sin(longitude));
+}
+
+inline float Longitude(const glm::vec3& p) {
+    return std::atan2(-p.z, p.x);
+}
+
+inline bool IsPole(const glm::vec3& p) {
+    return std::fabs(p.y) > 0.999999f;
+}
+
+// lays out vertices for one subdivision level's triangles, reusing the ones earlier levels made
+class VertexBuilder {
+public:
+    std::vector<Vertex> vertices;
+
+    unsigned int Get(unsigned int base, const glm::vec3& p, float u) {
+        uint64_t key = ((uint64_t)base << 32) | (uint32_t)(int32_t)std::lround(u * 1048576.0f);
+        auto it = index.find(key);
+        if (it != index.end())
+            return it->second;
+
+        float longitude = (u - 0.5f) * 2.0f * PI;
+        float theta = std::acos(glm::clamp(p.y, -1.0f, 1.0f));
+        Vertex v;
+        v.Position = p;
+        v.Normal = p;
+        v.TexCoords = glm::vec2(u, theta / PI);
+        v.Tangent = glm::vec3(-std::sin(longitude), 0.0f, -std::cos(longitude));
+        v.Bitangent = glm::vec3(std::cos(theta) * std::cos(longitude), -std::sin(theta),
+                                -std::cos(theta) * std::sin(longitude));
+        unsigned int id = (unsigned int)vertices.size();
+        vertices.push_back(v);
+        index[key] = id;
+        return id;
+    }
+
+private:
+    std::unordered_map<uint64_t, unsigned int> index;
+};
+
+inline void EmitLevel(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& triangles,
+                      VertexBuilder& builder, std::vector<unsigned int>& out) {
+    out.reserve(triangles.size());
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+        unsigned int base[3] = {triangles[t], triangles[t + 1], triangles[t + 2]};
+        float u[3];
+        bool pole[3];
+        float lo = 2.0f, hi = -1.0f;
+        for (int i = 0; i < 3; ++i) {
+            pole[i] = IsPole(positions[base[i]]);
+            u[i] = 0.5f + Longitude(positions[base[i]]) / (2.0f * PI);
+            if (!pole[i]) {
+                lo = std::min(lo, u[i]);
+                hi = std::max(hi, u[i]);
+            }
+        }
+        // across the date line: move the western side past u = 1
+        if (hi - lo > 0.5f) {
+            for (int i = 0; i < 3; ++i) {
+                if (!pole[i] && u[i] < 0.5f)
+                    u[i] += 1.0f;
+            }
+        }
+        // the pole takes the longitude in the middle of the triangle's other corners
+        for (int i = 0; i < 3; ++i) {
+            if (pole[i]) {
+                float sum = 0.0f;
+                int n = 0;
+                for (int j = 0; j < 3; ++j) {
+                    if (!pole[j]) {
+                        sum += u[j];
+                        n++;
+                    }
+                }
+                u[i] = n ? sum / n : 0.5f;
+            }
+        }
+        for (int i = 0; i < 3; ++i)
+            out.push_back(builder.Get(base[i], positions[base[i]], u[i]));
+    }
+}
+
+// largest distance between a flat triangle and the sphere, in radii
+inline float LevelError(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& triangles) {
+    float error = 0.0f;
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+        glm::vec3 centroid = (positions[triangles[t]] + positions[triangles[t + 1]] + positions[triangles[t + 2]]) / 3.0f;
+        error = std::max(error, 1.0f - glm::length(centroid));
+    }
+    return error;
+}
+
+} // namespace sphere_detail
+
+// unit sphere with its LOD chain (indices = finest level, lods = coarser ones), no textures
+inline ImportedMesh GenerateSphere(int maxSubdivision = MAX_SPHERE_SUBDIVISION,
+                                   int minSubdivision = MIN_SPHERE_SUBDIVISION) {
+    using namespace sphere_detail;
+
+    // pole-aligned icosahedron: the poles and two staggered rings of five
+    std::vector<glm::vec3> positions;
+    positions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    const float ringY = 1.0f / std::sqrt(5.0f);
+    for (int k = 0; k < 5; ++k)
+        positions.push_back(OnSphere(k * 2.0f * PI / 5.0f, ringY));
+    for (int k = 0; k < 5; ++k)
+        positions.push_back(OnSphere((k + 0.5f) * 2.0f * PI / 5.0f, -ringY));
+    positions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+
+    std::vector<unsigned int> triangles;
+    for (unsigned int k = 0; k < 5; ++k) {
+        unsigned int u0 = 1 + k, u1 = 1 + (k + 1) % 5;
+        unsigned int l0 = 6 + k, l1 = 6 + (k + 1) % 5;
+        unsigned int cap[] = {0, u0, u1,  u0, l0, u1,  u1, l0, l1,  11, l1, l0};
+        triangles.insert(triangles.end(), cap, cap + 12);
+    }
+    // wind everything counter-clockwise seen from outside, for back-face culling
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+        const glm::vec3 &a = positions[triangles[t]], &b = positions[triangles[t + 1]], &c = positions[triangles[t + 2]];
+        if (glm::dot(glm::cross(b - a, c - a), a + b + c) < 0.0f)
+            std::swap(triangles[t + 1], triangles[t + 2]);
+    }
+
+    std::vector<std::vector<unsigned int>> levels; // triangles of subdivision 1..max
+    for (int level = 1; level <= maxSubdivision; ++level) {
+        std::unordered_map<uint64_t, unsigned int> midpoints;
+        auto midpoint = [&](unsigned int a, unsigned int b) {
+            uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            auto it = midpoints.find(key);
+            if (it != midpoints.end())
+                return it->second;
+            unsigned int id = (unsigned int)positions.size();
+            positions.push_back(glm::normalize(positions[a] + positions[b]));
+            midpoints[key] = id;
+            return id;
+        };
+        std::vector<unsigned int> finer;
+        finer.reserve(triangles.size() * 4);
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            unsigned int a = triangles[t], b = triangles[t + 1], c = triangles[t + 2];
+            unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            unsigned int split[] = {a, ab, ca,  ab, b, bc,  ca, bc, c,  ab, bc, ca};
+            finer.insert(finer.end(), split, split + 12);
+        }
+        triangles = std::move(finer);
+        levels.push_back(triangles);
+    }
+
+    ImportedMesh sphere;
+    VertexBuilder builder;
+    int first = std::max(minSubdivision, 1);
+    for (int level = maxSubdivision; level >= first; --level) {
+        const std::vector<unsigned int>& source = levels[level - 1];
+        if (level == maxSubdivision) {
+            EmitLevel(positions, source, builder, sphere.indices);
+        } else {
+            LodLevel lod;
+            EmitLevel(positions, source, builder, lod.indices);
+            lod.error = LevelError(positions, source);
+            sphere.lods.push_back(std::move(lod));
+        }
+    }
+    sphere.vertices = std::move(builder.vertices);
+    return sphere;
+}
+
+// the sphere every planet is drawn with, in the geometry pool once for the whole scene
+inline const Mesh& SharedSphereMesh() {
+    static Mesh& mesh = []() -> Mesh& {
+        ImportedMesh sphere = GenerateSphere();
+        static Mesh built(std::move(sphere.vertices), std::move(sphere.indices), std::vector<Texture>());
+        for (const LodLevel& lod : sphere.lods)
+            built.AddLod(lod.indices, lod.error);
+        built.SetResidency(MeshResidency::GpuOnly);
+        ImportTotals().gpuResidentBytes += built.GpuBytes();
+        return built;
+    }();
+    return mesh;
+}
+
+// what a sphere body is made of besides the shared geometry: its surface textures,
+// with paths relative to directory
+struct SphereSurface {
+    std::string directory;
+    std::vector<TextureRef> textures;
+};
+
+#endif //SOLAR_SYSTEM_SPHERE_MESH_H
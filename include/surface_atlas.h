@@ -0,0 +1,310 @@
+#ifndef SOLAR_SYSTEM_SURFACE_ATLAS_H
+#define SOLAR_SYSTEM_SURFACE_ATLAS_H
+
+#include <algorithm>
+#include <vector>
+#include "glad/glad.h"
+#include <glm/glm.hpp>
+#include "shader.h"
+#include "texture_cache.h"
+
+// Planet surface maps packed into a few texture arrays, so every body is drawn with the
+// same textures bound and only a layer index changes between draws.
+//
+// Each of the SURFACE_ATLAS_TIERS arrays has one shape (format, size, levels), taken from
+// the first map that goes into it. Block-compressed maps (solar_cook's .stex) are copied
+// block for block with glCopyImageSubData into an array of their own format and size, so a
+// layer costs what the cooked texture did; a compressed map that matches no array, when
+// every array is taken, stays out of the atlas and the body draws its own texture.
+// Uncompressed maps are resampled into a GL_SRGB8_ALPHA8 array of the largest size class
+// that isn't wider than the map (maps smaller than the smallest class go to that one); every
+// mip level of the layer is rendered from the source's matching level, so the copy is as
+// sharp as the original and the other layers are left alone. Arrays grow a layer at a time
+// as bodies come in. The arrays stay bound to ATLAS_FIRST_UNIT onwards and the shaders pick
+// one with the body's {tier, layer}, which someFS gets from the body's instance (see
+// instance.h) and sunFS from a uniform (SetUniforms):
+//
+//   uniform sampler2DArray surfaceAtlas[SURFACE_ATLAS_TIERS];
+//   uniform ivec2 surfaceLayer; // tier, layer; x < 0 when the body isn't in the atlas
+//
+// The arrays count as pinned bytes in the TextureCache budget: the source maps are released
+// once copied, so there is nothing to stream levels back in from, and planet surfaces keep
+// all their levels whatever the budget.
+
+const int SURFACE_ATLAS_TIERS = 3;
+
+class SurfaceAtlas {
+public:
+    static const int ATLAS_FIRST_UNIT = 16;
+
+    // needs a current GL context
+    SurfaceAtlas() : copyShader(CopyProgram()) {
+        copyShader.use();
+        copyShader.setInt("source", 0);
+        glGenFramebuffers(1, &fbo);
+        glGenVertexArrays(1, &emptyVao);
+    }
+
+    // the program that copies surfaces into the atlas
+    static const ShaderSources& CopyProgram() {
+        static const ShaderSources program = {"resources/shaders/atlasCopyVS.vs",
+                                              "resources/shaders/atlasCopyFS.fs", {"source"}};
+        return program;
+    }
+
+    ~SurfaceAtlas() {
+        if (!TextureCache::Instance().ContextAlive())
+            return;
+        for (Tier& tier : tiers) {
+            if (tier.texture)
+                glDeleteTextures(1, &tier.texture);
+        }
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteVertexArrays(1, &emptyVao);
+    }
+
+    SurfaceAtlas(const SurfaceAtlas&) = delete;
+    SurfaceAtlas& operator=(const SurfaceAtlas&) = delete;
+
+    // copies the 2D texture into a free layer; returns {tier, layer}, or {-1, -1} if the
+    // texture is empty or fits no array
+    glm::ivec2 Add(GLuint source) {
+        Shape shape;
+        if (!describe(source, shape))
+            return glm::ivec2(-1);
+        int t = tierFor(shape);
+        if (t < 0)
+            return glm::ivec2(-1);
+        Tier& tier = tiers[t];
+        if (tier.layers == tier.capacity)
+            grow(t, tier.capacity + 1);
+        int layer = tier.layers++;
+        if (tier.shape.compressed)
+            copyBlocks(source, t, layer);
+        else
+            copy(source, t, layer);
+        Bind();
+        return glm::ivec2(t, layer);
+    }
+
+    // binds every tier to its unit; call once a frame before the bodies are drawn
+    void Bind() const {
+        GLuint textures[SURFACE_ATLAS_TIERS];
+        for (int t = 0; t < SURFACE_ATLAS_TIERS; ++t)
+            textures[t] = tiers[t].texture;
+        glBindTextures(ATLAS_FIRST_UNIT, SURFACE_ATLAS_TIERS, textures);
+    }
+
+    // points the shader's atlas samplers at their units
+    static void SetSamplerUnits(Shader& shader) {
+        int units[SURFACE_ATLAS_TIERS];
+        for (int t = 0; t < SURFACE_ATLAS_TIERS; ++t)
+            units[t] = ATLAS_FIRST_UNIT + t;
+        shader.use();
+        shader.setIntArray("surfaceAtlas", units, SURFACE_ATLAS_TIERS);
+    }
+
+    // the layer for the next draw, as returned by Add; x < 0 samples the material instead
+    static void SetUniforms(Shader& shader, glm::ivec2 layer) {
+        shader.setIVec2("surfaceLayer", layer.x, layer.y);
+    }
+
+    // size classes of the uncompressed arrays: 1024x512, 2048x1024, 4096x2048, the 2:1 of the
+    // equirectangular maps
+    static const int SIZE_CLASSES = 3;
+    static int ClassWidth(int sizeClass) { return 1024 << sizeClass; }
+    static int ClassHeight(int sizeClass) { return 512 << sizeClass; }
+
+    size_t Layers() const {
+        size_t layers = 0;
+        for (const Tier& tier : tiers)
+            layers += tier.layers;
+        return layers;
+    }
+
+    size_t Bytes() const {
+        size_t bytes = 0;
+        for (const Tier& tier : tiers)
+            bytes += layerBytes(tier.shape) * tier.capacity;
+        return bytes;
+    }
+
+private:
+    struct Shape {
+        GLenum format = 0; // internal format
+        bool compressed = false;
+        int width = 0, height = 0;
+        std::vector<size_t> levelBytes; // of one layer, every level
+
+        int Levels() const { return (int)levelBytes.size(); }
+        bool operator==(const Shape& other) const {
+            return format == other.format && width == other.width && height == other.height &&
+                   levelBytes == other.levelBytes;
+        }
+    };
+
+    struct Tier {
+        Shape shape;
+        GLuint texture = 0;
+        int layers = 0;
+        int capacity = 0;
+    };
+
+    Tier tiers[SURFACE_ATLAS_TIERS];
+    Shader copyShader;
+    GLuint fbo = 0;
+    GLuint emptyVao = 0;
+
+    static int levelWidth(const Shape& shape, int level) { return std::max(1, shape.width >> level); }
+    static int levelHeight(const Shape& shape, int level) { return std::max(1, shape.height >> level); }
+
+    static size_t layerBytes(const Shape& shape) {
+        size_t bytes = 0;
+        for (size_t levelBytes : shape.levelBytes)
+            bytes += levelBytes;
+        return bytes;
+    }
+
+    // the array shape the source goes into: its own for compressed sources, an RGBA8 size
+    // class for the rest
+    static bool describe(GLuint source, Shape& shape) {
+        GLint width = 0, height = 0, format = 0, compressed = GL_FALSE, maxLevel = 0;
+        glBindTexture(GL_TEXTURE_2D, source);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        if (width <= 0 || height <= 0) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            return false;
+        }
+
+        shape.levelBytes.clear();
+        if (compressed) {
+            shape.format = (GLenum)format;
+            shape.compressed = true;
+            shape.width = width;
+            shape.height = height;
+            for (int l = 0; l <= maxLevel; ++l) {
+                GLint w = 0, bytes = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_WIDTH, &w);
+                if (w != levelWidth(shape, l))
+                    break;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &bytes);
+                shape.levelBytes.push_back((size_t)bytes);
+            }
+        } else {
+            int c = 0;
+            while (c + 1 < SIZE_CLASSES && ClassWidth(c + 1) <= width)
+                ++c;
+            shape.format = GL_SRGB8_ALPHA8;
+            shape.compressed = false;
+            shape.width = ClassWidth(c);
+            shape.height = ClassHeight(c);
+            int levels = 1;
+            for (int size = shape.width; size > 1; size >>= 1)
+                ++levels;
+            for (int l = 0; l < levels; ++l)
+                shape.levelBytes.push_back((size_t)levelWidth(shape, l) * levelHeight(shape, l) * 4);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return true;
+    }
+
+    // the array of that shape, or a free one it claims; -1 when every array is taken
+    int tierFor(const Shape& shape) {
+        for (int t = 0; t < SURFACE_ATLAS_TIERS; ++t) {
+            if (tiers[t].capacity > 0 && tiers[t].shape == shape)
+                return t;
+        }
+        for (int t = 0; t < SURFACE_ATLAS_TIERS; ++t) {
+            if (tiers[t].capacity == 0) {
+                tiers[t].shape = shape;
+                return t;
+            }
+        }
+        return -1;
+    }
+
+    // reallocates the tier's array with room for `capacity` layers, keeping the ones in use
+    void grow(int t, int capacity) {
+        Tier& tier = tiers[t];
+        const Shape& shape = tier.shape;
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, shape.Levels(), shape.format, shape.width, shape.height, capacity);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // longitude wraps, latitude clamps at the poles
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        if (tier.texture) {
+            for (int l = 0; l < shape.Levels(); ++l) {
+                glCopyImageSubData(tier.texture, GL_TEXTURE_2D_ARRAY, l, 0, 0, 0, texture, GL_TEXTURE_2D_ARRAY, l,
+                                   0, 0, 0, levelWidth(shape, l), levelHeight(shape, l), tier.layers);
+            }
+            glDeleteTextures(1, &tier.texture);
+        }
+        TextureCache::Instance().AddPinnedBytes(layerBytes(shape) * (capacity - tier.capacity));
+        tier.texture = texture;
+        tier.capacity = capacity;
+    }
+
+    // a compressed source of the tier's shape, level by level
+    void copyBlocks(GLuint source, int t, int layer) {
+        const Shape& shape = tiers[t].shape;
+        for (int l = 0; l < shape.Levels(); ++l) {
+            glCopyImageSubData(source, GL_TEXTURE_2D, l, 0, 0, 0, tiers[t].texture, GL_TEXTURE_2D_ARRAY, l, 0, 0,
+                               layer, levelWidth(shape, l), levelHeight(shape, l), 1);
+        }
+    }
+
+    // draws the source over each level of the layer; the copy shader's derivatives make the
+    // source's matching mip level the one that's sampled
+    void copy(GLuint source, int t, int layer) {
+        const Shape& shape = tiers[t].shape;
+        GLint framebuffer, program, vao, viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        GLboolean srgb = glIsEnabled(GL_FRAMEBUFFER_SRGB);
+
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        copyShader.use();
+        glBindTextures(0, 1, &source);
+        glBindVertexArray(emptyVao);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+        for (int l = 0; l < shape.Levels(); ++l) {
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tiers[t].texture, l, layer);
+            glViewport(0, 0, levelWidth(shape, l), levelHeight(shape, l));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)framebuffer);
+        glBindVertexArray((GLuint)vao);
+        glUseProgram((GLuint)program);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (cullFace)
+            glEnable(GL_CULL_FACE);
+        if (blend)
+            glEnable(GL_BLEND);
+        if (!srgb)
+            glDisable(GL_FRAMEBUFFER_SRGB);
+    }
+};
+
+#endif //SOLAR_SYSTEM_SURFACE_ATLAS_H
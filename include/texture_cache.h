@@ -0,0 +1,746 @@
+#ifndef SOLAR_SYSTEM_TEXTURE_CACHE_H
+#define SOLAR_SYSTEM_TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <unordered_map>
+#include "glad/glad.h"
+#include "stb_image.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "content_hash.h"
+#include "cooked_texture.h"
+#include "asset_paths.h"
+#include "asset_pack.h"
+#include "load_report.h"
+#include "decode_memory_gate.h"
+
+inline GLenum MipChainFormat(const MipChain& chain) {
+    if (chain.channels == 1)
+        return GL_RED;
+    if (chain.channels == 2)
+        return GL_RG;
+    if (chain.channels == 4)
+        return GL_RGBA;
+    return GL_RGB;
+}
+
+// uploads go through this much mapped pixel-unpack memory at a time
+const size_t UPLOAD_STAGING_BYTES = (size_t)4 << 20;
+
+inline GLuint UploadStagingBuffer() {
+    static GLuint buffer = 0;
+    if (!buffer)
+        glGenBuffers(1, &buffer);
+    return buffer;
+}
+
+// Uploads a CPU-built mip chain level by level; the driver never has to build mips itself.
+// Levels from firstLevel on become the texture's levels 0, 1, ...
+// Rows are copied into a mapped staging buffer a strip at a time, so the driver never
+// holds a second copy of a whole level.
+inline void UploadMipChain(GLenum target, const MipChain& chain, size_t firstLevel = 0) {
+    GLenum format = MipChainFormat(chain);
+
+    // rows of small RGB levels aren't 4-byte aligned
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, UploadStagingBuffer());
+    for (size_t i = firstLevel; i < chain.levels.size(); ++i) {
+        const MipLevel& level = chain.levels[i];
+        GLint textureLevel = (GLint)(i - firstLevel);
+        glTexImage2D(target, textureLevel, format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+
+        size_t rowBytes = (size_t)level.width * chain.channels;
+        int stripRows = (int)std::max<size_t>(1, UPLOAD_STAGING_BYTES / rowBytes);
+        for (int y = 0; y < level.height; y += stripRows) {
+            int rows = std::min(stripRows, level.height - y);
+            size_t bytes = rows * rowBytes;
+            // orphaning lets the next strip go in while the last one is still being read
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, std::max(bytes, UPLOAD_STAGING_BYTES), nullptr, GL_STREAM_DRAW);
+            void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (!staging)
+                break;
+            memcpy(staging, &level.pixels[y * rowBytes], bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(target, textureLevel, 0, y, level.width, rows, format, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)(chain.levels.size() - firstLevel) - 1);
+}
+
+// Process-wide registry of 2D textures shared by every Model. Textures are keyed by the
+// canonical path of their file and by a hash of its contents, so the same image reached
+// through different paths (or copied next to another model) is decoded and uploaded once.
+// Both keys include the sRGB flag: an image used as colour and as data is two textures.
+// Every Acquire must be paired with a Release; the GL texture is deleted with its last user.
+//
+// Resident textures are kept under a memory budget. Each frame the bodies in sight Request
+// the resolution they need; Update then drops mip levels nobody needs, least recently used
+// first, whenever the textures don't fit, and streams levels back in on a background thread
+// once a body comes close again and there is room. Dropping happens on the GPU (the kept
+// levels are copied out and back with glCopyImageSubData); restoring re-reads the source.
+// Textures that are never requested (the skybox, ones without a model in view) aren't touched.
+class TextureCache {
+public:
+    static TextureCache& Instance() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // an image read and decoded (or parsed) but not uploaded yet
+    struct Prepared {
+        bool ok = false;
+        bool srgb = true;
+        uint64_t hash = 0;
+        size_t size = 0;
+        uint64_t frame = 0;    // when Prefetch or Adopt stored it
+        MipChain chain;        // decoded source image,
+        CookedTexture cooked;  // or solar_cook output; both empty when the contents matched a resident texture
+        DecodeReservation reservation; // the chain's share of the DecodeMemoryGate, until it's uploaded
+    };
+
+    // filter used for the CPU-built mip chains
+    MipFilter mipFilter = MipFilter::Kaiser;
+
+    // Decodes and builds mips for several images in parallel, ahead of the Acquire calls
+    // that will upload them. Images that are already resident are skipped, and so are the
+    // ones the DecodeMemoryGate has no room for; Acquire decodes those itself.
+    void Prefetch(const std::vector<std::pair<std::string, bool>>& requests) {
+        std::vector<std::pair<std::string, bool>> pending;
+        for (const auto& request : requests) {
+            std::string canonical = canonicalPath(sourcePath(request.first));
+            std::string key = pathKey(canonical, request.second);
+            if (!byPath.count(key) && !prepared.count(key))
+                pending.emplace_back(canonical, request.second);
+        }
+
+        std::vector<std::string> paths;
+        for (const auto& request : pending)
+            paths.push_back(request.first);
+        AssetReadAhead::Instance().Stage(paths);
+
+        std::vector<Prepared> results(pending.size());
+        ParallelFor(pending.size(), [&](size_t i) {
+            results[i] = prepare(pending[i].first, pending[i].second, mipFilter, &byHash, GateWait::Try);
+        });
+        for (size_t i = 0; i < pending.size(); ++i) {
+            if (results[i].ok) {
+                results[i].frame = frame;
+                prepared[pathKey(pending[i].first, pending[i].second)] = std::move(results[i]);
+            }
+        }
+    }
+
+    // Images decoded away from the GL thread: Decode may run on any thread (it doesn't touch
+    // the cache), Adopt hands the results to the cache on the GL thread like Prefetch would.
+    // As with Prefetch, images the DecodeMemoryGate has no room for are left to Acquire.
+    struct DecodedBatch {
+        std::vector<std::pair<std::string, Prepared>> images;
+    };
+
+    static DecodedBatch Decode(const std::vector<std::pair<std::string, bool>>& requests, MipFilter filter) {
+        DecodedBatch batch;
+        batch.images.resize(requests.size());
+        std::vector<std::string> paths(requests.size());
+        for (size_t i = 0; i < requests.size(); ++i) {
+            batch.images[i].first = canonicalPath(sourcePath(requests[i].first));
+            paths[i] = batch.images[i].first;
+        }
+        AssetReadAhead::Instance().Stage(paths);
+        ParallelFor(requests.size(), [&](size_t i) {
+            batch.images[i].second = prepare(batch.images[i].first, requests[i].second, filter, nullptr,
+                                             GateWait::Try);
+        });
+        return batch;
+    }
+
+    void Adopt(DecodedBatch& batch) {
+        for (auto& image : batch.images) {
+            std::string key = pathKey(image.first, image.second.srgb);
+            if (image.second.ok && !byPath.count(key)) {
+                image.second.frame = frame;
+                prepared[key] = std::move(image.second);
+            }
+        }
+        batch.images.clear();
+    }
+
+    // returns the GL texture for the image at path, loading it on first use (0 on failure).
+    // srgb marks colour images, whose mips are filtered in linear light.
+    unsigned int Acquire(const std::string& path, bool srgb = true) {
+        std::string canonical = canonicalPath(sourcePath(path));
+        std::string key = pathKey(canonical, srgb);
+
+        auto byPathIt = byPath.find(key);
+        if (byPathIt != byPath.end()) {
+            ++hits;
+            entries[byPathIt->second].refs++;
+            return byPathIt->second;
+        }
+
+        Prepared image;
+        auto preparedIt = prepared.find(key);
+        if (preparedIt != prepared.end()) {
+            image = std::move(preparedIt->second);
+            prepared.erase(preparedIt);
+        } else {
+            image = prepare(canonical, srgb, mipFilter, &byHash, GateWait::Force);
+        }
+        if (!image.ok) {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return 0;
+        }
+
+        uint64_t hash = image.hash;
+        auto byHashIt = byHash.find(contentKey(hash, srgb));
+        if (byHashIt != byHash.end() && entries[byHashIt->second].size == image.size) {
+            // same image under another name
+            ++hits;
+            Entry& entry = entries[byHashIt->second];
+            entry.refs++;
+            entry.paths.push_back(canonical);
+            byPath[key] = byHashIt->second;
+            return byHashIt->second;
+        }
+
+        ++misses;
+        if (image.chain.levels.empty() && image.cooked.levels.empty()) {
+            // content matched a texture that was released in the meantime
+            image = prepare(canonical, srgb, mipFilter, nullptr, GateWait::Force);
+            if (!image.ok)
+                return 0;
+        }
+        unsigned int id = upload(canonical, image);
+
+        Entry entry;
+        entry.refs = 1;
+        entry.hash = hash;
+        entry.size = image.size;
+        entry.paths.push_back(canonical);
+        entry.generation = ++generations;
+        describe(entry, image, srgb);
+        entries[id] = entry;
+        byPath[key] = id;
+        byHash[contentKey(hash, srgb)] = id;
+        return id;
+    }
+
+    void Release(unsigned int id) {
+        auto it = entries.find(id);
+        if (it == entries.end())
+            return;
+        if (--it->second.refs > 0)
+            return;
+
+        for (const std::string& p : it->second.paths)
+            byPath.erase(pathKey(p, it->second.srgb));
+        byHash.erase(contentKey(it->second.hash, it->second.srgb));
+        entries.erase(it);
+        if (contextAlive)
+            glDeleteTextures(1, &id);
+    }
+
+    // called before the GL context goes away; models released after that only drop bookkeeping
+    void ContextDestroyed() {
+        contextAlive = false;
+    }
+
+    bool ContextAlive() const { return contextAlive; }
+
+    size_t Hits() const { return hits; }
+    size_t Misses() const { return misses; }
+    size_t Resident() const { return entries.size(); }
+
+    // frames a texture stays "in use" after its last Request
+    static constexpr uint64_t IN_USE_FRAMES = 2;
+    // frames a prefetched image waits for its Acquire before it's thrown away
+    static constexpr uint64_t PREPARED_FRAMES = 2;
+    // budget pressure never drops a texture below this size
+    static constexpr int MIN_RESIDENT_SIZE = 64;
+    // bounds the GPU copies Update does in one frame
+    static constexpr int MAX_DROPS_PER_FRAME = 4;
+
+    void SetBudget(size_t bytes) { budgetBytes = bytes; }
+    size_t BudgetBytes() const { return budgetBytes; }
+
+    // textures this cache doesn't own but that count against the budget (the skybox)
+    void AddPinnedBytes(size_t bytes) { pinnedBytes += bytes; }
+
+    // bytes of every resident level plus the pinned bytes
+    size_t ResidentBytes() const {
+        size_t total = pinnedBytes;
+        for (const auto& it : entries)
+            total += residentBytes(it.second);
+        return total;
+    }
+
+    // mip levels currently dropped from resident textures, and textures with levels on the way back
+    size_t DroppedLevels() const {
+        size_t dropped = 0;
+        for (const auto& it : entries)
+            dropped += it.second.residentBase;
+        return dropped;
+    }
+    size_t Streaming() const {
+        size_t streaming = 0;
+        for (const auto& it : entries)
+            streaming += it.second.streaming ? 1 : 0;
+        return streaming;
+    }
+
+    // The texture is needed this frame, sharp enough to show `texels` texels across its
+    // width; from then on the budget may drop the levels it doesn't need.
+    void Request(unsigned int id, float texels) {
+        auto it = entries.find(id);
+        if (it == entries.end() || it->second.levelBytes.empty())
+            return;
+        Entry& entry = it->second;
+        int levels = (int)entry.levelBytes.size();
+        int base = 0;
+        if (texels > 0.0f && entry.width > texels)
+            base = std::min(levels - 1, (int)std::floor(std::log2(entry.width / texels)));
+        if (entry.lastUsed != frame || !entry.managed)
+            entry.requestedBase = base;
+        else
+            entry.requestedBase = std::min(entry.requestedBase, base);
+        entry.managed = true;
+        entry.lastUsed = frame;
+    }
+
+    // Call once per frame on the GL thread, after the frame's Requests: brings in streamed
+    // levels, throws away prefetched images that weren't acquired, starts streaming for
+    // textures that need more detail, and drops levels while the textures are over budget.
+    void Update() {
+        applyStreamed();
+        dropStalePrepared();
+        ++frame;
+
+        size_t used = ResidentBytes();
+        std::vector<unsigned int> wanting;
+        for (auto& it : entries) {
+            const Entry& entry = it.second;
+            if (entry.managed && !entry.streaming && inUse(entry) && entry.requestedBase < entry.residentBase)
+                wanting.push_back(it.first);
+        }
+        // the textures that need the most detail back go first
+        std::sort(wanting.begin(), wanting.end(), [this](unsigned int a, unsigned int b) {
+            const Entry& ea = entries[a];
+            const Entry& eb = entries[b];
+            return ea.residentBase - ea.requestedBase > eb.residentBase - eb.requestedBase;
+        });
+        for (unsigned int id : wanting) {
+            Entry& entry = entries[id];
+            size_t extra = levelRangeBytes(entry, entry.requestedBase, entry.residentBase);
+            if (used + extra > budgetBytes)
+                continue;
+            used += extra;
+            streamIn(id, entry, entry.requestedBase);
+        }
+        if (used > budgetBytes)
+            evict(used - budgetBytes);
+    }
+
+    ~TextureCache() {
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            stopping = true;
+        }
+        streamWake.notify_one();
+        if (streamer.joinable())
+            streamer.join();
+    }
+
+private:
+    struct Entry {
+        size_t refs = 0;
+        uint64_t hash = 0;
+        size_t size = 0;
+        std::vector<std::string> paths;
+
+        // residency, see Request and Update
+        bool srgb = true;
+        GLenum format = 0;               // internal format (also the pixel format when uncompressed)
+        bool compressed = false;
+        int width = 0, height = 0;       // of the full-resolution level
+        std::vector<size_t> levelBytes;  // size of every level of the full chain
+        int residentBase = 0;            // finest level of the full chain on the GPU
+        int requestedBase = 0;           // finest level the latest Requests asked for
+        bool managed = false;            // requested at least once
+        uint64_t lastUsed = 0;           // frame of the latest Request
+        bool streaming = false;
+        uint64_t generation = 0;         // tells a stream-in apart from a reused texture name
+    };
+
+    struct StreamJob {
+        unsigned int id;
+        uint64_t generation;
+        std::string path;
+        bool srgb;
+        MipFilter filter;
+        int base;
+        Prepared image;
+    };
+
+    std::unordered_map<std::string, Prepared> prepared;
+    std::unordered_map<std::string, unsigned int> byPath;
+    std::unordered_map<uint64_t, unsigned int> byHash;
+    std::unordered_map<unsigned int, Entry> entries;
+    size_t hits = 0, misses = 0;
+    bool contextAlive = true;
+
+    size_t budgetBytes = (size_t)512 << 20;
+    size_t pinnedBytes = 0;
+    uint64_t frame = 1;
+    uint64_t generations = 0;
+
+    std::thread streamer;
+    std::mutex streamMutex;
+    std::condition_variable streamWake;
+    std::deque<StreamJob> streamQueue;
+    std::deque<StreamJob> streamed;
+    bool stopping = false;
+
+    TextureCache() = default;
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    bool inUse(const Entry& entry) const {
+        return entry.lastUsed + IN_USE_FRAMES >= frame;
+    }
+
+    static size_t levelRangeBytes(const Entry& entry, int first, int end) {
+        size_t bytes = 0;
+        for (int level = first; level < end; ++level)
+            bytes += entry.levelBytes[level];
+        return bytes;
+    }
+
+    static size_t residentBytes(const Entry& entry) {
+        return levelRangeBytes(entry, entry.residentBase, (int)entry.levelBytes.size());
+    }
+
+    // coarsest base level that still keeps the texture at MIN_RESIDENT_SIZE or above
+    static int minimumBase(const Entry& entry) {
+        int base = 0;
+        int levels = (int)entry.levelBytes.size();
+        while (base + 1 < levels && std::max(entry.width, entry.height) >> (base + 1) >= MIN_RESIDENT_SIZE)
+            ++base;
+        return base;
+    }
+
+    static void describe(Entry& entry, const Prepared& image, bool srgb) {
+        entry.srgb = srgb;
+        entry.levelBytes.clear();
+        if (!image.cooked.levels.empty()) {
+            entry.format = image.cooked.format;
+            entry.compressed = true;
+            entry.width = image.cooked.levels[0].width;
+            entry.height = image.cooked.levels[0].height;
+            for (const CookedTextureLevel& level : image.cooked.levels)
+                entry.levelBytes.push_back(level.blocks.size());
+        } else if (!image.chain.levels.empty()) {
+            entry.format = MipChainFormat(image.chain);
+            entry.compressed = false;
+            entry.width = image.chain.levels[0].width;
+            entry.height = image.chain.levels[0].height;
+            for (const MipLevel& level : image.chain.levels)
+                entry.levelBytes.push_back(level.pixels.size());
+        }
+    }
+
+    // prefetched images nobody acquired; their chains (and decode memory) go
+    void dropStalePrepared() {
+        for (auto it = prepared.begin(); it != prepared.end();) {
+            if (it->second.frame + PREPARED_FRAMES <= frame)
+                it = prepared.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // Drops levels least recently used first until `excess` bytes are freed: first levels
+    // finer than what their texture was last asked for, then idle textures down to the
+    // minimum size, and only then textures in use.
+    void evict(size_t excess) {
+        std::vector<std::pair<uint64_t, unsigned int>> order;
+        for (const auto& it : entries) {
+            if (it.second.managed && !it.second.streaming)
+                order.emplace_back(it.second.lastUsed, it.first);
+        }
+        std::sort(order.begin(), order.end());
+
+        int drops = 0;
+        auto pass = [&](bool idleOnly, bool surplusOnly) {
+            for (const auto& candidate : order) {
+                if (excess == 0 || drops == MAX_DROPS_PER_FRAME)
+                    return;
+                Entry& entry = entries[candidate.second];
+                if (idleOnly && inUse(entry))
+                    continue;
+                int floor = minimumBase(entry);
+                if (surplusOnly)
+                    floor = inUse(entry) ? std::min(floor, entry.requestedBase) : 0;
+                int base = entry.residentBase;
+                size_t freed = 0;
+                while (base < floor && freed < excess)
+                    freed += entry.levelBytes[base++];
+                if (base == entry.residentBase)
+                    continue;
+                dropLevels(candidate.second, entry, base);
+                excess -= std::min(excess, freed);
+                ++drops;
+            }
+        };
+        pass(false, true);
+        pass(true, false);
+        pass(false, false);
+    }
+
+    // (Re)specifies the texture bound to GL_TEXTURE_2D with storage for the chain from
+    // `base` on, no data; levels [count, clearUpTo) are emptied
+    static void allocateLevels(const Entry& entry, int base, int clearUpTo) {
+        int count = (int)entry.levelBytes.size() - base;
+        for (int level = 0; level < std::max(count, clearUpTo); ++level) {
+            bool keep = level < count;
+            GLsizei w = keep ? std::max(1, entry.width >> (base + level)) : 0;
+            GLsizei h = keep ? std::max(1, entry.height >> (base + level)) : 0;
+            if (entry.compressed) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, entry.format, w, h, 0,
+                                       keep ? (GLsizei)entry.levelBytes[base + level] : 0, nullptr);
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, level, entry.format, w, h, 0, entry.format, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count - 1);
+    }
+
+    static void copyLevels(const Entry& entry, GLuint from, int fromFirst, GLuint to, int toFirst, int count,
+                           int base) {
+        for (int level = 0; level < count; ++level) {
+            GLsizei w = std::max(1, entry.width >> (base + level));
+            GLsizei h = std::max(1, entry.height >> (base + level));
+            glCopyImageSubData(from, GL_TEXTURE_2D, fromFirst + level, 0, 0, 0, to, GL_TEXTURE_2D, toFirst + level,
+                               0, 0, 0, w, h, 1);
+        }
+    }
+
+    // keeps the levels from `base` on: they go to a scratch texture and back into the
+    // same texture name, respecified one or more levels smaller, so models keep their ids
+    void dropLevels(unsigned int id, Entry& entry, int base) {
+        int oldCount = (int)entry.levelBytes.size() - entry.residentBase;
+        int count = (int)entry.levelBytes.size() - base;
+
+        GLuint scratch;
+        glGenTextures(1, &scratch);
+        glBindTexture(GL_TEXTURE_2D, scratch);
+        allocateLevels(entry, base, 0);
+        copyLevels(entry, id, base - entry.residentBase, scratch, 0, count, base);
+
+        glBindTexture(GL_TEXTURE_2D, id);
+        allocateLevels(entry, base, oldCount);
+        copyLevels(entry, scratch, 0, id, 0, count, base);
+        glDeleteTextures(1, &scratch);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        entry.residentBase = base;
+    }
+
+    void streamIn(unsigned int id, Entry& entry, int base) {
+        StreamJob job;
+        job.id = id;
+        job.generation = entry.generation;
+        job.path = entry.paths.front();
+        job.srgb = entry.srgb;
+        job.filter = mipFilter;
+        job.base = base;
+        entry.streaming = true;
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            if (!streamer.joinable())
+                streamer = std::thread([this]() { streamLoop(); });
+            streamQueue.push_back(std::move(job));
+        }
+        streamWake.notify_one();
+    }
+
+    void streamLoop() {
+        for (;;) {
+            StreamJob job;
+            {
+                std::unique_lock<std::mutex> lock(streamMutex);
+                streamWake.wait(lock, [this]() { return stopping || !streamQueue.empty(); });
+                if (stopping)
+                    return;
+                job = std::move(streamQueue.front());
+                streamQueue.pop_front();
+            }
+            // without room the job comes back empty and Update asks again on a later frame
+            job.image = prepare(job.path, job.srgb, job.filter, nullptr, GateWait::Try, job.base);
+            std::lock_guard<std::mutex> lock(streamMutex);
+            streamed.push_back(std::move(job));
+        }
+    }
+
+    // re-uploads textures whose source was read again, from the level their stream-in asked for
+    // (the only levels the stream-in kept)
+    void applyStreamed() {
+        std::deque<StreamJob> done;
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            done.swap(streamed);
+        }
+        for (StreamJob& job : done) {
+            auto it = entries.find(job.id);
+            if (it == entries.end() || it->second.generation != job.generation)
+                continue;
+            Entry& entry = it->second;
+            entry.streaming = false;
+            size_t levels = std::max(job.image.cooked.levels.size(), job.image.chain.levels.size());
+            if (!job.image.ok || levels != entry.levelBytes.size() || job.base >= entry.residentBase)
+                continue;
+
+            ScopedLoadTimer timer(job.path, "texture", LoadStage::Upload);
+            glBindTexture(GL_TEXTURE_2D, job.id);
+            if (!job.image.cooked.levels.empty())
+                UploadCookedTexture(GL_TEXTURE_2D, job.image.cooked, job.base);
+            else
+                UploadMipChain(GL_TEXTURE_2D, job.image.chain, job.base);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            entry.residentBase = job.base;
+        }
+    }
+
+    // in cooked mode every image is read from its solar_cook output instead
+    static std::string sourcePath(const std::string& path) {
+        return UseCookedAssets() ? CookedTexturePath(path) : path;
+    }
+
+    static bool isCooked(const std::string& path) {
+        return path.size() > 5 && path.compare(path.size() - 5, 5, ".stex") == 0;
+    }
+
+    // the byPath / prepared key and the byHash key of an image used with the given sRGB flag
+    static std::string pathKey(const std::string& canonical, bool srgb) {
+        return srgb ? canonical : canonical + "#linear";
+    }
+
+    static uint64_t contentKey(uint64_t hash, bool srgb) {
+        return srgb ? hash : hash ^ 0x9e3779b97f4a7c15ull;
+    }
+
+    static std::string canonicalPath(const std::string& path) {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return std::string(resolved);
+        return path;
+    }
+
+    // how prepare takes its share of the DecodeMemoryGate (see there)
+    enum class GateWait {
+        Try,   // batches and the streaming thread: skip the image when there's no room
+        Force  // the GL thread, which uploads the image right away
+    };
+
+    // reads, hashes and decodes an image and builds its mips; safe to run on worker threads
+    // as long as `resident` isn't modified meanwhile. A stream-in passes the first level it
+    // restores as restoreFrom: the levels before it are left empty, and the file's bytes,
+    // counted when it was first loaded, aren't reported again. stb_image can't decode at a
+    // lower resolution, so a source image is still decoded in full; cooked images copy only
+    // the restored levels.
+    static Prepared prepare(const std::string& path, bool srgb, MipFilter filter,
+                            const std::unordered_map<uint64_t, unsigned int>* resident, GateWait wait,
+                            int restoreFrom = -1) {
+        const size_t firstLevel = restoreFrom > 0 ? (size_t)restoreFrom : 0;
+        Prepared image;
+        image.srgb = srgb;
+        AssetView bytes;
+        {
+            ScopedLoadTimer timer(path, "texture", LoadStage::Read);
+            bytes = OpenAsset(path);
+            if (!bytes.ok)
+                return image;
+            image.hash = HashBytes(bytes.data, bytes.size);
+            image.size = bytes.size;
+        }
+        if (resident && resident->count(contentKey(image.hash, srgb))) {
+            image.ok = true;
+            return image;
+        }
+        if (restoreFrom < 0)
+            LoadReport::Instance().AddBytes(path, "texture", bytes.size);
+
+        if (isCooked(path)) {
+            ScopedLoadTimer timer(path, "texture", LoadStage::Parse);
+            image.ok = ParseCookedTexture(bytes.data, bytes.size, image.cooked, firstLevel);
+            return image;
+        }
+
+        int width, height, nrComponents;
+        if (!stbi_info_from_memory(bytes.data, (int)bytes.size, &width, &height, &nrComponents))
+            return image;
+        size_t reserved = DecodeMemoryGate::DecodeBytes(width, height, nrComponents);
+        if (wait == GateWait::Force)
+            DecodeMemoryGate::Instance().ForceReserve(reserved);
+        else if (!DecodeMemoryGate::Instance().TryReserve(reserved))
+            return image;
+        image.reservation = DecodeReservation(reserved);
+
+        MipLevel base;
+        {
+            ScopedLoadTimer timer(path, "texture", LoadStage::Decode);
+            unsigned char *data = stbi_load_from_memory(bytes.data, (int)bytes.size, &width, &height,
+                                                        &nrComponents, 0);
+            if (data) {
+                // stb_image's buffer goes before the mips are built, so they never coexist
+                base.width = width;
+                base.height = height;
+                base.pixels.assign(data, data + (size_t)width * height * nrComponents);
+                stbi_image_free(data);
+            }
+        }
+        if (!base.pixels.empty()) {
+            ScopedLoadTimer timer(path, "texture", LoadStage::Mips);
+            image.chain = GenerateMipChain(std::move(base), nrComponents, srgb, filter, firstLevel);
+            image.ok = true;
+        }
+        image.reservation.Shrink(image.chain.Bytes());
+        return image;
+    }
+
+    static unsigned int upload(const std::string& path, const Prepared& image) {
+        ScopedLoadTimer timer(path, "texture", LoadStage::Upload);
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        if (!image.cooked.levels.empty())
+            UploadCookedTexture(GL_TEXTURE_2D, image.cooked);
+        else
+            UploadMipChain(GL_TEXTURE_2D, image.chain);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+};
+
+#endif //SOLAR_SYSTEM_TEXTURE_CACHE_H
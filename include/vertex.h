@@ -0,0 +1,15 @@
+#ifndef SOLAR_SYSTEM_VERTEX_H
+#define SOLAR_SYSTEM_VERTEX_H
+
+#include "glm/glm.hpp"
+
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+#endif //SOLAR_SYSTEM_VERTEX_H
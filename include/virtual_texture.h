@@ -0,0 +1,670 @@
+#ifndef SOLAR_SYSTEM_VIRTUAL_TEXTURE_H
+#define SOLAR_SYSTEM_VIRTUAL_TEXTURE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "glad/glad.h"
+#include "stb_image.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "shader.h"
+
+// Sparse virtual texturing for planet surfaces that are far too big to upload whole.
+//
+// Offline, BuildVirtualTexture cuts an image and its mip chain into fixed size tiles (with a
+// border for bilinear filtering) and writes them to a single .vt file. At run time a low
+// resolution feedback pass records which tile and mip level every visible texel wants, the
+// missing tiles are read on a loader thread and copied into pages of one physical cache
+// texture, and a small indirection table tells someFS which page holds each tile. Tiles that
+// aren't resident yet fall back to their closest resident ancestor, and the coarsest level is
+// always resident, so the surface is never missing, only blurrier for a few frames.
+//
+// GPU memory is the page cache plus the indirection tables, independent of source size.
+
+// .vt file: header, then every tile of every level (finest first, row-major), uncompressed
+struct VtHeader {
+    char magic[4];
+    uint32_t width, height, channels, tileContent, border, levels;
+};
+
+const char VT_MAGIC[4] = {'S', 'V', 'T', '1'};
+
+// tile grid of a pyramid; shared by the builder and the runtime
+struct VtLayout {
+    uint32_t width = 0, height = 0, channels = 0;
+    uint32_t tileContent = 120, border = 4;
+    uint32_t levels = 0;
+    std::vector<uint32_t> tilesX, tilesY, firstTile;
+
+    uint32_t PageSize() const { return tileContent + 2 * border; }
+    size_t TileBytes() const { return (size_t)PageSize() * PageSize() * channels; }
+    uint32_t LevelWidth(uint32_t level) const { return std::max(1u, width >> level); }
+    uint32_t LevelHeight(uint32_t level) const { return std::max(1u, height >> level); }
+    size_t TileIndex(uint32_t level, uint32_t x, uint32_t y) const { return firstTile[level] + (size_t)y * tilesX[level] + x; }
+    size_t TileCount() const { return levels ? firstTile.back() + (size_t)tilesX.back() * tilesY.back() : 0; }
+
+    // levels go down until the whole image fits in one tile
+    void Compute() {
+        levels = 0;
+        tilesX.clear();
+        tilesY.clear();
+        firstTile.clear();
+        size_t first = 0;
+        for (;;) {
+            uint32_t tx = (LevelWidth(levels) + tileContent - 1) / tileContent;
+            uint32_t ty = (LevelHeight(levels) + tileContent - 1) / tileContent;
+            tilesX.push_back(tx);
+            tilesY.push_back(ty);
+            firstTile.push_back((uint32_t)first);
+            first += (size_t)tx * ty;
+            ++levels;
+            if (tx == 1 && ty == 1)
+                break;
+        }
+    }
+};
+
+// Cuts the image at imagePath into a tile pyramid. Longitude (x) wraps around and latitude
+// clamps, which is what the equirectangular planet maps need. Returns false if the image
+// can't be read or the output can't be written.
+inline bool BuildVirtualTexture(const std::string& imagePath, const std::string& outPath, bool srgb = true) {
+    int width, height, channels;
+    unsigned char* data = stbi_load(imagePath.c_str(), &width, &height, &channels, 0);
+    if (!data) {
+        std::cout << "Virtual texture source failed to load: " << imagePath << std::endl;
+        return false;
+    }
+
+    VtLayout layout;
+    layout.width = width;
+    layout.height = height;
+    layout.channels = channels;
+    layout.Compute();
+
+    MipChain chain = GenerateMipChain(data, width, height, channels, srgb, MipFilter::Kaiser);
+    stbi_image_free(data);
+
+    std::ofstream out(outPath, std::ios::binary);
+    if (!out) {
+        std::cout << "Could not write virtual texture: " << outPath << std::endl;
+        return false;
+    }
+    VtHeader header;
+    std::memcpy(header.magic, VT_MAGIC, 4);
+    header.width = layout.width;
+    header.height = layout.height;
+    header.channels = layout.channels;
+    header.tileContent = layout.tileContent;
+    header.border = layout.border;
+    header.levels = layout.levels;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const int page = (int)layout.PageSize();
+    const size_t tileBytes = layout.TileBytes();
+    for (uint32_t level = 0; level < layout.levels; ++level) {
+        const MipLevel& src = chain.levels[level];
+        const uint32_t tilesX = layout.tilesX[level];
+        std::vector<unsigned char> row(tileBytes * tilesX);
+        for (uint32_t ty = 0; ty < layout.tilesY[level]; ++ty) {
+            ParallelFor(tilesX, [&](size_t tx) {
+                unsigned char* tile = &row[tx * tileBytes];
+                for (int y = 0; y < page; ++y) {
+                    int sy = (int)(ty * layout.tileContent) + y - (int)layout.border;
+                    sy = std::min(std::max(sy, 0), src.height - 1);
+                    for (int x = 0; x < page; ++x) {
+                        int sx = (int)(tx * layout.tileContent) + x - (int)layout.border;
+                        sx = ((sx % src.width) + src.width) % src.width;
+                        std::memcpy(&tile[((size_t)y * page + x) * channels],
+                                    &src.pixels[((size_t)sy * src.width + sx) * channels], channels);
+                    }
+                }
+            });
+            out.write(reinterpret_cast<const char*>(row.data()), row.size());
+        }
+    }
+    return (bool)out;
+}
+
+class VirtualTextureSystem {
+public:
+    static const int INDIRECTION_UNIT = 14;
+    static const int PAGE_CACHE_UNIT = 15;
+    static const int MAX_LEVELS = 16;
+
+    // pagesPerSide^2 pages of 128x128 texels; 32 gives a 4096x4096 (64 MB) cache.
+    // The feedback buffer is the screen divided by feedbackDivisor in both directions.
+    explicit VirtualTextureSystem(int pagesPerSide = 32, int feedbackDivisor = 4)
+            : pagesPerSide(pagesPerSide), feedbackDivisor(feedbackDivisor) {}
+
+    VirtualTextureSystem(const VirtualTextureSystem&) = delete;
+    VirtualTextureSystem& operator=(const VirtualTextureSystem&) = delete;
+
+    ~VirtualTextureSystem() {
+        if (loader.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            loader.join();
+        }
+        for (auto& source : sources)
+            close(source->fd);
+    }
+
+    // opens a .vt pyramid; returns its id, or -1 if the file is missing or doesn't match the cache
+    int Add(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return -1;
+        VtHeader header;
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            std::memcmp(header.magic, VT_MAGIC, 4) != 0 || header.levels > MAX_LEVELS ||
+            header.tileContent + 2 * header.border != PAGE_SIZE) {
+            std::cout << "Not a usable virtual texture: " << path << std::endl;
+            close(fd);
+            return -1;
+        }
+        if (!pageCache)
+            init();
+
+        std::unique_ptr<Source> source(new Source);
+        source->fd = fd;
+        source->layout.width = header.width;
+        source->layout.height = header.height;
+        source->layout.channels = header.channels;
+        source->layout.tileContent = header.tileContent;
+        source->layout.border = header.border;
+        source->layout.Compute();
+        if (source->layout.levels != header.levels) {
+            std::cout << "Corrupt virtual texture header: " << path << std::endl;
+            close(fd);
+            return -1;
+        }
+
+        const VtLayout& layout = source->layout;
+        uint32_t rows = 0;
+        for (uint32_t level = 0; level < layout.levels; ++level) {
+            source->levelRow[level] = (int)rows;
+            rows += layout.tilesY[level];
+        }
+        source->indirection.assign((size_t)layout.tilesX[0] * rows * 4, 0);
+        glGenTextures(1, &source->indirectionTexture);
+        glBindTexture(GL_TEXTURE_2D, source->indirectionTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, layout.tilesX[0], rows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        int id = (int)sources.size();
+        sources.push_back(std::move(source));
+
+        // the single tile of the coarsest level is the fallback for everything else
+        uint32_t top = layout.levels - 1;
+        LoadedTile tile = readTile(requestFor(id, top, 0, 0));
+        int slot = tile.ok ? allocatePage() : -1;
+        if (slot < 0) {
+            std::cout << "Could not load the base tile of " << path << std::endl;
+            glDeleteTextures(1, &sources.back()->indirectionTexture);
+            close(fd);
+            sources.pop_back();
+            return -1;
+        }
+        uploadPage(slot, tile);
+        pages[slot].pinned = true;
+        indirectionDirty = true;
+        updateIndirection();
+        return id;
+    }
+
+    size_t Count() const { return sources.size(); }
+
+    // redirects rendering into the feedback buffer; draw the virtually textured bodies with a
+    // shader using vtFeedbackFS and SetFeedbackUniforms, then call EndFeedback
+    void BeginFeedback(int screenWidth, int screenHeight) {
+        int w = std::max(1, screenWidth / feedbackDivisor), h = std::max(1, screenHeight / feedbackDivisor);
+        if (w != feedbackWidth || h != feedbackHeight)
+            resizeFeedback(w, h);
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+        glViewport(0, 0, w, h);
+        const GLuint nothing[4] = {0, 0, 0, 0};
+        glClearBufferuiv(GL_COLOR, 0, nothing);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // starts an asynchronous read-back of the feedback buffer; it is consumed a frame later
+    // so the CPU never waits for the GPU
+    void EndFeedback() {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[readbackIndex]);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readbackPixels[readbackIndex] = (size_t)feedbackWidth * feedbackHeight;
+        readbackIndex ^= 1;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    // processes the previous frame's feedback, queues missing tiles, uploads the tiles that
+    // finished loading and refreshes the indirection tables
+    void Update() {
+        ++frame;
+        std::vector<uint64_t> missing;
+        collectFeedback(missing);
+        requestTiles(missing);
+        uploadLoadedTiles();
+        updateIndirection();
+    }
+
+    // uniforms and textures for sampling (someFS); id < 0 disables virtual texturing for the
+    // next draw
+    void SetUniforms(Shader& shader, int id) {
+        shader.setBool("vtEnabled", id >= 0);
+        if (id < 0 || id >= (int)sources.size())
+            return;
+        const Source& source = *sources[id];
+        shader.setIVec2("vtSize", (int)source.layout.width, (int)source.layout.height);
+        shader.setInt("vtLevels", (int)source.layout.levels);
+        shader.setInt("vtTileContent", (int)source.layout.tileContent);
+        shader.setInt("vtBorder", (int)source.layout.border);
+        shader.setIntArray("vtLevelRow", source.levelRow, MAX_LEVELS);
+        shader.setFloat("vtCacheSize", (float)(pagesPerSide * PAGE_SIZE));
+
+        glActiveTexture(GL_TEXTURE0 + INDIRECTION_UNIT);
+        glBindTexture(GL_TEXTURE_2D, source.indirectionTexture);
+        glActiveTexture(GL_TEXTURE0 + PAGE_CACHE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, pageCache);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // uniforms for writing the feedback of virtual texture `id` (vtFeedbackFS)
+    void SetFeedbackUniforms(Shader& shader, int id) {
+        if (id < 0 || id >= (int)sources.size())
+            return;
+        const Source& source = *sources[id];
+        shader.setInt("vtId", id);
+        shader.setIVec2("vtSize", (int)source.layout.width, (int)source.layout.height);
+        shader.setInt("vtLevels", (int)source.layout.levels);
+        shader.setInt("vtTileContent", (int)source.layout.tileContent);
+        shader.setFloat("vtFeedbackBias", std::log2((float)feedbackDivisor));
+    }
+
+    // the integer and float samplers must never share a unit, even while unused
+    static void SetSamplerUnits(Shader& shader) {
+        shader.use();
+        shader.setInt("vtIndirection", INDIRECTION_UNIT);
+        shader.setInt("vtPageCache", PAGE_CACHE_UNIT);
+    }
+
+    // deletes the GL objects; call before the context goes away
+    void Release() {
+        for (auto& source : sources) {
+            glDeleteTextures(1, &source->indirectionTexture);
+            source->indirectionTexture = 0;
+        }
+        if (pageCache) {
+            glDeleteTextures(1, &pageCache);
+            glDeleteTextures(1, &feedbackColor);
+            glDeleteRenderbuffers(1, &feedbackDepth);
+            glDeleteFramebuffers(1, &feedbackFbo);
+            glDeleteBuffers(2, readback);
+            pageCache = 0;
+        }
+    }
+
+    size_t ResidentPages() const { return pageOf.size(); }
+    size_t PageCapacity() const { return pages.size(); }
+    size_t PendingTiles() const { return inFlight.size(); }
+    size_t CacheBytes() const { return pages.size() * PAGE_SIZE * PAGE_SIZE * 4; }
+
+private:
+    static const uint32_t PAGE_SIZE = 128;
+    static const size_t MAX_IN_FLIGHT = 64;
+    static const size_t MAX_UPLOADS_PER_FRAME = 16;
+    static const uint64_t NO_TILE = ~0ull;
+
+    struct Source {
+        int fd = -1;
+        VtLayout layout;
+        int levelRow[MAX_LEVELS] = {};
+        std::vector<uint8_t> indirection; // RGBA8UI: page x, page y, level of the page, 1
+        unsigned int indirectionTexture = 0;
+    };
+
+    struct Page {
+        uint64_t key = NO_TILE;
+        uint64_t lastUsed = 0;
+        bool pinned = false;
+    };
+
+    // everything the loader thread needs, so it never touches `sources`
+    struct TileRequest {
+        uint64_t key;
+        int fd;
+        off_t offset;
+        size_t bytes;
+        uint32_t channels;
+    };
+
+    struct LoadedTile {
+        uint64_t key = NO_TILE;
+        bool ok = false;
+        std::vector<unsigned char> rgba;
+    };
+
+    int pagesPerSide, feedbackDivisor;
+    std::vector<std::unique_ptr<Source>> sources;
+    std::vector<Page> pages;
+    std::unordered_map<uint64_t, int> pageOf;
+    std::unordered_set<uint64_t> inFlight;
+    std::vector<LoadedTile> loadedBacklog;
+    uint64_t frame = 0;
+    bool indirectionDirty = false;
+
+    unsigned int pageCache = 0;
+    unsigned int feedbackFbo = 0, feedbackColor = 0, feedbackDepth = 0;
+    unsigned int readback[2] = {0, 0};
+    size_t readbackPixels[2] = {0, 0};
+    int readbackIndex = 0;
+    int feedbackWidth = 0, feedbackHeight = 0;
+    GLint savedViewport[4] = {0, 0, 0, 0};
+
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<TileRequest> queue;
+    std::vector<LoadedTile> loaded;
+    bool stopping = false;
+
+    static uint64_t tileKey(int id, uint32_t level, uint32_t x, uint32_t y) {
+        return ((uint64_t)id << 48) | ((uint64_t)level << 40) | ((uint64_t)y << 20) | x;
+    }
+    static int keyId(uint64_t key) { return (int)(key >> 48); }
+    static uint32_t keyLevel(uint64_t key) { return (uint32_t)(key >> 40) & 0xFF; }
+    static uint32_t keyY(uint64_t key) { return (uint32_t)(key >> 20) & 0xFFFFF; }
+    static uint32_t keyX(uint64_t key) { return (uint32_t)key & 0xFFFFF; }
+
+    void init() {
+        pages.assign((size_t)pagesPerSide * pagesPerSide, Page());
+
+        glGenTextures(1, &pageCache);
+        glBindTexture(GL_TEXTURE_2D, pageCache);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, pagesPerSide * PAGE_SIZE, pagesPerSide * PAGE_SIZE, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        glGenFramebuffers(1, &feedbackFbo);
+        glGenTextures(1, &feedbackColor);
+        glGenRenderbuffers(1, &feedbackDepth);
+        glGenBuffers(2, readback);
+
+        loader = std::thread([this]() { loaderLoop(); });
+    }
+
+    void resizeFeedback(int w, int h) {
+        feedbackWidth = w;
+        feedbackHeight = h;
+        glBindTexture(GL_TEXTURE_2D, feedbackColor);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, w, h, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Virtual texture feedback framebuffer is incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        for (int i = 0; i < 2; ++i) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)w * h * 4 * sizeof(uint16_t), nullptr, GL_STREAM_READ);
+            readbackPixels[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // reads the older of the two feedback buffers: every texel names the tile it wants
+    // (x, y, level, id + 1). The tile and all its ancestors are marked as used.
+    void collectFeedback(std::vector<uint64_t>& missing) {
+        int index = readbackIndex; // the buffer written the frame before last
+        if (readbackPixels[index] == 0)
+            return;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[index]);
+        const uint16_t* texels = static_cast<const uint16_t*>(
+                glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readbackPixels[index] * 4 * sizeof(uint16_t), GL_MAP_READ_BIT));
+        if (texels) {
+            std::unordered_set<uint64_t> seen;
+            uint64_t previous = NO_TILE;
+            for (size_t i = 0; i < readbackPixels[index]; ++i) {
+                const uint16_t* t = &texels[i * 4];
+                if (t[3] == 0)
+                    continue;
+                int id = t[3] - 1;
+                if (id >= (int)sources.size())
+                    continue;
+                uint64_t key = tileKey(id, t[2], t[0], t[1]);
+                if (key == previous || !seen.insert(key).second)
+                    continue; // neighbouring texels mostly want the same tile
+                previous = key;
+                markWanted(id, t[2], t[0], t[1], missing);
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void markWanted(int id, uint32_t level, uint32_t x, uint32_t y, std::vector<uint64_t>& missing) {
+        const VtLayout& layout = sources[id]->layout;
+        for (; level < layout.levels; ++level, x /= 2, y /= 2) {
+            x = std::min(x, layout.tilesX[level] - 1);
+            y = std::min(y, layout.tilesY[level] - 1);
+            uint64_t key = tileKey(id, level, x, y);
+            auto it = pageOf.find(key);
+            if (it != pageOf.end()) {
+                if (pages[it->second].lastUsed == frame)
+                    return; // this tile's ancestors were handled already
+                pages[it->second].lastUsed = frame;
+            } else if (!inFlight.count(key)) {
+                missing.push_back(key);
+            }
+        }
+    }
+
+    TileRequest requestFor(int id, uint32_t level, uint32_t x, uint32_t y) const {
+        const VtLayout& layout = sources[id]->layout;
+        TileRequest request;
+        request.key = tileKey(id, level, x, y);
+        request.fd = sources[id]->fd;
+        request.offset = (off_t)(sizeof(VtHeader) + layout.TileIndex(level, x, y) * layout.TileBytes());
+        request.bytes = layout.TileBytes();
+        request.channels = layout.channels;
+        return request;
+    }
+
+    // coarse tiles first: they cover the most screen and unblock the finer ones' fallback
+    void requestTiles(std::vector<uint64_t>& missing) {
+        std::sort(missing.begin(), missing.end());
+        missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+        std::stable_sort(missing.begin(), missing.end(), [](uint64_t a, uint64_t b) {
+            return keyLevel(a) > keyLevel(b);
+        });
+
+        std::vector<TileRequest> requests;
+        for (uint64_t key : missing) {
+            if (inFlight.size() >= MAX_IN_FLIGHT)
+                break;
+            inFlight.insert(key);
+            requests.push_back(requestFor(keyId(key), keyLevel(key), keyX(key), keyY(key)));
+        }
+        if (requests.empty())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.insert(queue.end(), requests.begin(), requests.end());
+        }
+        wake.notify_one();
+    }
+
+    void uploadLoadedTiles() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (LoadedTile& tile : loaded)
+                loadedBacklog.push_back(std::move(tile));
+            loaded.clear();
+        }
+
+        size_t uploads = 0;
+        size_t i = 0;
+        for (; i < loadedBacklog.size() && uploads < MAX_UPLOADS_PER_FRAME; ++i) {
+            LoadedTile& tile = loadedBacklog[i];
+            inFlight.erase(tile.key);
+            if (!tile.ok || pageOf.count(tile.key))
+                continue;
+            int slot = allocatePage();
+            if (slot < 0)
+                continue; // every page is in use this frame; the tile is asked for again later
+            uploadPage(slot, tile);
+            pages[slot].lastUsed = frame;
+            ++uploads;
+        }
+        loadedBacklog.erase(loadedBacklog.begin(), loadedBacklog.begin() + i);
+    }
+
+    // a free page, or the least recently used one that wasn't needed this frame
+    int allocatePage() {
+        int best = -1;
+        for (int i = 0; i < (int)pages.size(); ++i) {
+            const Page& page = pages[i];
+            if (page.key == NO_TILE)
+                return i;
+            if (page.pinned || page.lastUsed == frame)
+                continue;
+            if (best < 0 || page.lastUsed < pages[best].lastUsed)
+                best = i;
+        }
+        if (best >= 0) {
+            pageOf.erase(pages[best].key);
+            pages[best] = Page();
+            indirectionDirty = true;
+        }
+        return best;
+    }
+
+    void uploadPage(int slot, const LoadedTile& tile) {
+        int px = slot % pagesPerSide, py = slot / pagesPerSide;
+        glBindTexture(GL_TEXTURE_2D, pageCache);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, px * PAGE_SIZE, py * PAGE_SIZE, PAGE_SIZE, PAGE_SIZE,
+                        GL_RGBA, GL_UNSIGNED_BYTE, tile.rgba.data());
+        pages[slot].key = tile.key;
+        pageOf[tile.key] = slot;
+        indirectionDirty = true;
+    }
+
+    // resolves every tile of every level to itself if resident, otherwise to whatever its
+    // parent resolves to. Rebuilt whole: the tables are a few tens of KB.
+    void updateIndirection() {
+        if (!indirectionDirty)
+            return;
+        indirectionDirty = false;
+        for (size_t id = 0; id < sources.size(); ++id) {
+            Source& source = *sources[id];
+            const VtLayout& layout = source.layout;
+            const uint32_t stride = layout.tilesX[0];
+            for (uint32_t level = layout.levels; level-- > 0;) {
+                for (uint32_t y = 0; y < layout.tilesY[level]; ++y) {
+                    for (uint32_t x = 0; x < layout.tilesX[level]; ++x) {
+                        uint8_t* entry = &source.indirection[((size_t)(source.levelRow[level] + y) * stride + x) * 4];
+                        auto it = pageOf.find(tileKey((int)id, level, x, y));
+                        if (it != pageOf.end()) {
+                            entry[0] = (uint8_t)(it->second % pagesPerSide);
+                            entry[1] = (uint8_t)(it->second / pagesPerSide);
+                            entry[2] = (uint8_t)level;
+                            entry[3] = 1;
+                        } else if (level + 1 < layout.levels) {
+                            uint32_t parentX = std::min(x / 2, layout.tilesX[level + 1] - 1);
+                            uint32_t parentY = std::min(y / 2, layout.tilesY[level + 1] - 1);
+                            const uint8_t* parent = &source.indirection[
+                                    ((size_t)(source.levelRow[level + 1] + parentY) * stride + parentX) * 4];
+                            std::memcpy(entry, parent, 4);
+                        }
+                    }
+                }
+            }
+            GLsizei rows = (GLsizei)(source.indirection.size() / 4 / stride);
+            glBindTexture(GL_TEXTURE_2D, source.indirectionTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, stride, rows, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                            source.indirection.data());
+        }
+    }
+
+    // reads one tile and widens it to RGBA, the page cache format
+    static LoadedTile readTile(const TileRequest& request) {
+        LoadedTile tile;
+        tile.key = request.key;
+        std::vector<unsigned char> raw(request.bytes);
+        if (pread(request.fd, raw.data(), raw.size(), request.offset) != (ssize_t)raw.size())
+            return tile;
+
+        const size_t texels = request.bytes / request.channels;
+        tile.rgba.resize(texels * 4);
+        for (size_t i = 0; i < texels; ++i) {
+            const unsigned char* in = &raw[i * request.channels];
+            unsigned char* out = &tile.rgba[i * 4];
+            if (request.channels >= 3) {
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                out[3] = request.channels == 4 ? in[3] : 255;
+            } else {
+                out[0] = out[1] = out[2] = in[0];
+                out[3] = request.channels == 2 ? in[1] : 255;
+            }
+        }
+        tile.ok = true;
+        return tile;
+    }
+
+    void loaderLoop() {
+        for (;;) {
+            TileRequest request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+                request = queue.front();
+                queue.pop_front();
+            }
+            LoadedTile tile = readTile(request);
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.push_back(std::move(tile));
+        }
+    }
+};
+
+#endif //SOLAR_SYSTEM_VIRTUAL_TEXTURE_H
@@ -0,0 +1,14 @@
+#version 450 core
+
+// Resamples a surface map into a SurfaceAtlas layer. The source's mip chain is sampled
+// trilinearly at the layer's size, so shrinking a map doesn't alias.
+
+in vec2 TexCoords;
+
+out vec4 FragColor;
+
+uniform sampler2D source;
+
+void main() {
+    FragColor = texture(source, TexCoords);
+}
\ No newline at end of file
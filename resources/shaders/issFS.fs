@@ -46,9 +46,19 @@ struct SpotLight {
 
 
 uniform Material material;
-uniform PointLight light;
-uniform SpotLight spotLight;
-uniform vec3 ViewPos;
+// per-frame camera data, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 0) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 ViewPos;
+    float time;
+};
+
+// the sun and the flashlight, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 1) uniform Lights {
+    PointLight light;
+    SpotLight spotLight;
+};
 
 vec4 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec4 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
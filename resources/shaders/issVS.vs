@@ -4,8 +4,13 @@ layout(location = 1) in vec3 aNorm;
 layout(location = 2) in vec2 aTex;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame camera data, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 0) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 ViewPos;
+    float time;
+};
 
 out vec2 TexCoords;
 out vec3 Normal;
@@ -1,13 +1,19 @@
-#version 330 core
+#version 450 core
 layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// per-frame camera data, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 0) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 ViewPos;
+    float time;
+};
 
 void main() {
     TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
+    // the sky doesn't move with the camera, only turns
+    vec4 pos = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
     gl_Position = pos.xyww;
 }
\ No newline at end of file
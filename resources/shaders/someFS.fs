@@ -4,17 +4,18 @@ in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
+// the body's material, from its instance (see someVS)
+flat in vec3 MaterialAmbient;
+flat in vec3 MaterialDiffuse;
+flat in vec3 MaterialSpecular;
+flat in float MaterialShininess;
+flat in ivec2 SurfaceLayer; // tier, layer in the surface atlas; x < 0 falls back to material.texture_diffuse1
+
 out vec4 FragColor;
 
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float shininess;
 };
 
 struct PointLight {
@@ -47,17 +48,51 @@ struct SpotLight {
 
 
 uniform Material material;
-uniform PointLight light;
-uniform SpotLight spotLight;
-uniform vec3 ViewPos;
+// per-frame camera data, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 0) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 ViewPos;
+    float time;
+};
+
+// the sun and the flashlight, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 1) uniform Lights {
+    PointLight light;
+    SpotLight spotLight;
+};
 
 uniform samplerCube depthMap;
 
+// sparse virtual texture replacing material.texture_diffuse1 on the big planet maps
+uniform bool vtEnabled;
+uniform usampler2D vtIndirection; // per tile: page x, page y, level of that page
+uniform sampler2D vtPageCache;
+uniform ivec2 vtSize;
+uniform int vtLevels;
+uniform int vtTileContent;
+uniform int vtBorder;
+uniform int vtLevelRow[16];
+uniform float vtCacheSize;
+
+// every planet's surface map, packed into one array per size (see surface_atlas.h)
+uniform sampler2DArray surfaceAtlas[3];
+
+vec3 albedo;
+
 vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 float ShadowCalculation(vec3 fragPos);
+vec4 SampleVirtualTexture(vec2 uv);
 
 void main() {
+    if (vtEnabled)
+        albedo = SampleVirtualTexture(TexCoords).rgb;
+    else if (SurfaceLayer.x >= 0)
+        albedo = texture(surfaceAtlas[SurfaceLayer.x], vec3(TexCoords, float(SurfaceLayer.y))).rgb;
+    else
+        albedo = texture(material.texture_diffuse1, TexCoords).rgb;
+
     vec3 normal = normalize(Normal);
     vec3 ViewDir = normalize(ViewPos - FragPos);
     vec3 result = CalculateSpotLight(spotLight, normal, FragPos, ViewDir);
@@ -68,15 +103,15 @@ void main() {
 
 vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     // ambient
-    vec3 Ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords)) * material.ambient;
+    vec3 Ambient = light.ambient * albedo * MaterialAmbient;
     // diffuse
     vec3 lDir = normalize(light.position - fragPos);
     float diff = max(dot(normal, lDir), 0.0f);
-    vec3 Diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords)) * material.diffuse;
+    vec3 Diffuse = light.diffuse * diff * albedo * MaterialDiffuse;
     // specular
     vec3 halfwayDir = normalize(lDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0f), material.shininess);
-    vec3 Specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords)) * material.specular;
+    float spec = pow(max(dot(normal, halfwayDir), 0.0f), MaterialShininess);
+    vec3 Specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords)) * MaterialSpecular;
 
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear*distance + light.quadratic*(distance*distance));
@@ -92,18 +127,18 @@ vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewD
 
 vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     // ambient
-    vec3 Ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords)) * material.ambient;
+    vec3 Ambient = light.ambient * albedo * MaterialAmbient;
 
     // diffuse
     vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 Diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords)) * material.diffuse;
+    vec3 Diffuse = light.diffuse * diff * albedo * MaterialDiffuse;
 
 
     // specular
     vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    vec3 Specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords)) * material.specular;
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), MaterialShininess);
+    vec3 Specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords)) * MaterialSpecular;
 
 
     // attenuation
@@ -123,6 +158,33 @@ vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir
     return (Ambient + Diffuse + Specular);
 }
 
+vec4 SampleVirtualTexture(vec2 uv) {
+    vec2 texel = uv * vec2(vtSize);
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    int level = clamp(int(floor(lod)), 0, vtLevels - 1);
+
+    uv = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0));
+    ivec2 levelSize = max(vtSize >> level, ivec2(1));
+    ivec2 tiles = (levelSize + vtTileContent - 1) / vtTileContent;
+    ivec2 tile = clamp(ivec2(uv * vec2(levelSize)) / vtTileContent, ivec2(0), tiles - 1);
+    uvec4 entry = texelFetch(vtIndirection, ivec2(tile.x, vtLevelRow[level] + tile.y), 0);
+
+    // the entry may point at a coarser ancestor; locate uv inside that level's tile
+    int resident = int(entry.b);
+    ivec2 residentSize = max(vtSize >> resident, ivec2(1));
+    vec2 inLevel = uv * vec2(residentSize);
+    ivec2 residentTiles = (residentSize + vtTileContent - 1) / vtTileContent;
+    // the same walk up the pyramid the CPU side does when filling the table
+    ivec2 residentTile = min(tile >> (resident - level), residentTiles - 1);
+    vec2 inTile = inLevel - vec2(residentTile * vtTileContent);
+    inTile = clamp(inTile, vec2(0.5 - float(vtBorder)), vec2(float(vtTileContent + vtBorder) - 0.5));
+
+    float pageSize = float(vtTileContent + 2 * vtBorder);
+    vec2 pageTexel = vec2(entry.rg) * pageSize + float(vtBorder) + inTile;
+    return textureLod(vtPageCache, pageTexel / vtCacheSize, 0.0);
+}
+
 float ShadowCalculation(vec3 fragPos) {
     // get vector between fragment position and light position
     vec3 fragToLight = FragPos - light.position;
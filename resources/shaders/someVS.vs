@@ -3,17 +3,42 @@ layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNorm;
 layout(location = 2) in vec2 aTex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per instance, one body each (see instance.h)
+layout(location = 5) in mat4 iModel;
+layout(location = 9) in vec3 iAmbient;
+layout(location = 10) in vec3 iDiffuse;
+layout(location = 11) in vec3 iSpecular;
+layout(location = 12) in float iShininess;
+layout(location = 13) in ivec2 iSurfaceLayer;
+
+// per-frame camera data, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 0) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 ViewPos;
+    float time;
+};
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
+// the instance's material, for the fragment shader
+flat out vec3 MaterialAmbient;
+flat out vec3 MaterialDiffuse;
+flat out vec3 MaterialSpecular;
+flat out float MaterialShininess;
+flat out ivec2 SurfaceLayer;
+
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0f));
+    FragPos = vec3(iModel * vec4(aPos, 1.0f));
     TexCoords = aTex;
-    Normal = mat3(transpose(inverse(model))) * aNorm;
+    Normal = mat3(transpose(inverse(iModel))) * aNorm;
     gl_Position =  projection * view * vec4(FragPos, 1.0f);
+
+    MaterialAmbient = iAmbient;
+    MaterialDiffuse = iDiffuse;
+    MaterialSpecular = iSpecular;
+    MaterialShininess = iShininess;
+    SurfaceLayer = iSurfaceLayer;
 }
\ No newline at end of file
@@ -39,25 +39,50 @@ in vec3 Normal;
 out vec4 FragColor;
 
 uniform Material material;
-uniform vec3 ViewPos;
-uniform PointLight light;
-uniform SpotLight spotLight;
+// the flashlight's glow on the sun, which ignores spotLight.ambient
+uniform vec3 flashlightAmbient;
+
+// the sun's surface map in the planets' atlas (see surface_atlas.h); x < 0 falls back to
+// material.texture_diffuse1
+uniform sampler2DArray surfaceAtlas[3];
+uniform ivec2 surfaceLayer;
+
+// per-frame camera data, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 0) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec3 ViewPos;
+    float time;
+};
+
+// the sun and the flashlight, shared by every program (see frame_uniforms.h)
+layout(std140, binding = 1) uniform Lights {
+    PointLight light;
+    SpotLight spotLight;
+};
+
+vec3 albedo;
 
 vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 
 void main() {
+    if (surfaceLayer.x >= 0)
+        albedo = texture(surfaceAtlas[surfaceLayer.x], vec3(TexCoords, float(surfaceLayer.y))).rgb;
+    else
+        albedo = texture(material.texture_diffuse1, TexCoords).rgb;
+
     vec3 normal = normalize(Normal);
     vec3 ViewDir = normalize(ViewPos - FragPos);
     vec3 result = CalculateSpotLight(spotLight, normal, FragPos, ViewDir);
-    result += vec3(texture(material.texture_diffuse1, TexCoords));
+    result += albedo;
     FragColor = vec4(result, 1.0f);
 }
 
 
 vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     // ambient
-    vec3 Ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
+    vec3 Ambient = flashlightAmbient * albedo;
 
 
     // spotlight strength
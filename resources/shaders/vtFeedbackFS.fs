@@ -0,0 +1,29 @@
+#version 450 core
+
+// Virtual texture feedback: writes which tile (x, y, mip level) of which virtual texture
+// every fragment would like to sample. Rendered at a fraction of the screen size, so the
+// mip level is computed with vtFeedbackBias subtracted to match the full size frame.
+
+in vec2 TexCoords;
+
+out uvec4 Feedback;
+
+uniform int vtId;
+uniform ivec2 vtSize;
+uniform int vtLevels;
+uniform int vtTileContent;
+uniform float vtFeedbackBias;
+
+void main() {
+    vec2 texel = TexCoords * vec2(vtSize);
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) - vtFeedbackBias;
+    int level = clamp(int(floor(lod)), 0, vtLevels - 1);
+
+    vec2 uv = vec2(fract(TexCoords.x), clamp(TexCoords.y, 0.0, 1.0));
+    ivec2 levelSize = max(vtSize >> level, ivec2(1));
+    ivec2 tiles = (levelSize + vtTileContent - 1) / vtTileContent;
+    ivec2 tile = clamp(ivec2(uv * vec2(levelSize)) / vtTileContent, ivec2(0), tiles - 1);
+
+    Feedback = uvec4(uvec2(tile), uint(level), uint(vtId + 1));
+}
@@ -0,0 +1,66 @@
+#include <cstdlib>
+#include <new>
+
+#include "alloc_stats.h"
+
+// Replacement global allocation functions that count every operator new. Plain malloc/free
+// underneath, so the only cost is two relaxed atomic adds (and two thread-local ones) per
+// allocation.
+
+namespace {
+
+void* countedAlloc(std::size_t size) {
+  AllocationCounter& counter = Allocations();
+  counter.count.fetch_add(1, std::memory_order_relaxed);
+  counter.bytes.fetch_add(size, std::memory_order_relaxed);
+  ThreadAllocationCounter& thread = ThreadAllocations();
+  ++thread.count;
+  thread.bytes += size;
+  return std::malloc(size ? size : 1);
+}
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  void* p = countedAlloc(size);
+  if (!p) {
+	throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
@@ -1,6 +1,10 @@
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
@@ -8,10 +12,25 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "stb_image.h"
+#include "imgui.h"
+#include "imgui_impl_glfw.h"
+#include "imgui_impl_opengl3.h"
 
+#include "alloc_stats.h"
+#include "asset_pack.h"
 #include "camera.h"
+#include "cooked_cubemap.h"
+#include "frame_uniforms.h"
+#include "frustum.h"
+#include "instance_batcher.h"
+#include "lazy_model.h"
+#include "load_report.h"
 #include "model.h"
+#include "render_queue.h"
+#include "render_stats.h"
 #include "shader.h"
+#include "surface_atlas.h"
+#include "virtual_texture.h"
 
 struct Orb {
   glm::vec3 Position = glm::vec3(0.0f);
@@ -29,6 +48,10 @@ struct Orb {
   float RotationSpeed = 0.0f;
   float RevolutionSpeed = 0.0f;
   float RevolutionSmallSpeed = 0.0f;
+  // degrees per second; animateOrb turns them into the angles above
+  float RotationRate = 0.0f;
+  float RevolutionRate = 0.0f;
+  float RevolutionSmallRate = 0.0f;
   int RevolutionNr = 0;
 };
 
@@ -53,12 +76,40 @@ struct SpotLight {
   float OuterCutoff = 1.0f;
 };
 
+// the uniforms set for every body each frame, resolved once per program (see
+// orbUniforms); the camera and the lights are in the Frame and Lights blocks
+struct OrbUniforms {
+  Uniform<glm::mat4> model;
+  bool lit = false;	 // whether the material uniforms below are resolved
+  Uniform<glm::vec3> materialAmbient, materialDiffuse, materialSpecular;
+  Uniform<float> materialShininess;
+};
+
+// something the render loop draws: the orb it moves, the model it draws
+// there and the program it's drawn with; every body goes through the same
+// steps, so adding one doesn't touch the loop
+struct Body {
+  Orb* orb;
+  LazyModel* model;
+  Shader* shader;
+  bool emissive = false;  // unlit (the sun); lit bodies take virtual textures
+  int virtualTexture = -1;
+  size_t instance = 0;	// this frame's, in the InstanceBatcher (lit bodies)
+};
+
 Camera cam;
 
 int SCR_WIDTH = 800, SCR_HEIGHT = 600;
 float prevX = SCR_WIDTH / 2.0;
 float prevY = SCR_HEIGHT / 2.0;
 bool flashlightOn = false;
+bool hudOn = true;
+// how far ahead (in seconds of camera movement) models start loading
+const float PREFETCH_SECONDS = 3.0f;
+// the projection's far plane, also the depth range of the render queue's keys
+const float FAR_PLANE = 1000.0f;
+// what solar_cook calls the skybox cube map
+const char* const SKYBOX_NAME = "resources/textures/skybox";
 
 glm::vec3 issPos;
 
@@ -67,23 +118,78 @@ void processInput(GLFWwindow* window);
 void cursorPositionCallback(GLFWwindow* window, double posX, double posY);
 void scrollCallback(GLFWwindow* window, double offsetX, double offsetY);
 void frameBufferSizeCallback(GLFWwindow* window, int width, int height);
-void setUpOrbData(Orb& o,
-				  Shader& s,
-				  PointLight& pl,
-				  SpotLight& sl,
-				  bool depth = false);
+void setUpOrbData(Orb& o, Shader& s, bool depth = false);
+void updateOrbit(Orb& o);
+void animateOrb(Orb& o, float seconds);
 void keyCallback(GLFWwindow* window,
 				 int key,
 				 int scancode,
 				 int action,
 				 int mod);
-auto loadTexture(const char* path) -> unsigned;
+auto loadTexture(const char* path, bool srgb = true) -> unsigned;
 unsigned int loadSkybox(std::vector<std::string>& faces);
 auto setUpTheISS() -> unsigned;
 auto setUpTheSkybox() -> unsigned;
-void setSpotlight(Shader& s, SpotLight& sl);
+auto pointLightBlock(const PointLight& pl) -> PointLightBlock;
+auto spotLightBlock(const SpotLight& sl) -> SpotLightBlock;
+auto orbUniforms(const Shader& s, bool lit) -> const OrbUniforms&;
+auto pixelsPerModelUnit(const Orb& o) -> float;
+auto orbModelMatrix(const Orb& o) -> glm::mat4;
+auto orbInstance(const Orb& o, const LazyModel& m) -> InstanceData;
+void drawHud(float frameMs, const VirtualTextureSystem& vt);
+
+// totals collected in --benchmark mode, averaged and printed on exit
+struct BenchmarkTotals {
+  int frames = 0;
+  double frameMs = 0.0;
+  size_t trianglesDrawn = 0;
+  size_t trianglesFullDetail = 0;
+  size_t drawCalls = 0;
+  size_t uniformCalls = 0;
+};
+void printBenchmark(const BenchmarkTotals& b);
+void writeLoadReport();
+
+auto main(int argc, char** argv) -> int {
+  auto launchTime = std::chrono::steady_clock::now();
+  // --benchmark N renders N frames as fast as possible and prints per-frame
+  // averages
+  int benchmarkFrames = 0;
+  for (int i = 1; i < argc; i++) {
+	if (std::strcmp(argv[i], "--benchmark") == 0) {
+	  benchmarkFrames = i + 1 < argc ? std::atoi(argv[i + 1]) : 1000;
+	}
+	// --build-vt <image> <out.vt> cuts a (16K+) surface map into a virtual
+	// texture tile pyramid and exits
+	if (std::strcmp(argv[i], "--build-vt") == 0 && i + 2 < argc) {
+	  return BuildVirtualTexture(argv[i + 1], argv[i + 2]) ? 0 : 1;
+	}
+	// --cooked loads only solar_cook's outputs (always on in release builds)
+	if (std::strcmp(argv[i], "--cooked") == 0) {
+	  UseCookedAssets() = true;
+	}
+	// --texture-budget MB caps texture memory; mips are dropped to stay under
+	if (std::strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+	  TextureCache::Instance().SetBudget((size_t)std::atoi(argv[i + 1]) << 20);
+	}
+	// --decode-memory MB caps what decoded images may hold until they are uploaded
+	if (std::strcmp(argv[i], "--decode-memory") == 0 && i + 1 < argc) {
+	  DecodeMemoryGate::Instance().SetCeiling((size_t)std::atoi(argv[i + 1])
+											  << 20);
+	}
+	// --no-io-uring reads asset batches on threads instead of through io_uring
+	if (std::strcmp(argv[i], "--no-io-uring") == 0) {
+	  BatchIoUseUring() = false;
+	}
+  }
+  // cooked assets come from solar_cook's pack when there is one, loose files
+  // otherwise
+  if (UseCookedAssets() && AssetPack::Mounted().Open(ASSET_PACK_PATH)) {
+	std::cout << "Mounted " << ASSET_PACK_PATH << ": "
+			  << AssetPack::Mounted().Files() << " files, "
+			  << AssetPack::Mounted().MappedBytes() / (1024 * 1024) << " MB\n";
+  }
 
-auto main() -> int {
   // init
   int initStatus = glfwInit();
   assert(initStatus == GLFW_TRUE);
@@ -109,6 +215,17 @@ auto main() -> int {
 	return -1;
   }
 
+  if (benchmarkFrames > 0) {
+	glfwSwapInterval(0);
+  }
+
+  // ---- HUD ----
+  //--------------
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGui_ImplGlfw_InitForOpenGL(window, false);
+  ImGui_ImplOpenGL3_Init("#version 450 core");
+
   // ---- CALLBACKS ----
   //--------------------
   glfwSetFramebufferSizeCallback(window, frameBufferSizeCallback);
@@ -116,29 +233,84 @@ auto main() -> int {
   glfwSetScrollCallback(window, scrollCallback);
   glfwSetKeyCallback(window, keyCallback);
 
-  // configure global opengl state
+  // configure global opengl state; this is also the state the render queue
+  // expects between frames
   glEnable(GL_DEPTH_TEST);
+  glEnable(GL_CULL_FACE);
+  glCullFace(GL_BACK);
+
+  // faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order; cooked together as
+  // SKYBOX_NAME (see resources/assets.txt)
+  std::vector<std::string> faces{
+	  "resources/textures/front.png", "resources/textures/back.png",
+	  "resources/textures/up.png",	  "resources/textures/down.png",
+	  "resources/textures/right.png", "resources/textures/left.png"};
+
+  // the programs built at startup, each with the uniforms set on it, which are
+  // checked right after linking
+  const ShaderSources sunProgram = {
+	  "resources/shaders/sunVS.vs", "resources/shaders/sunFS.fs",
+	  {"model", "material.ambient", "material.diffuse", "material.specular",
+	   "material.shininess", "flashlightAmbient", "surfaceAtlas",
+	   "surfaceLayer"}};
+  const ShaderSources issProgram = {
+	  "resources/shaders/issVS.vs", "resources/shaders/issFS.fs",
+	  {"model", "material.texture_diffuse", "material.texture_specular",
+	   "material.ambient", "material.diffuse", "material.specular",
+	   "material.shininess"}};
+  const ShaderSources skyboxProgram = {"resources/shaders/skyboxVS.vs",
+									   "resources/shaders/skyboxFS.fs",
+									   {"skybox"}};
+  const ShaderSources orbProgram = {
+	  "resources/shaders/someVS.vs", "resources/shaders/someFS.fs",
+	  {"vtEnabled", "vtIndirection", "vtPageCache", "vtSize", "vtLevels",
+	   "vtTileContent", "vtBorder", "vtLevelRow", "vtCacheSize",
+	   "surfaceAtlas"}};
+  const ShaderSources vtFeedbackProgram = {
+	  "resources/shaders/someVS.vs", "resources/shaders/vtFeedbackFS.fs",
+	  {"vtId", "vtSize", "vtLevels", "vtTileContent", "vtFeedbackBias"}};
+
+  // their sources and the skybox are read in one batch before any of them is
+  // needed
+  {
+	const ShaderSources* const startupPrograms[] = {
+		&sunProgram, &issProgram, &skyboxProgram, &orbProgram,
+		&vtFeedbackProgram, &SurfaceAtlas::CopyProgram()};
+	// a source two programs share (someVS.vs) is staged for each of them; it's
+	// read once and kept until both have opened it
+	std::vector<std::string> startupFiles;
+	for (const ShaderSources* program : startupPrograms) {
+	  startupFiles.push_back(program->vertex);
+	  startupFiles.push_back(program->fragment);
+	  if (UseCookedAssets()) {
+		startupFiles.push_back(
+			CookedShaderPath(program->vertex, program->fragment, ""));
+	  }
+	}
+	if (UseCookedAssets()) {
+	  startupFiles.push_back(CookedCubemapPath(SKYBOX_NAME));
+	} else {
+	  startupFiles.insert(startupFiles.end(), faces.begin(), faces.end());
+	}
+	AssetReadAhead::Instance().Stage(startupFiles);
+  }
 
   // ---- SHADERS ----
   //------------------
-  Shader sunShader("resources/shaders/sunVS.vs", "resources/shaders/sunFS.fs");
-  Shader issShader("resources/shaders/issVS.vs", "resources/shaders/issFS.fs");
-  Shader skyboxShader("resources/shaders/skyboxVS.vs",
-					  "resources/shaders/skyboxFS.fs");
-  Shader orbShader("resources/shaders/someVS.vs",
-				   "resources/shaders/someFS.fs");
+  Shader sunShader(sunProgram);
+  Shader issShader(issProgram);
+  Shader skyboxShader(skyboxProgram);
+  Shader orbShader(orbProgram);
+  Shader vtFeedbackShader(vtFeedbackProgram);
   //    Shader orbDepthShader("resources/shaders/orbDepthVS.vs",
   //    "resources/shaders/orbDepthFS.fs", "resources/shaders/orbDepthGS.gs");
 
   // ---- SKYBOX ----
   //-----------------
-  std::vector<std::string> faces{
-	  "resources/textures/front.png", "resources/textures/back.png",
-	  "resources/textures/up.png",	  "resources/textures/down.png",
-	  "resources/textures/right.png", "resources/textures/left.png"};
-
   unsigned skyboxTexture = loadSkybox(faces);
   unsigned skyboxVAO = setUpTheSkybox();
+  // filtering across face edges, which the smaller mips would otherwise show
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
   skyboxShader.use();
   skyboxShader.setInt("skybox", 0);
@@ -147,55 +319,100 @@ auto main() -> int {
   //----------------------
   PointLight sunlight;
   SpotLight flashlight;
+  // camera and lights for every program, written once a frame
+  FrameUniforms frameUniforms;
 
   // ---- MODELS ----
   //-----------------
+  // loaded surface maps are copied into one set of texture arrays, so the
+  // bodies are drawn without binding textures of their own
+  SurfaceAtlas surfaceAtlas;
+  SurfaceAtlas::SetSamplerUnits(sunShader);
+  SurfaceAtlas::SetSamplerUnits(orbShader);
+
+  // every body is the shared procedural sphere with its own surface map; the
+  // maps load in the background once the body comes into view, and the sphere
+  // is drawn in the given colour until then (or if the map is missing)
   // SUN
-  Model sunModel("resources/objects/Sun/Sun.obj");
+  LazyModel sunModel(
+	  SphereSurface{"resources/objects/Sun", {{"texture_diffuse", "Sun.jpg"}}},
+	  glm::vec3(1.0f, 0.8f, 0.35f));
   sunModel.SetShaderTextureNamePrefix("material.");
+  sunModel.SetSurfaceAtlas(&surfaceAtlas);
 
   // MERCURY
-  Model mercuryModel("resources/objects/Mercury/source/Mercury/Mercury.FBX");
+  LazyModel mercuryModel(
+	  SphereSurface{"resources/objects/Mercury/textures",
+					{{"texture_diffuse", "Mercury_Tex.jpeg"}}},
+	  glm::vec3(0.55f, 0.52f, 0.5f));
   mercuryModel.SetShaderTextureNamePrefix("material.");
+  mercuryModel.SetSurfaceAtlas(&surfaceAtlas);
 
   // VENUS
-  Model venusModel("resources/objects/Venus/Sun.obj");
+  LazyModel venusModel(
+	  SphereSurface{"resources/objects/Venus", {{"texture_diffuse", "Sun.jpg"}}},
+	  glm::vec3(0.9f, 0.78f, 0.55f));
   venusModel.SetShaderTextureNamePrefix("material.");
+  venusModel.SetSurfaceAtlas(&surfaceAtlas);
 
   // EARTH
-  Model earthModel("resources/objects/Earth/Earth.obj");
+  LazyModel earthModel(SphereSurface{"resources/objects/Earth",
+									 {{"texture_diffuse", "Earth.bmp"}}},
+					   glm::vec3(0.25f, 0.4f, 0.7f));
   earthModel.SetShaderTextureNamePrefix("material.");
+  earthModel.SetSurfaceAtlas(&surfaceAtlas);
 
   // MOON
-  Model moonModel("resources/objects/Moon/Moon.obj");
+  LazyModel moonModel(
+	  SphereSurface{"resources/objects/Moon", {{"texture_diffuse", "Moon.jpg"}}},
+	  glm::vec3(0.6f, 0.6f, 0.6f));
   moonModel.SetShaderTextureNamePrefix("material.");
+  moonModel.SetSurfaceAtlas(&surfaceAtlas);
 
   // MARS
-  Model marsModel("resources/objects/MarsPlanet/MarsPlanet.obj");
+  LazyModel marsModel(SphereSurface{"resources/objects/MarsPlanet",
+									{{"texture_diffuse", "Planet_Wight_1600.jpg"}}},
+					  glm::vec3(0.75f, 0.35f, 0.2f));
   marsModel.SetShaderTextureNamePrefix("material.");
+  marsModel.SetSurfaceAtlas(&surfaceAtlas);
 
   // JUPITER
-  Model jupiterModel(
-	  "resources/objects/Jupiter/"
-	  "Jupiter_v1_L3.123c7d3fa769-8754-46f9-8dde-2a1db30a7c4e/"
-	  "13905_Jupiter_V1_l3.obj");
+  LazyModel jupiterModel(
+	  SphereSurface{"resources/objects/Jupiter/"
+					"Jupiter_v1_L3.123c7d3fa769-8754-46f9-8dde-2a1db30a7c4e",
+					{{"texture_diffuse", "Jupiter_diff.jpg"}}},
+	  glm::vec3(0.8f, 0.7f, 0.55f));
   jupiterModel.SetShaderTextureNamePrefix("material.");
+  jupiterModel.SetSurfaceAtlas(&surfaceAtlas);
+
+  // ---- VIRTUAL TEXTURES ----
+  //---------------------------
+  // high resolution surfaces are streamed in as tiles when a pyramid built
+  // with --build-vt exists; otherwise the model's own diffuse map is used
+  VirtualTextureSystem virtualTextures;
+  int earthVt = virtualTextures.Add("resources/objects/Earth/Earth.vt");
+  int marsVt = virtualTextures.Add("resources/objects/MarsPlanet/Mars.vt");
+  VirtualTextureSystem::SetSamplerUnits(orbShader);
 
   // ---- ORBS ----
   //---------------
+  // Size is the radius in world units (the shared sphere has radius 1)
   // EARTH
   Orb earth;
-  earth.Size = glm::vec3(0.2);
+  earth.Size = glm::vec3(1.5f);
   earth.Position = glm::vec3(0.0f, 0.0f, 10.0f);
   earth.RotationAxis = glm::vec3(0.5f, 1.0f, 0.0f);
+  earth.RotationRate = 30.0f;
 
   // MOON
   Orb moon;
   moon.Position = glm::vec3(20.0f, 0.0f, 0.0f);
   moon.RevolutionRadius = glm::vec2(moon.Position.x);
-  moon.Size = glm::vec3(0.04);
+  moon.Size = glm::vec3(0.4f);
   moon.RevolutionNr = 1;
   moon.RotationAxis = glm::vec3(0.11f, 1.0f, 0.0f);
+  moon.RotationRate = -10.0f;
+  moon.RevolutionRate = 10.5f;
 
   // MERCURY
   Orb mercury;
@@ -205,9 +422,12 @@ auto main() -> int {
 	  mercury.RevolutionCenterSmall.x + mercury.RevolutionRadiusSmall.x,
 	  mercury.RevolutionCenterSmall.y, mercury.RevolutionCenterSmall.z);
   mercury.RevolutionRadius = glm::vec2(mercury.RevolutionCenterSmall.x);
-  mercury.Size = glm::vec3(0.01f);
+  mercury.Size = glm::vec3(0.6f);
   mercury.RevolutionNr = 2;
   mercury.RotationAxis = glm::vec3(0.08f, 1.0f, 0.0f);
+  mercury.RotationRate = 2.0f;
+  mercury.RevolutionRate = 5.0f;
+  mercury.RevolutionSmallRate = 30.0f;
 
   // VENUS
   Orb venus;
@@ -217,17 +437,22 @@ auto main() -> int {
 	  glm::vec3(venus.RevolutionCenterSmall.x + venus.RevolutionRadiusSmall.x,
 				venus.RevolutionCenterSmall.y, venus.RevolutionCenterSmall.z);
   venus.RevolutionRadius = glm::vec2(venus.RevolutionCenterSmall.x);
-  venus.Size = glm::vec3(0.1);
+  venus.Size = glm::vec3(1.0f);
   venus.RevolutionNr = 2;
   venus.RotationAxis = glm::vec3(0.09f, -1.0f, 0.0f);
+  venus.RotationRate = 0.2f;
+  venus.RevolutionRate = 2.0f;
+  venus.RevolutionSmallRate = 20.0f;
 
   // SUN
   Orb sun;
   sun.Position = glm::vec3(120.0f, 0.0f, 0.0f);
   sun.RevolutionRadius = glm::vec2(sun.Position.x);
-  sun.Size = glm::vec3(0.7);
+  sun.Size = glm::vec3(10.0f);
   sun.RevolutionNr = 1;
   sun.RotationAxis = glm::vec3(0.2f, 1.0f, 0.0f);
+  sun.RotationRate = 2.0f;
+  sun.RevolutionRate = 5.0f;
 
   // MARS
   Orb mars;
@@ -237,9 +462,12 @@ auto main() -> int {
 	  glm::vec3(mars.RevolutionCenterSmall.x + mars.RevolutionRadiusSmall.x,
 				mars.RevolutionCenterSmall.y, mars.RevolutionCenterSmall.z);
   mars.RevolutionRadius = glm::vec2(mars.RevolutionCenterSmall.x);
-  mars.Size = glm::vec3(0.08);
+  mars.Size = glm::vec3(1.2f);
   mars.RevolutionNr = 2;
   mars.RotationAxis = glm::vec3(0.6f, 1.0f, 0.0f);
+  mars.RotationRate = 20.0f;
+  mars.RevolutionRate = 3.0f;
+  mars.RevolutionSmallRate = 25.0f;
 
   // JUPITER
   Orb jupiter;
@@ -249,14 +477,32 @@ auto main() -> int {
 	  jupiter.RevolutionCenterSmall.x + jupiter.RevolutionRadiusSmall.x,
 	  jupiter.RevolutionCenterSmall.y, jupiter.RevolutionCenterSmall.z);
   jupiter.RevolutionRadius = glm::vec2(jupiter.RevolutionCenterSmall.x);
-  jupiter.Size = glm::vec3(0.03f);
+  jupiter.Size = glm::vec3(14.5f);
   jupiter.RevolutionNr = 2;
   jupiter.RotationAxis = glm::vec3(0.2f, 1.0f, 0.0f);
+  jupiter.RotationRate = 30.0f;
+  jupiter.RevolutionRate = 1.0f;
+  jupiter.RevolutionSmallRate = 20.0f;
+
+  // ---- BODIES ----
+  //-----------------
+  std::vector<Body> bodies = {
+	  {&sun, &sunModel, &sunShader, true},
+	  {&earth, &earthModel, &orbShader, false, earthVt},
+	  {&moon, &moonModel, &orbShader},
+	  {&mercury, &mercuryModel, &orbShader},
+	  {&venus, &venusModel, &orbShader},
+	  {&mars, &marsModel, &orbShader, false, marsVt},
+	  {&jupiter, &jupiterModel, &orbShader}};
+  // the frame's draws, sorted before they're executed
+  RenderQueue renderQueue;
+  // the lit bodies' per-instance data; bodies sharing a mesh share a draw
+  InstanceBatcher instances;
 
   // THE ISS
   unsigned issVAO = setUpTheISS();
   unsigned issDiffuse = loadTexture("resources/textures/iss.png");
-  unsigned issSpecular = loadTexture("resources/textures/iss_specular.png");
+  unsigned issSpecular = loadTexture("resources/textures/iss_specular.png", false);
 
   issShader.use();
   issShader.setInt("material.texture_diffuse", 0);
@@ -264,14 +510,6 @@ auto main() -> int {
 
   // ---- ISS data ----
   // ------------------
-  // pointlight properties
-  issShader.setVec3("light.ambient", sunlight.Ambient);
-  issShader.setVec3("light.diffuse", sunlight.Diffuse);
-  issShader.setVec3("light.specular", sunlight.Specular);
-  issShader.setFloat("light.constant", sunlight.Const);
-  issShader.setFloat("light.linear", sunlight.Linear);
-  issShader.setFloat("light.quadratic", sunlight.Quadratic);
-
   issShader.setVec3("material.ambient", glm::vec3(1.0f));
   issShader.setVec3("material.diffuse", glm::vec3(1.0f));
   issShader.setVec3("material.specular", glm::vec3(1.0f));
@@ -310,11 +548,19 @@ auto main() -> int {
   //    orbShader.use();
   //    orbShader.setInt("depthMap", 0);
 
+  BenchmarkTotals benchmark;
+  auto frameStart = std::chrono::steady_clock::now();
+  glm::vec3 prevCamPosition = cam.Position;
+  bool firstFrame = true;
+  bool startupReported = false;
+  float frameMs = 0.0f;
+
   // rendering loop
   while (!glfwWindowShouldClose(window)) {
 	// poll events
 	glfwPollEvents();
 	processInput(window);
+	FrameStats().Reset();
 
 	// update world state
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -359,14 +605,14 @@ auto main() -> int {
 	//
 	//        // EARTH
 	//        earth.RotationSpeed = glfwGetTime()*30;
-	//        setUpOrbData(earth, orbDepthShader, sunlight, flashlight, true);
+	//        setUpOrbData(earth, orbDepthShader, true);
 	//        earthModel.Draw(orbDepthShader);
 	//
 	//
 	//        // MOON
 	//        moon.RotationSpeed = glfwGetTime() * (-10);
 	//        moon.RevolutionSpeed = glfwGetTime() * 10.5;
-	//        setUpOrbData(moon, orbDepthShader, sunlight, flashlight, true);
+	//        setUpOrbData(moon, orbDepthShader, true);
 	//        moonModel.Draw(orbDepthShader);
 
 	//
@@ -374,7 +620,7 @@ auto main() -> int {
 	//        mercury.RotationSpeed = glfwGetTime() * 2;
 	//        mercury.RevolutionSpeed = glfwGetTime() * 5;
 	//        mercury.RevolutionSmallSpeed = glfwGetTime() * 30;
-	//        setUpOrbData(mercury, orbDepthShader, sunlight, flashlight, true);
+	//        setUpOrbData(mercury, orbDepthShader, true);
 	//        mercuryModel.Draw(orbDepthShader);
 	//
 	//
@@ -382,7 +628,7 @@ auto main() -> int {
 	//        venus.RotationSpeed = glfwGetTime() * 0.2;
 	//        venus.RevolutionSpeed = glfwGetTime() * 2;
 	//        venus.RevolutionSmallSpeed = glfwGetTime() * 20;
-	//        setUpOrbData(venus, orbDepthShader, sunlight, flashlight, true);
+	//        setUpOrbData(venus, orbDepthShader, true);
 	//        venusModel.Draw(orbDepthShader);
 	//
 	//
@@ -390,7 +636,7 @@ auto main() -> int {
 	//        mars.RotationSpeed = glfwGetTime() * 20;
 	//        mars.RevolutionSpeed = glfwGetTime() * 3;
 	//        mars.RevolutionSmallSpeed = glfwGetTime() * 25;
-	//        setUpOrbData(mars, orbDepthShader, sunlight, flashlight, true);
+	//        setUpOrbData(mars, orbDepthShader, true);
 	//        marsModel.Draw(orbDepthShader);
 	//
 	//
@@ -398,7 +644,7 @@ auto main() -> int {
 	//        jupiter.RotationSpeed = glfwGetTime() * 30;
 	//        jupiter.RevolutionSpeed = glfwGetTime();
 	//        jupiter.RevolutionSmallSpeed = glfwGetTime() * 20;
-	//        setUpOrbData(jupiter, orbDepthShader, sunlight, flashlight, true);
+	//        setUpOrbData(jupiter, orbDepthShader, true);
 	//        jupiterModel.Draw(orbDepthShader);
 
 	//        glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -409,127 +655,254 @@ auto main() -> int {
 	// ---- DRAWING OBJECTS ----
 	//--------------------------
 
-	// THE ISS
-	issShader.use();
-	issShader.setVec3("light.position", sunlight.Position);
-
 	glm::mat4 projection =
 		glm::perspective(glm::radians(cam.Zoom),
-						 (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
-	issShader.setMat4("projection", projection);
-	issShader.setMat4("view", cam.GetViewMatrix());
+						 (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, FAR_PLANE);
 
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, issPos);
-	// changing the ISS's position so it rotates around the Earth: k(r*cos() +
-	// a, r*sin() + b); y: making the ISS go up and down
-	model = glm::rotate(model, glm::radians((float)glfwGetTime() * (-4.005f)),
-						glm::vec3(0.0f, 1.0f, 0.0f));
-	issPos =
-		glm::vec3(5 * cos(glm::radians(glfwGetTime() * 5)) + earth.Position.x,
-				  sin(glm::radians(glfwGetTime() * 20)),
-				  5 * sin(glm::radians(glfwGetTime() * 5)) + earth.Position.z);
-	model = glm::scale(model, glm::vec3(0.5f));
-	issShader.setMat4("model", model);
-
-	setSpotlight(issShader, flashlight);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, issDiffuse);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, issSpecular);
+	// every body moves before anything is drawn; the sun lights the others
+	for (Body& body : bodies) {
+	  animateOrb(*body.orb, (float)glfwGetTime());
+	  updateOrbit(*body.orb);
+	}
+	sunlight.Position = sun.Position;
 
-	glDisable(GL_CULL_FACE);
-	glBindVertexArray(issVAO);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	FrameBlock frameBlock;
+	frameBlock.projection = projection;
+	frameBlock.view = cam.GetViewMatrix();
+	frameBlock.viewPos = cam.Position;
+	frameBlock.time = (float)glfwGetTime();
+	LightsBlock lightsBlock;
+	lightsBlock.light = pointLightBlock(sunlight);
+	lightsBlock.spotLight = spotLightBlock(flashlight);
+	frameUniforms.Write(frameBlock, lightsBlock);
+
+	// ---- MODEL STREAMING ----
+	// bodies in view, or in the view from where the camera will be a few
+	// seconds from now at its current speed, get their models loaded
+	ModelLoader::Instance().Update();
+	// trims or restores texture mips for what last frame's bodies requested
+	TextureCache::Instance().Update();
+	glm::vec3 camVelocity =
+		(cam.Position - prevCamPosition) / std::max(frameMs / 1000.0f, 0.001f);
+	prevCamPosition = cam.Position;
+	Frustum viewFrustum =
+		Frustum::FromMatrix(projection * cam.GetViewMatrix());
+	glm::vec3 aheadPosition = cam.Position + camVelocity * PREFETCH_SECONDS;
+	Frustum aheadFrustum = Frustum::FromMatrix(
+		glm::perspective(glm::radians(std::min(cam.Zoom * 1.5f, 120.0f)),
+						 (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, FAR_PLANE) *
+		glm::lookAt(aheadPosition, aheadPosition + cam.Front, cam.Up));
+	// ---- BODIES ----
+	// this frame's models, LODs and instances; a lit body that binds nothing
+	// of its own (see LazyModel::SharedGeometry) is batched with the bodies
+	// that have the same mesh
+	instances.Clear();
+	for (Body& body : bodies) {
+	  body.model->Update(orbModelMatrix(*body.orb), viewFrustum, aheadFrustum);
+	  body.model->SelectLod(pixelsPerModelUnit(*body.orb));
+	  if (body.emissive) {
+		continue;
+	  }
+	  InstanceData instance = orbInstance(*body.orb, *body.model);
+	  GeometryRange mesh, lod;
+	  if (body.virtualTexture < 0 && body.model->SharedGeometry(mesh, lod)) {
+		body.instance =
+			instances.Add(instance, *body.shader, mesh, lod,
+						  glm::length(body.orb->Position - cam.Position));
+	  } else {
+		body.instance = instances.Add(instance);
+	  }
+	}
+	instances.Upload();
+
+	// ---- VIRTUAL TEXTURE FEEDBACK ----
+	// tiles arrive a few frames late anyway
+	if (virtualTextures.Count() > 0) {
+	  virtualTextures.BeginFeedback(SCR_WIDTH, SCR_HEIGHT);
+	  vtFeedbackShader.use();
+	  for (Body& body : bodies) {
+		if (body.virtualTexture >= 0) {
+		  virtualTextures.SetFeedbackUniforms(vtFeedbackShader,
+											  body.virtualTexture);
+		  body.model->DrawInstance(vtFeedbackShader,
+								   instances.BaseInstance(body.instance));
+		}
+	  }
+	  virtualTextures.EndFeedback();
+	  virtualTextures.Update();
+	}
 
-	// ---- PLANETS ----
+	// ---- DRAWING ----
 	// -----------------
-	// SUN
+	// every draw goes through the render queue, which orders them by pass,
+	// program, material and distance and sets only the state that changes
+	surfaceAtlas.Bind();
+	// the sun's program-wide uniforms; the flashlight lights the sun up fully
 	sunShader.use();
-	sunShader.setMat4("projection", projection);
-	sunShader.setMat4("view", cam.GetViewMatrix());
 	sunShader.setVec3("material.diffuse", glm::vec3(1.0f));
+	sunShader.setVec3("flashlightAmbient",
+					  glm::vec3(flashlightOn ? 1.0f : 0.0f));
+
+	// BODIES
+	// the ones drawing themselves: the sun (with uniforms), bodies with
+	// textures or a virtual texture of their own, and proxies
+	for (Body& body : bodies) {
+	  if (!body.emissive && instances.Batched(body.instance)) {
+		continue;
+	  }
+	  RenderState state;
+	  state.program = body.shader->ID;
+	  uint64_t key = renderQueue.Key(
+		  RenderPass::Opaque, body.shader->ID, body.model->MaterialKey(),
+		  glm::length(body.orb->Position - cam.Position), FAR_PLANE);
+	  Body* b = &body;
+	  GLuint baseInstance =
+		  body.emissive ? 0 : instances.BaseInstance(body.instance);
+	  renderQueue.Submit(key, state, [b, baseInstance, &virtualTextures]() {
+		if (b->emissive) {
+		  setUpOrbData(*b->orb, *b->shader);
+		  SurfaceAtlas::SetUniforms(*b->shader, b->model->SurfaceLayer());
+		  b->model->Draw(*b->shader);
+		} else {
+		  virtualTextures.SetUniforms(*b->shader, b->virtualTexture);
+		  b->model->DrawInstance(*b->shader, baseInstance);
+		}
+	  });
+	}
+	// and the rest, one draw per mesh
+	for (const InstanceBatch& batch : instances.Batches()) {
+	  RenderState state;
+	  state.program = batch.shader->ID;
+	  const InstanceBatch* shared = &batch;
+	  renderQueue.Submit(
+		  renderQueue.Key(RenderPass::Opaque, batch.shader->ID, 0, batch.depth,
+						  FAR_PLANE),
+		  state, [shared, &virtualTextures]() {
+			virtualTextures.SetUniforms(*shared->shader, -1);
+			InstanceBatcher::Draw(*shared);
+		  });
+	}
 
-	flashlight.Ambient = glm::vec3(1.0f);
-	sun.RotationSpeed = glfwGetTime() * 2;
-	sun.RevolutionSpeed = glfwGetTime() * 5;
-	setUpOrbData(sun, sunShader, sunlight, flashlight);
-	sunModel.Draw(sunShader);
-	sunlight.Position = sun.Position;
-
-	flashlight.Ambient = glm::vec3(0.0f);
-
-	orbShader.use();
-	orbShader.setMat4("projection", projection);
-	orbShader.setMat4("view", cam.GetViewMatrix());
-
-	// EARTH
-	earth.RotationSpeed = glfwGetTime() * 30;
-	setUpOrbData(earth, orbShader, sunlight, flashlight);
-	earthModel.Draw(orbShader);
-
-	// MOON
-	moon.RotationSpeed = glfwGetTime() * (-10);
-	moon.RevolutionSpeed = glfwGetTime() * 10.5;
-	setUpOrbData(moon, orbShader, sunlight, flashlight);
-	moonModel.Draw(orbShader);
-
-	// MERCURY
-	mercury.RotationSpeed = glfwGetTime() * 2;
-	mercury.RevolutionSpeed = glfwGetTime() * 5;
-	mercury.RevolutionSmallSpeed = glfwGetTime() * 30;
-	setUpOrbData(mercury, orbShader, sunlight, flashlight);
-	mercuryModel.Draw(orbShader);
-
-	// VENUS
-	venus.RotationSpeed = glfwGetTime() * 0.2;
-	venus.RevolutionSpeed = glfwGetTime() * 2;
-	venus.RevolutionSmallSpeed = glfwGetTime() * 20;
-	setUpOrbData(venus, orbShader, sunlight, flashlight);
-	venusModel.Draw(orbShader);
-
-	// MARS
-	mars.RotationSpeed = glfwGetTime() * 20;
-	mars.RevolutionSpeed = glfwGetTime() * 3;
-	mars.RevolutionSmallSpeed = glfwGetTime() * 25;
-	setUpOrbData(mars, orbShader, sunlight, flashlight);
-	marsModel.Draw(orbShader);
-
-	// JUPITER
-	jupiter.RotationSpeed = glfwGetTime() * 30;
-	jupiter.RevolutionSpeed = glfwGetTime();
-	jupiter.RevolutionSmallSpeed = glfwGetTime() * 20;
-	setUpOrbData(jupiter, orbShader, sunlight, flashlight);
-	jupiterModel.Draw(orbShader);
-
-	//        glActiveTexture(GL_TEXTURE0);
-	//        glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+	// THE ISS
+	glm::mat4 issModel = glm::mat4(1.0f);
+	issModel = glm::translate(issModel, issPos);
+	// changing the ISS's position so it rotates around the Earth: k(r*cos() +
+	// a, r*sin() + b); y: making the ISS go up and down
+	issModel =
+		glm::rotate(issModel, glm::radians((float)glfwGetTime() * (-4.005f)),
+					glm::vec3(0.0f, 1.0f, 0.0f));
+	issPos =
+		glm::vec3(5 * cos(glm::radians(glfwGetTime() * 5)) + earth.Position.x,
+				  sin(glm::radians(glfwGetTime() * 20)),
+				  5 * sin(glm::radians(glfwGetTime() * 5)) + earth.Position.z);
+	issModel = glm::scale(issModel, glm::vec3(0.5f));
+	RenderState issState;
+	issState.program = issShader.ID;
+	issState.cullFace = false;	// the quad is seen from both sides
+	renderQueue.Submit(
+		renderQueue.Key(RenderPass::Opaque, issShader.ID, issDiffuse,
+						glm::length(glm::vec3(issModel[3]) - cam.Position),
+						FAR_PLANE),
+		issState, [&]() {
+		  issShader.setMat4("model", issModel);
+		  glActiveTexture(GL_TEXTURE0);
+		  glBindTexture(GL_TEXTURE_2D, issDiffuse);
+		  glActiveTexture(GL_TEXTURE1);
+		  glBindTexture(GL_TEXTURE_2D, issSpecular);
+		  glBindVertexArray(issVAO);
+		  glDrawArrays(GL_TRIANGLES, 0, 6);
+		});
 
 	// ---- SKYBOX ----
 	// ----------------
-	glDepthFunc(GL_LEQUAL);
-
-	skyboxShader.use();
-	glm::mat4 view = glm::mat4(glm::mat3(cam.GetViewMatrix()));
-	skyboxShader.setMat4("view", view);
-	skyboxShader.setMat4("projection", projection);
-
-	glBindVertexArray(skyboxVAO);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
-	glDepthFunc(GL_LESS);
+	RenderState skyboxState;
+	skyboxState.program = skyboxShader.ID;
+	skyboxState.depthFunc = GL_LEQUAL;	// drawn at the far plane
+	renderQueue.Submit(
+		renderQueue.Key(RenderPass::Sky, skyboxShader.ID, skyboxTexture, 0.0f,
+						FAR_PLANE),
+		skyboxState, [&]() {
+		  glBindVertexArray(skyboxVAO);
+		  glActiveTexture(GL_TEXTURE0);
+		  glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
+		  glDrawArrays(GL_TRIANGLES, 0, 36);
+		  glBindVertexArray(0);
+		});
+
+	renderQueue.Execute();
+
+	if (hudOn) {
+	  drawHud(frameMs, virtualTextures);
+	}
 
 	// render image
+	frameUniforms.EndFrame();
+	GeometryPool::Instance().EndFrame();
 	glfwSwapBuffers(window);
+	if (firstFrame) {
+	  firstFrame = false;
+	  std::cout << "first frame after "
+				<< std::chrono::duration<double, std::milli>(
+					   std::chrono::steady_clock::now() - launchTime)
+					   .count()
+				<< " ms, peak RSS " << PeakResidentBytes() / (1024 * 1024)
+				<< " MB\n";
+	}
+	// start-up ends when the first wave of models (the bodies in view) is in
+	if (!startupReported && ModelLoader::Instance().Loaded() > 0 &&
+		ModelLoader::Instance().Pending() == 0) {
+	  startupReported = true;
+	  std::cout << "visible models loaded after "
+				<< std::chrono::duration<double, std::milli>(
+					   std::chrono::steady_clock::now() - launchTime)
+					   .count()
+				<< " ms, peak RSS " << PeakResidentBytes() / (1024 * 1024)
+				<< " MB, decodes held up to "
+				<< DecodeMemoryGate::Instance().PeakReserved() / (1024 * 1024)
+				<< " of " << DecodeMemoryGate::Instance().Ceiling() / (1024 * 1024)
+				<< " MB\n";
+	  BatchReadStats readAhead = AssetReadAhead::Instance().Totals();
+	  if (readAhead.files > 0) {
+		std::cout << "read ahead " << readAhead.files << " files, "
+				  << readAhead.bytes / 1024 << " KB in " << readAhead.requests
+				  << " requests via " << readAhead.engine << ", queue depth "
+				  << readAhead.maxInFlight << ", "
+				  << readAhead.seconds * 1000.0 << " ms\n";
+	  }
+	  // start-up files nobody opened aren't worth holding on to
+	  AssetReadAhead::Instance().Clear();
+	}
+
+	auto frameEnd = std::chrono::steady_clock::now();
+	frameMs =
+		std::chrono::duration<float, std::milli>(frameEnd - frameStart).count();
+	frameStart = frameEnd;
+
+	if (benchmarkFrames > 0) {
+	  const RenderStats& stats = FrameStats();
+	  benchmark.frames++;
+	  benchmark.frameMs += frameMs;
+	  benchmark.trianglesDrawn += stats.trianglesDrawn;
+	  benchmark.trianglesFullDetail += stats.trianglesFullDetail;
+	  benchmark.drawCalls += stats.drawCalls;
+	  benchmark.uniformCalls += stats.uniformCalls;
+	  if (benchmark.frames >= benchmarkFrames) {
+		glfwSetWindowShouldClose(window, true);
+	  }
+	}
+  }
+
+  if (benchmarkFrames > 0) {
+	printBenchmark(benchmark);
   }
+  writeLoadReport();
 
   // de-init
+  ImGui_ImplOpenGL3_Shutdown();
+  ImGui_ImplGlfw_Shutdown();
+  ImGui::DestroyContext();
+  virtualTextures.Release();
+  TextureCache::Instance().ContextDestroyed();
   glfwTerminate();
   return 0;
 }
@@ -558,6 +931,8 @@ void processInput(GLFWwindow* window) {
 //------------------------
 void frameBufferSizeCallback(GLFWwindow* window, int width, int height) {
   glViewport(0, 0, width, height);
+  SCR_WIDTH = width;
+  SCR_HEIGHT = height;
 }
 //------------------------
 // whenever the mouse cursor changes it's position, this function is called
@@ -576,42 +951,59 @@ void scrollCallback(GLFWwindow* window, double offsetX, double offsetY) {
   cam.ProcessMouseScroll(offsetY);
 }
 //------------------------
-// setting up the shader data to draw the planets and the sun
+// model matrix of an orb at its current position
 //------------------------
-void setUpOrbData(Orb& o,
-				  Shader& s,
-				  PointLight& pl,
-				  SpotLight& sl,
-				  bool depth) {
-  // depth == true => we don't need/have these attributes
-  if (!depth) {
-	// PointLight
-	s.setVec3("light.position", pl.Position);
-	s.setVec3("light.ambient", pl.Ambient);
-	s.setVec3("light.diffuse", pl.Diffuse);
-	s.setVec3("light.specular", pl.Specular);
-	s.setFloat("light.constant", pl.Const);
-	s.setFloat("light.linear", pl.Linear);
-	s.setFloat("light.quadratic", pl.Quadratic);
-
-	// SpotLight
-	setSpotlight(s, sl);
-
-	s.setVec3("material.ambient", o.Ambient);
-	s.setVec3("material.diffuse", o.Diffuse);
-	s.setVec3("material.specular", o.Specular);
-	s.setFloat("material.shininess", 32.0f);
-
-	s.setVec3("ViewPos", cam.Position);
-  }
-
-  // transformations
+auto orbModelMatrix(const Orb& o) -> glm::mat4 {
   glm::mat4 model = glm::mat4(1.0f);
   model = glm::translate(model, o.Position);
   model = glm::rotate(model, glm::radians(o.RotationSpeed), o.RotationAxis);
   model = glm::scale(model, o.Size);
-  s.setMat4("model", model);
+  return model;
+}
+//------------------------
+// what someVS draws a lit orb with: where it is (or its proxy, until the
+// model is in) and its material
+//------------------------
+auto orbInstance(const Orb& o, const LazyModel& m) -> InstanceData {
+  InstanceData instance;
+  instance.Model = m.InstanceTransform();
+  instance.Ambient = o.Ambient;
+  instance.Diffuse = o.Diffuse;
+  instance.Specular = o.Specular;
+  instance.Shininess = 32.0f;
+  instance.SurfaceLayer = m.SurfaceLayer();
+  return instance;
+}
+//------------------------
+// setting up the shader data to draw the sun (programs without instances)
+//------------------------
+void setUpOrbData(Orb& o, Shader& s, bool depth) {
+  const OrbUniforms& u = orbUniforms(s, !depth);
+  // depth == true => we don't need/have these attributes
+  if (!depth) {
+	s.set(u.materialAmbient, o.Ambient);
+	s.set(u.materialDiffuse, o.Diffuse);
+	s.set(u.materialSpecular, o.Specular);
+	s.set(u.materialShininess, 32.0f);
+  }
 
+  // transformations
+  s.set(u.model, orbModelMatrix(o));
+  updateOrbit(o);
+}
+//------------------------
+// turns the orb's rates into the angles it's at after `seconds`
+//------------------------
+void animateOrb(Orb& o, float seconds) {
+  o.RotationSpeed = seconds * o.RotationRate;
+  o.RevolutionSpeed = seconds * o.RevolutionRate;
+  o.RevolutionSmallSpeed = seconds * o.RevolutionSmallRate;
+}
+//------------------------
+// moves the orb along its orbit (or orbit around an orbit) to where its
+// revolution speeds put it
+//------------------------
+void updateOrbit(Orb& o) {
   float x, y, z, xp, yp, zp;
   switch (o.RevolutionNr) {
 	case 1: {
@@ -733,72 +1125,53 @@ auto setUpTheSkybox() -> unsigned {
 //------------------------
 // loading a 2D texture from resources/textures
 //------------------------
-auto loadTexture(const char* path) -> unsigned {
-  unsigned tex0;
-  int width, height, nrChannels;
-  unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-
-  if (data) {
-	glGenTextures(1, &tex0);
-	glBindTexture(GL_TEXTURE_2D, tex0);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	GLenum format;
-	switch (nrChannels) {
-	  case 1: {
-		format = GL_RED;
-	  } break;
-	  case 3: {
-		format = GL_RGB;
-	  } break;
-	  case 4: {
-		format = GL_RGBA;
-	  } break;
-	}
-
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-				 GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-  } else {
+auto loadTexture(const char* path, bool srgb) -> unsigned {
+  // goes through the texture cache so cooked builds get the compressed copy
+  unsigned tex0 = TextureCache::Instance().Acquire(path, srgb);
+  if (tex0 == 0) {
 	std::cout << "Failed to load texture!\n";
   }
-  stbi_image_free(data);
-
   return tex0;
 }
 //------------------------
-// loading a 2D texture for the skybox from resources/textures
+// loading the skybox cube map: solar_cook's compressed .scube in cooked mode,
+// otherwise the six faces decoded in parallel with their mips built on the CPU
 //------------------------
 unsigned loadSkybox(std::vector<std::string>& faces) {
-  unsigned textureID;
-  glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-  int width, height, nrChannels;
-  for (unsigned i = 0; i < faces.size(); i++) {
-	unsigned char* data =
-		stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-	if (data) {
-	  glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB_ALPHA, width,
-				   height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-	  stbi_image_free(data);
-	} else {
-	  std::cout << "Cubemap tex failed to load at path: " << faces[i]
-				<< std::endl;
-	  stbi_image_free(data);
+  CubemapImage image;
+  std::string cooked = CookedCubemapPath(SKYBOX_NAME);
+  bool loaded = false;
+  if (UseCookedAssets()) {
+	AssetView file;
+	{
+	  ScopedLoadTimer timer(cooked, "skybox", LoadStage::Read);
+	  file = OpenAsset(cooked);
 	}
+	if (file.ok) {
+	  LoadReport::Instance().AddBytes(cooked, "skybox", file.size);
+	  ScopedLoadTimer timer(cooked, "skybox", LoadStage::Parse);
+	  loaded = ParseCookedCubemap(file.data, file.size, image.cooked);
+	}
+	if (!loaded) {
+	  std::cout << "Missing or stale " << cooked
+				<< ", decoding the skybox faces instead\n";
+	  image.cooked.clear();
+	}
+  }
+  if (!loaded) {
+	// before any model, so nothing else holds the decode memory gate yet
+	loaded = DecodeCubemapFaces(faces, true, MipFilter::Kaiser, image.decoded,
+								image.reservation);
+  }
+  if (!loaded) {
+	std::cout << "Cubemap faces failed to load: " << faces[0] << " ...\n";
+	return 0;
   }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-  return textureID;
+  ScopedLoadTimer timer(image.cooked.empty() ? faces[0] : cooked, "skybox",
+						LoadStage::Upload);
+  TextureCache::Instance().AddPinnedBytes(image.Bytes());
+  return UploadCubemap(image, true);
 }
 //------------------------
 // processes input from relevant keys
@@ -811,25 +1184,168 @@ void keyCallback(GLFWwindow* window,
   if (key == GLFW_KEY_F && action == GLFW_PRESS) {
 	flashlightOn = !flashlightOn;
   }
+  if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+	hudOn = !hudOn;
+  }
+  if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+	writeLoadReport();
+  }
+}
+//------------------------
+// writes the per-asset load times to load_report.json / load_report.txt
+//------------------------
+void writeLoadReport() {
+  LoadReport& report = LoadReport::Instance();
+  if (report.Write("load_report")) {
+	std::cout << "Load report (" << report.Assets()
+			  << " assets) written to load_report.json and load_report.txt\n";
+  } else {
+	std::cout << "Could not write the load report\n";
+  }
 }
 //------------------------
-// sets and updates spotlight properites
+// the lights as the Lights uniform block lays them out; the flashlight shines
+// from the camera
 //------------------------
-void setSpotlight(Shader& s, SpotLight& sl) {
-  s.setVec3("spotLight.position", cam.Position);
-  s.setVec3("spotLight.direction", cam.Front);
-  s.setFloat("spotLight.cutoff", cos(glm::radians(sl.Cutoff)));
-  s.setFloat("spotLight.outerCutoff", cos(glm::radians(sl.OuterCutoff)));
+auto pointLightBlock(const PointLight& pl) -> PointLightBlock {
+  PointLightBlock block = {};
+  block.position = pl.Position;
+  block.ambient = pl.Ambient;
+  block.diffuse = pl.Diffuse;
+  block.specular = pl.Specular;
+  block.constant = pl.Const;
+  block.linear = pl.Linear;
+  block.quadratic = pl.Quadratic;
+  return block;
+}
+auto spotLightBlock(const SpotLight& sl) -> SpotLightBlock {
+  SpotLightBlock block = {};
+  block.position = cam.Position;
+  block.direction = cam.Front;
+  block.cutOff = cos(glm::radians(sl.Cutoff));
+  block.outerCutOff = cos(glm::radians(sl.OuterCutoff));
   if (flashlightOn) {
-	s.setVec3("spotLight.ambient", sl.Ambient);
-	s.setVec3("spotLight.diffuse", sl.Diffuse);
-	s.setVec3("spotLight.specular", sl.Specular);
-  } else {	// All to 0.
-	s.setVec3("spotLight.ambient", glm::vec3(0.0f));
-	s.setVec3("spotLight.diffuse", glm::vec3(0.0f));
-	s.setVec3("spotLight.specular", glm::vec3(0.0f));
+	block.ambient = sl.Ambient;
+	block.diffuse = sl.Diffuse;
+	block.specular = sl.Specular;
+  }	 // otherwise all 0
+  block.constant = sl.Const;
+  block.linear = sl.Linear;
+  block.quadratic = sl.Quadratic;
+  return block;
+}
+//------------------------
+// per-body uniform handles of a program; the material ones are resolved the
+// first time the program draws a lit body, so depth-only programs aren't
+// reported for lacking them
+//------------------------
+auto orbUniforms(const Shader& s, bool lit) -> const OrbUniforms& {
+  static std::unordered_map<unsigned, OrbUniforms> programs;
+  auto it = programs.find(s.ID);
+  if (it == programs.end()) {
+	it = programs.emplace(s.ID, OrbUniforms()).first;
+	it->second.model = s.Resolve<glm::mat4>("model");
+  }
+  OrbUniforms& u = it->second;
+  if (lit && !u.lit) {
+	u.lit = true;
+	u.materialAmbient = s.Resolve<glm::vec3>("material.ambient");
+	u.materialDiffuse = s.Resolve<glm::vec3>("material.diffuse");
+	u.materialSpecular = s.Resolve<glm::vec3>("material.specular");
+	u.materialShininess = s.Resolve<float>("material.shininess");
+  }
+  return u;
+}
+//------------------------
+// how many screen pixels one unit of the orb's model space covers at its
+// current distance from the camera; drives LOD selection
+//------------------------
+auto pixelsPerModelUnit(const Orb& o) -> float {
+  float distance = std::max(glm::length(o.Position - cam.Position), 0.1f);
+  float pixelsPerWorldUnit =
+	  (SCR_HEIGHT / 2.0f) / (distance * tan(glm::radians(cam.Zoom) / 2.0f));
+  return pixelsPerWorldUnit * std::max(o.Size.x, std::max(o.Size.y, o.Size.z));
+}
+//------------------------
+// draws the statistics overlay, toggled with H
+//------------------------
+void drawHud(float frameMs, const VirtualTextureSystem& vt) {
+  const RenderStats& stats = FrameStats();
+
+  ImGui_ImplOpenGL3_NewFrame();
+  ImGui_ImplGlfw_NewFrame();
+  ImGui::NewFrame();
+
+  ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f));
+  ImGui::Begin("Stats", nullptr,
+			   ImGuiWindowFlags_NoDecoration |
+				   ImGuiWindowFlags_AlwaysAutoResize |
+				   ImGuiWindowFlags_NoInputs);
+  ImGui::Text("%.2f ms/frame (%.0f FPS)", frameMs,
+			  frameMs > 0.0f ? 1000.0f / frameMs : 0.0f);
+  ImGui::Text("triangles: %zu drawn / %zu full detail", stats.trianglesDrawn,
+			  stats.trianglesFullDetail);
+  ImGui::Text("draw calls: %zu, %zu bodies instanced", stats.drawCalls,
+			  stats.instancesBatched);
+  ImGui::Text("uniform calls: %zu, plus %zu bytes of frame blocks",
+			  stats.uniformCalls, FrameUniforms::FrameBytes());
+  ImGui::Text("state changes: %zu (%zu redundant skipped)", stats.stateChanges,
+			  stats.stateChangesElided);
+  const TextureCache& textures = TextureCache::Instance();
+  ImGui::Text("textures: %zu shared, %zu cache hits / %zu misses",
+			  textures.Resident(), textures.Hits(), textures.Misses());
+  ImGui::Text("texture memory: %.1f / %.1f MB, %zu mips dropped, %zu streaming",
+			  textures.ResidentBytes() / (1024.0 * 1024.0),
+			  textures.BudgetBytes() / (1024.0 * 1024.0),
+			  textures.DroppedLevels(), textures.Streaming());
+  const ImportStats& import = ImportTotals();
+  ImGui::Text("mesh memory: %.1f MB CPU / %.1f MB GPU, %.1f MB deduplicated",
+			  import.cpuResidentBytes / (1024.0 * 1024.0),
+			  import.gpuResidentBytes / (1024.0 * 1024.0),
+			  import.sharedBytes / (1024.0 * 1024.0));
+  ImGui::Text("process RSS: %.1f MB, %.1f MB freed by dropping CPU geometry",
+			  ResidentBytes() / (1024.0 * 1024.0),
+			  import.rssReleasedBytes / (1024.0 * 1024.0));
+  const ModelLoader& loader = ModelLoader::Instance();
+  ImGui::Text("models: %zu loaded, %zu loading", loader.Loaded(),
+			  loader.Pending());
+  if (vt.Count() > 0) {
+	ImGui::Text("virtual texture pages: %zu / %zu (%zu MB), %zu loading",
+				vt.ResidentPages(), vt.PageCapacity(),
+				vt.CacheBytes() / (1024 * 1024), vt.PendingTiles());
+  }
+  ImGui::End();
+
+  ImGui::Render();
+  ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
+//------------------------
+// prints the per-frame averages gathered in --benchmark mode
+//------------------------
+void printBenchmark(const BenchmarkTotals& b) {
+  if (b.frames == 0) {
+	return;
   }
-  s.setFloat("spotLight.constant", sl.Const);
-  s.setFloat("spotLight.linear", sl.Linear);
-  s.setFloat("spotLight.quadratic", sl.Quadratic);
+  std::cout << "benchmark: " << b.frames << " frames\n"
+			<< "  frame time:          " << b.frameMs / b.frames << " ms\n"
+			<< "  triangles (LOD):     " << b.trianglesDrawn / b.frames << "\n"
+			<< "  triangles (full):    " << b.trianglesFullDetail / b.frames
+			<< "\n"
+			<< "  draw calls:          " << b.drawCalls / b.frames << "\n"
+			<< "  uniform calls:       " << b.uniformCalls / b.frames << "\n"
+			<< "  texture cache:       " << TextureCache::Instance().Hits()
+			<< " hits / " << TextureCache::Instance().Misses() << " misses, "
+			<< TextureCache::Instance().Resident() << " textures\n";
+  const ImportStats& import = ImportTotals();
+  std::cout << "  model import:        " << import.meshes << " meshes, "
+			<< import.ThroughputMBps() << " MB/s, " << import.allocations
+			<< " allocations converting (" << import.buildAllocations
+			<< " building meshes), "
+			<< (import.readSeconds + import.convertSeconds) * 1000.0
+			<< " ms (+" << import.lodSeconds * 1000.0 << " ms LODs)\n"
+			<< "  mesh memory:         "
+			<< import.cpuResidentBytes / 1024 << " KB CPU / "
+			<< import.gpuResidentBytes / 1024 << " KB GPU, RSS down "
+			<< import.rssReleasedBytes / 1024 << " KB on the release"
+			<< std::endl;
 }
@@ -0,0 +1,488 @@
+// solar_cook: turns the source assets listed in resources/assets.txt into the
+// runtime-ready files the viewer loads in cooked mode (release builds, or
+// --cooked):
+//   models   -> cooked/<path>.smesh  (converted meshes with their LOD chains)
+//   textures -> cooked/<path>.stex   (BC1/BC3/BC4 with a CPU-built mip chain)
+//   cube maps -> cooked/<name>.scube (six .stex faces in one file)
+//   shaders  -> cooked/shaders/*.sprog (linked program binaries)
+// All of those, the shader sources and the files listed as `file` are then
+// packed into cooked/assets.pack, which the viewer maps instead of opening them
+// one by one. Every output is recorded in cooked/manifest.txt with a hash of
+// everything it was built from, so a rerun only rebuilds what changed. Run it
+// from the repository root; --force rebuilds everything.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+#include "glad/glad.h"
+#include "GLFW/glfw3.h"
+#include "stb_image.h"
+
+#include "asset_pack.h"
+#include "asset_paths.h"
+#include "content_hash.h"
+#include "cooked_cubemap.h"
+#include "cooked_model.h"
+#include "cooked_texture.h"
+#include "model_import.h"
+#include "parallel.h"
+#include "shader.h"
+
+namespace {
+
+// bump when an output format or the cooking itself changes, to rebuild
+// everything
+const char* const COOK_VERSION = "solar_cook 1";
+const char* const MANIFEST_PATH = "cooked/manifest.txt";
+
+struct TextureJob {
+  std::string path;
+  bool srgb;
+};
+
+struct ShaderJob {
+  std::string vertex, fragment, geometry;
+};
+
+// faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order, always sRGB colour
+struct CubemapJob {
+  std::string name;
+  std::vector<std::string> faces;
+};
+
+struct AssetList {
+  std::vector<std::string> models;
+  std::vector<TextureJob> textures;
+  std::vector<ShaderJob> shaders;
+  std::vector<CubemapJob> cubemaps;
+  std::vector<std::string> files;
+};
+
+enum class Outcome { Cooked, UpToDate, Failed };
+
+struct Summary {
+  size_t cooked = 0, upToDate = 0, failed = 0;
+
+  void add(Outcome outcome) {
+	if (outcome == Outcome::Cooked)
+	  cooked++;
+	else if (outcome == Outcome::UpToDate)
+	  upToDate++;
+	else
+	  failed++;
+  }
+};
+
+// one line per asset:  model <path> | texture <path> srgb|linear |
+// shader <vs> <fs> [gs] | cubemap <name> <6 faces> | file <path>
+auto readAssetList(const std::string& path, AssetList& list) -> bool {
+  std::ifstream in(path);
+  if (!in)
+	return false;
+  std::string line;
+  while (std::getline(in, line)) {
+	std::istringstream fields(line);
+	std::string kind;
+	if (!(fields >> kind) || kind[0] == '#')
+	  continue;
+	if (kind == "model") {
+	  std::string model;
+	  if (fields >> model)
+		list.models.push_back(model);
+	} else if (kind == "texture") {
+	  TextureJob job;
+	  std::string space;
+	  if (fields >> job.path) {
+		job.srgb = !(fields >> space) || space != "linear";
+		list.textures.push_back(job);
+	  }
+	} else if (kind == "shader") {
+	  ShaderJob job;
+	  if (fields >> job.vertex >> job.fragment) {
+		fields >> job.geometry;
+		list.shaders.push_back(job);
+	  }
+	} else if (kind == "cubemap") {
+	  CubemapJob job;
+	  std::string face;
+	  fields >> job.name;
+	  while (fields >> face)
+		job.faces.push_back(face);
+	  if (job.faces.size() == CUBE_FACES)
+		list.cubemaps.push_back(job);
+	  else
+		std::cout << path << ": cubemap " << job.name << " needs "
+				  << CUBE_FACES << " faces\n";
+	} else if (kind == "file") {
+	  std::string file;
+	  if (fields >> file)
+		list.files.push_back(file);
+	} else {
+	  std::cout << path << ": unknown asset kind '" << kind << "'\n";
+	}
+  }
+  return true;
+}
+
+// manifest lines are "<hash> <output path>"
+auto readManifest() -> std::map<std::string, uint64_t> {
+  std::map<std::string, uint64_t> manifest;
+  std::ifstream in(MANIFEST_PATH);
+  uint64_t hash;
+  std::string output;
+  while (in >> std::hex >> hash >> output)
+	manifest[output] = hash;
+  return manifest;
+}
+
+auto writeManifest(const std::map<std::string, uint64_t>& manifest) -> bool {
+  MakeParentDirectories(MANIFEST_PATH);
+  std::ofstream out(MANIFEST_PATH, std::ios::trunc);
+  for (const auto& entry : manifest)
+	out << std::hex << entry.second << ' ' << entry.first << '\n';
+  return (bool)out;
+}
+
+auto fileExists(const std::string& path) -> bool {
+  struct stat file;
+  return stat(path.c_str(), &file) == 0;
+}
+
+// a model's output depends on the file itself and on the material libraries
+// next to it
+auto modelHash(const std::string& path) -> uint64_t {
+  uint64_t hash = HashFile(path, HashString(COOK_VERSION));
+  std::string directory = path.substr(0, path.find_last_of('/'));
+  std::vector<std::string> materials;
+  if (DIR* dir = opendir(directory.c_str())) {
+	while (dirent* entry = readdir(dir)) {
+	  std::string name = entry->d_name;
+	  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mtl") == 0)
+		materials.push_back(directory + '/' + name);
+	}
+	closedir(dir);
+  }
+  std::sort(materials.begin(), materials.end());
+  for (const std::string& material : materials)
+	hash = HashFile(material, HashString(material, hash));
+  return hash;
+}
+
+auto textureHash(const TextureJob& job) -> uint64_t {
+  return HashFile(job.path,
+				  HashString(job.srgb ? "srgb" : "linear", HashString(COOK_VERSION)));
+}
+
+auto cookModel(const std::string& path, uint64_t hash,
+			   const std::map<std::string, uint64_t>& manifest,
+			   ImportedModel& model) -> Outcome {
+  std::string output = CookedMeshPath(path);
+  auto it = manifest.find(output);
+  if (it != manifest.end() && it->second == hash &&
+	  ReadCookedModel(output, model))
+	return Outcome::UpToDate;
+
+  ImportStats stats;
+  if (!ImportModel(path, model, stats)) {
+	std::cout << "failed to import " << path << '\n';
+	return Outcome::Failed;
+  }
+  if (!MakeParentDirectories(output) || !WriteCookedModel(output, model)) {
+	std::cout << "failed to write " << output << '\n';
+	return Outcome::Failed;
+  }
+  return Outcome::Cooked;
+}
+
+auto cookTexture(const TextureJob& job, uint64_t hash,
+				 const std::map<std::string, uint64_t>& manifest) -> Outcome {
+  std::string output = CookedTexturePath(job.path);
+  auto it = manifest.find(output);
+  if (it != manifest.end() && it->second == hash && fileExists(output))
+	return Outcome::UpToDate;
+
+  int width, height, channels;
+  unsigned char* data = stbi_load(job.path.c_str(), &width, &height, &channels, 0);
+  if (!data) {
+	std::cout << "failed to decode " << job.path << '\n';
+	return Outcome::Failed;
+  }
+  MipChain chain = GenerateMipChain(data, width, height, channels, job.srgb,
+									MipFilter::Kaiser);
+  stbi_image_free(data);
+  CookedTexture texture = CompressMipChain(chain);
+  if (!MakeParentDirectories(output) || !WriteCookedTexture(output, texture)) {
+	std::cout << "failed to write " << output << '\n';
+	return Outcome::Failed;
+  }
+  return Outcome::Cooked;
+}
+
+auto cubemapHash(const CubemapJob& job) -> uint64_t {
+  uint64_t hash = HashString(COOK_VERSION);
+  for (const std::string& face : job.faces)
+	hash = HashFile(face, HashString(face, hash));
+  return hash;
+}
+
+auto cookCubemap(const CubemapJob& job, uint64_t hash,
+				 const std::map<std::string, uint64_t>& manifest) -> Outcome {
+  std::string output = CookedCubemapPath(job.name);
+  auto it = manifest.find(output);
+  if (it != manifest.end() && it->second == hash && fileExists(output))
+	return Outcome::UpToDate;
+
+  std::vector<MipChain> chains;
+  DecodeReservation reservation;
+  if (!DecodeCubemapFaces(job.faces, true, MipFilter::Kaiser, chains,
+						  reservation)) {
+	std::cout << "failed to decode the faces of " << job.name
+			  << " (they must be square and of one size)\n";
+	return Outcome::Failed;
+  }
+  std::vector<CookedTexture> faces(CUBE_FACES);
+  for (int i = 0; i < CUBE_FACES; i++)
+	faces[i] = CompressMipChain(chains[i]);
+  if (!MakeParentDirectories(output) || !WriteCookedCubemap(output, faces)) {
+	std::cout << "failed to write " << output << '\n';
+	return Outcome::Failed;
+  }
+  return Outcome::Cooked;
+}
+
+// program binaries need a GL context of the driver that will load them; an
+// invisible window is enough
+auto cookShaders(const std::vector<ShaderJob>& shaders, bool force,
+				 const std::map<std::string, uint64_t>& manifest,
+				 std::map<std::string, uint64_t>& updated, Summary& summary)
+	-> void {
+  if (shaders.empty())
+	return;
+  if (glfwInit() != GLFW_TRUE) {
+	std::cout << "no display, shader binaries not cooked\n";
+	return;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow* window = glfwCreateWindow(64, 64, "solar_cook", nullptr, nullptr);
+  if (window == nullptr) {
+	std::cout << "no OpenGL 4.5 context, shader binaries not cooked\n";
+	glfwTerminate();
+	return;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+	std::cout << "could not load GLAD functions, shader binaries not cooked\n";
+	glfwTerminate();
+	return;
+  }
+
+  uint64_t driver = DriverHash();
+  for (const ShaderJob& job : shaders) {
+	std::string output =
+		CookedShaderPath(job.vertex, job.fragment, job.geometry);
+	uint64_t hash = HashFile(job.vertex, HashString(COOK_VERSION, driver));
+	hash = HashFile(job.fragment, hash);
+	if (!job.geometry.empty())
+	  hash = HashFile(job.geometry, hash);
+	updated[output] = hash;
+
+	auto it = manifest.find(output);
+	if (!force && it != manifest.end() && it->second == hash &&
+		fileExists(output)) {
+	  summary.add(Outcome::UpToDate);
+	  continue;
+	}
+	Shader shader(job.vertex.c_str(), job.fragment.c_str(),
+				  job.geometry.empty() ? nullptr : job.geometry.c_str());
+	bool saved = MakeParentDirectories(output) &&
+				 SaveProgramBinary(shader.ID, output, shader.sourceHash);
+	glDeleteProgram(shader.ID);
+	if (!saved) {
+	  std::cout << "failed to save the program binary " << output << '\n';
+	  updated.erase(output);
+	}
+	summary.add(saved ? Outcome::Cooked : Outcome::Failed);
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+}
+
+// everything the pack holds, in about the order the viewer reads it: shaders,
+// the files used as they are, then the cooked textures and meshes
+auto packContents(const AssetList& assets,
+				  const std::map<std::string, uint64_t>& outputs)
+	-> std::vector<std::string> {
+  std::vector<std::string> files;
+  std::set<std::string> seen;
+  auto add = [&](const std::string& file) {
+	if (!file.empty() && seen.insert(file).second)
+	  files.push_back(file);
+  };
+  for (const ShaderJob& job : assets.shaders) {
+	add(job.vertex);
+	add(job.fragment);
+	add(job.geometry);
+	std::string binary =
+		CookedShaderPath(job.vertex, job.fragment, job.geometry);
+	if (outputs.count(binary))
+	  add(binary);
+  }
+  for (const std::string& file : assets.files)
+	add(file);
+  for (const char* extension : {".scube", ".stex", ".smesh"}) {
+	for (const auto& output : outputs) {
+	  const std::string& name = output.first;
+	  size_t length = std::strlen(extension);
+	  if (name.size() > length &&
+		  name.compare(name.size() - length, length, extension) == 0)
+		add(name);
+	}
+  }
+  return files;
+}
+
+auto writePack(const std::vector<std::string>& files, bool force,
+			   const std::map<std::string, uint64_t>& manifest,
+			   std::map<std::string, uint64_t>& updated) -> Outcome {
+  uint64_t hash = HashString(COOK_VERSION);
+  for (const std::string& file : files)
+	hash = HashFile(file, HashString(file, hash));
+  auto it = manifest.find(ASSET_PACK_PATH);
+  if (!force && it != manifest.end() && it->second == hash &&
+	  fileExists(ASSET_PACK_PATH)) {
+	updated[ASSET_PACK_PATH] = hash;
+	return Outcome::UpToDate;
+  }
+
+  std::vector<PackInput> inputs(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+	inputs[i].path = files[i];
+	if (!ReadFileBytes(files[i], inputs[i].bytes)) {
+	  std::cout << "failed to read " << files[i] << " for the pack\n";
+	  return Outcome::Failed;
+	}
+  }
+  PackWriteStats stats;
+  if (!MakeParentDirectories(ASSET_PACK_PATH) ||
+	  !WriteAssetPack(ASSET_PACK_PATH, inputs, &stats)) {
+	std::cout << "failed to write " << ASSET_PACK_PATH << '\n';
+	return Outcome::Failed;
+  }
+  std::cout << "packed " << stats.files << " files (" << stats.compressedFiles
+			<< " compressed), " << stats.inputBytes / 1024 << " KB -> "
+			<< stats.packBytes / 1024 << " KB\n";
+  updated[ASSET_PACK_PATH] = hash;
+  return Outcome::Cooked;
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  std::string assetsPath = "resources/assets.txt";
+  bool force = false;
+  for (int i = 1; i < argc; i++) {
+	if (std::strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+	  assetsPath = argv[++i];
+	} else if (std::strcmp(argv[i], "--force") == 0) {
+	  force = true;
+	} else {
+	  std::cout << "usage: solar_cook [--assets <list>] [--force]\n";
+	  return 2;
+	}
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  AssetList assets;
+  if (!readAssetList(assetsPath, assets)) {
+	std::cout << "could not read " << assetsPath << '\n';
+	return 1;
+  }
+  std::map<std::string, uint64_t> manifest;
+  if (!force)
+	manifest = readManifest();
+  std::map<std::string, uint64_t> updated;
+  Summary summary;
+
+  // models first: their materials add to the texture list
+  std::vector<uint64_t> modelHashes(assets.models.size());
+  std::vector<ImportedModel> models(assets.models.size());
+  std::vector<Outcome> modelOutcomes(assets.models.size());
+  ParallelFor(assets.models.size(), [&](size_t i) {
+	modelHashes[i] = modelHash(assets.models[i]);
+	modelOutcomes[i] =
+		cookModel(assets.models[i], modelHashes[i], manifest, models[i]);
+  });
+
+  std::map<std::string, bool> textureSpaces;  // path -> srgb, deduplicated
+  for (const TextureJob& job : assets.textures)
+	textureSpaces[job.path] = job.srgb;
+  for (size_t i = 0; i < models.size(); i++) {
+	summary.add(modelOutcomes[i]);
+	if (modelOutcomes[i] == Outcome::Failed)
+	  continue;
+	updated[CookedMeshPath(assets.models[i])] = modelHashes[i];
+	for (const ImportedMesh& mesh : models[i].meshes) {
+	  for (const TextureRef& ref : mesh.textures) {
+		// only diffuse maps hold sRGB colour, as in Model
+		textureSpaces[models[i].directory + '/' + ref.path] =
+			ref.type == "texture_diffuse";
+	  }
+	}
+  }
+  models.clear();
+
+  std::vector<TextureJob> textures;
+  for (const auto& entry : textureSpaces)
+	textures.push_back(TextureJob{entry.first, entry.second});
+  std::vector<uint64_t> textureHashes(textures.size());
+  std::vector<Outcome> textureOutcomes(textures.size());
+  ParallelFor(textures.size(), [&](size_t i) {
+	textureHashes[i] = textureHash(textures[i]);
+	textureOutcomes[i] = cookTexture(textures[i], textureHashes[i], manifest);
+  });
+  for (size_t i = 0; i < textures.size(); i++) {
+	summary.add(textureOutcomes[i]);
+	if (textureOutcomes[i] != Outcome::Failed)
+	  updated[CookedTexturePath(textures[i].path)] = textureHashes[i];
+  }
+
+  // each cube map decodes and compresses its faces in parallel already
+  for (const CubemapJob& job : assets.cubemaps) {
+	uint64_t hash = cubemapHash(job);
+	Outcome outcome = cookCubemap(job, hash, manifest);
+	summary.add(outcome);
+	if (outcome != Outcome::Failed)
+	  updated[CookedCubemapPath(job.name)] = hash;
+  }
+
+  cookShaders(assets.shaders, force, manifest, updated, summary);
+  summary.add(
+	  writePack(packContents(assets, updated), force, manifest, updated));
+
+  if (!writeManifest(updated)) {
+	std::cout << "could not write " << MANIFEST_PATH << '\n';
+	return 1;
+  }
+  double seconds = std::chrono::duration<double>(
+					   std::chrono::steady_clock::now() - start)
+					   .count();
+  std::cout << "solar_cook: " << summary.cooked << " cooked, "
+			<< summary.upToDate << " up to date, " << summary.failed
+			<< " failed in " << seconds << " s\n";
+  return summary.failed == 0 ? 0 : 1;
+}